@@ -26,6 +26,20 @@
 #import <Dropbox/Dropbox.h>
 #import <CoreData/CoreData.h>
 
+@class PKEntitySyncPlan;
+
 @interface DBRecord (ParcelKit)
 - (void)pk_setFieldsWithManagedObject:(NSManagedObject *)managedObject syncAttributeName:(NSString *)syncAttributeName;
+- (void)pk_setFieldsWithManagedObject:(NSManagedObject *)managedObject syncPlan:(PKEntitySyncPlan *)syncPlan;
+
+// Only sets the fields of the properties changed since the managed object was last saved,
+// the record must already hold the fields of the last saved state.
+- (void)pk_setChangedFieldsWithManagedObject:(NSManagedObject *)managedObject syncPlan:(PKEntitySyncPlan *)syncPlan;
+
+// Returns the values read with the sync plan with related managed objects replaced by their sync identifiers,
+// so that the fields can be set away from the thread of the managed object context.
++ (NSDictionary *)pk_fieldValuesWithValues:(NSDictionary *)values syncPlan:(PKEntitySyncPlan *)syncPlan;
+
+// Sets the fields of values already read with the sync plan.
+- (void)pk_setFieldsWithValues:(NSDictionary *)values syncPlan:(PKEntitySyncPlan *)syncPlan;
 @end
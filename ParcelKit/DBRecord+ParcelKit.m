@@ -23,166 +23,364 @@
 //  THE SOFTWARE.
 //
 
+#import <CommonCrypto/CommonDigest.h>
 #import "DBRecord+ParcelKit.h"
 #import "PKConstants.h"
 #import "NSManagedObject+ParcelKit.h"
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKEntitySyncPlan.h"
+#import "PKListDiff.h"
+#import "PKBinaryChunker.h"
+#import "PKSyncTracer.h"
+#import "PKCompression.h"
 
-#ifndef PKMaximumBinaryDataChunkLengthInBytes
-#define PKMaximumBinaryDataChunkLengthInBytes 95000
-#endif
+static NSString *PKHexStringWithDigest(const unsigned char *digest)
+{
+    NSMutableString *string = [[NSMutableString alloc] initWithCapacity:CC_MD5_DIGEST_LENGTH * 2];
+    for (NSUInteger i = 0; i < CC_MD5_DIGEST_LENGTH; i++) {
+        [string appendFormat:@"%02x", digest[i]];
+    }
+    return string;
+}
 
-@implementation DBRecord (ParcelKit)
+// Chunk records are addressed by their contents so unchanged chunks keep their record.
+// The owning record and field are part of the hash as chunks are deleted along with their owner.
+static NSString *PKBinaryRecordIDForChunk(NSData *chunk, NSString *recordID, NSString *fieldName)
+{
+    CC_MD5_CTX context;
+    CC_MD5_Init(&context);
+    NSData *owner = [[NSString stringWithFormat:@"%@\n%@\n", recordID, fieldName] dataUsingEncoding:NSUTF8StringEncoding];
+    CC_MD5_Update(&context, [owner bytes], (CC_LONG)[owner length]);
+    CC_MD5_Update(&context, [chunk bytes], (CC_LONG)[chunk length]);
+    
+    unsigned char digest[CC_MD5_DIGEST_LENGTH];
+    CC_MD5_Final(digest, &context);
+    return PKHexStringWithDigest(digest);
+}
 
-- (void)pk_setFieldsWithManagedObject:(NSManagedObject *)managedObject syncAttributeName:(NSString *)syncAttributeName
+// Combines the chunks of previously synced binary data, or returns nil if any of them is missing
+static NSData *PKChunkedDataWithBinaryRecordIDs(NSArray *binaryRecordIDs, DBTable *binaryTable)
 {
-    __weak typeof(self) weakSelf = self;
-    NSDictionary *propertiesByName = [[managedObject entity] propertiesByName];
-    NSArray *fieldNames = [[self fields] allKeys];
+    NSMutableData *data = [[NSMutableData alloc] init];
+    for (NSString *binaryRecordID in binaryRecordIDs) {
+        NSData *chunk = [[binaryTable getRecord:binaryRecordID error:nil] objectForKey:@"data"];
+        if (!chunk || ![chunk isKindOfClass:[NSData class]]) return nil;
+        chunk = [PKCompression decodedData:chunk];
+        if (!chunk) return nil;
+        [data appendData:chunk];
+    }
+    return data;
+}
+
+// Turns the values of the list into toValues with as few list operations as possible
+static void PKApplyListDiff(DBList *list, NSArray *fromValues, NSArray *toValues)
+{
+    for (PKListDiffOperation *operation in [PKListDiff operationsFromArray:fromValues toArray:toValues]) {
+        switch (operation.type) {
+            case PKListDiffOperationRemove:
+                [list removeObjectAtIndex:operation.index];
+                break;
+            case PKListDiffOperationInsert:
+                [list insertObject:operation.object atIndex:operation.index];
+                break;
+            case PKListDiffOperationMove:
+                [list moveObjectAtIndex:operation.index toIndex:operation.toIndex];
+                break;
+        }
+    }
+}
+
+// Values stored as data are compared as data, so a string that is now stored compressed counts as changed
+static BOOL PKFieldValueIsEqual(id previousValue, id value)
+{
+    if (!previousValue) return NO;
+    if ([value isKindOfClass:[NSData class]]) {
+        return [previousValue isKindOfClass:[NSData class]] && [previousValue isEqualToData:value];
+    }
+    if ([previousValue isKindOfClass:[NSData class]]) return NO;
+    return [previousValue compare:value] == NSOrderedSame;
+}
+
+// Returns the sync identifiers of the managed objects in order without firing faults, the identifiers of faults
+// are fetched together from the store instead. Managed objects without a sync identifier are left out.
+static NSArray *PKSyncIDsForManagedObjects(NSArray *managedObjects, NSString *entityName, NSString *syncAttributeName)
+{
+    NSManagedObjectContext *managedObjectContext = nil;
+    NSMutableArray *faultObjectIDs = [[NSMutableArray alloc] init];
+    for (NSManagedObject *managedObject in managedObjects) {
+        if ([managedObject isFault]) {
+            managedObjectContext = [managedObject managedObjectContext];
+            [faultObjectIDs addObject:[managedObject objectID]];
+        }
+    }
     
-    NSDictionary *values = nil;
-    if ([managedObject respondsToSelector:@selector(syncedPropertiesDictionary:)]) {
-        // Get the custom properties dictionary
-        values = [managedObject performSelector:@selector(syncedPropertiesDictionary:) withObject:propertiesByName];
-    } else {
-        // Get the standard properties dictionary
-        values = [managedObject dictionaryWithValuesForKeys:[propertiesByName allKeys]];
+    NSDictionary *fetchedSyncIDs = nil;
+    if ([faultObjectIDs count] > 0) {
+        NSError *error = nil;
+        fetchedSyncIDs = [managedObjectContext pk_syncIDsKeyedByObjectID:faultObjectIDs entityName:entityName syncAttributeName:syncAttributeName error:&error];
+        if (!fetchedSyncIDs) {
+            NSLog(@"Error executing fetch request: %@", error);
+        }
     }
     
+    NSMutableArray *syncIDs = [[NSMutableArray alloc] initWithCapacity:[managedObjects count]];
+    for (NSManagedObject *managedObject in managedObjects) {
+        NSString *syncID = [fetchedSyncIDs objectForKey:[managedObject objectID]];
+        if (!syncID) {
+            syncID = [managedObject valueForKey:syncAttributeName];
+        }
+        if (syncID) {
+            [syncIDs addObject:syncID];
+        }
+    }
+    return syncIDs;
+}
+
+// Returns the sync identifiers of the syncable objects of a to-many relationship value
+static NSArray *PKSyncIDsForRelatedObjects(id value, PKSyncPlanRelationship *relationship, NSString *syncAttributeName)
+{
+    NSArray *relatedObjects = ([relationship isOrdered] ? [value array] : [value allObjects]);
+    NSPredicate* syncablePred = [NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+        
+        if ([object respondsToSelector:@selector(isRecordSyncable)]) {
+            id<ParcelKitSyncedObject> pkObj = (id<ParcelKitSyncedObject>)object;
+            // Don't links to un-synced objects
+            return [pkObj isRecordSyncable];
+        } else {
+            return YES;
+        }
+    }];
+    relatedObjects = [relatedObjects filteredArrayUsingPredicate:syncablePred];
+    return PKSyncIDsForManagedObjects(relatedObjects, relationship.destinationEntityName, syncAttributeName);
+}
+
+// Deletes the binary records that are no longer referenced
+static void PKDeleteBinaryRecords(NSArray *binaryRecordIDs, NSSet *keptBinaryRecordIDs, DBTable *binaryTable)
+{
+    for (NSString *binaryRecordID in binaryRecordIDs) {
+        if ([keptBinaryRecordIDs containsObject:binaryRecordID]) continue;
+        
+        DBRecord *record = [binaryTable getRecord:binaryRecordID error:nil];
+        if (record) {
+            [record deleteRecord];
+        }
+    }
+}
+
+@implementation DBRecord (ParcelKit)
+
++ (NSDictionary *)pk_fieldValuesWithValues:(NSDictionary *)values syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    NSString *syncAttributeName = syncPlan.syncAttributeName;
+    NSMutableDictionary *fieldValues = [values mutableCopy];
     [values enumerateKeysAndObjectsUsingBlock:^(NSString *name, id value, BOOL *stop) {
-        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        id property = [syncPlan propertyForName:name];
+        if (![property isKindOfClass:[PKSyncPlanRelationship class]] || value == [NSNull null]) return;
         
-        if ([name isEqualToString:syncAttributeName]) return;
+        PKSyncPlanRelationship *relationship = property;
+        if ([syncPlan excludesPropertyName:name] || ([relationship isToMany] && ![relationship isSynced])) {
+            [fieldValues removeObjectForKey:name];
+        } else if ([relationship isToMany]) {
+            [fieldValues setObject:PKSyncIDsForRelatedObjects(value, relationship, syncAttributeName) forKey:name];
+        } else {
+            [fieldValues setObject:([value valueForKey:syncAttributeName] ?: [NSNull null]) forKey:name];
+        }
+    }];
+    return fieldValues;
+}
 
-        NSPropertyDescription *propertyDescription = [propertiesByName objectForKey:name];
-        if ([propertyDescription isTransient]) return;
+- (void)pk_setFieldsWithManagedObject:(NSManagedObject *)managedObject syncAttributeName:(NSString *)syncAttributeName
+{
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[managedObject entity] tableID:self.table.tableId syncAttributeName:syncAttributeName];
+    [self pk_setFieldsWithManagedObject:managedObject syncPlan:syncPlan];
+}
 
+- (void)pk_setFieldsWithManagedObject:(NSManagedObject *)managedObject syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    PKTraceScope("pk_setFieldsWithManagedObject", self.recordId);
+    [self pk_setFieldsWithValues:[syncPlan syncedValuesForManagedObject:managedObject] syncPlan:syncPlan];
+}
+
+- (void)pk_setChangedFieldsWithManagedObject:(NSManagedObject *)managedObject syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    PKTraceScope("pk_setChangedFieldsWithManagedObject", self.recordId);
+    [self pk_setFieldsWithValues:[syncPlan changedSyncedValuesForManagedObject:managedObject] syncPlan:syncPlan];
+}
+
+- (void)pk_setFieldsWithValues:(NSDictionary *)values syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    __weak typeof(self) weakSelf = self;
+    NSString *syncAttributeName = syncPlan.syncAttributeName;
+    NSDictionary *fields = [self fields];
+    
+    [values enumerateKeysAndObjectsUsingBlock:^(NSString *name, id value, BOOL *stop) {
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        
+        if ([syncPlan excludesPropertyName:name]) return;
+        
+        // Values of names that are not properties of the entity are synced like attributes
+        id property = [syncPlan propertyForName:name];
+        BOOL isAttribute = (property == nil) || [property isKindOfClass:[PKSyncPlanAttribute class]];
+        
         if (value && value != [NSNull null]) {
-            if ((propertyDescription == nil) || [propertyDescription isKindOfClass:[NSAttributeDescription class]]) {
+            if (isAttribute) {
                 id previousValue = [strongSelf objectForKey:name];
 
-                NSAttributeType attributeType = [(NSAttributeDescription *)propertyDescription attributeType];
-                if ((propertyDescription == nil) || (attributeType != NSBinaryDataAttributeType)) {
-                    if (!previousValue || [previousValue compare:value] != NSOrderedSame) {
-                        [strongSelf setObject:value forKey:name];
-                    }
-                } else {
-                    NSString *binaryTableID = [self.table.tableId stringByAppendingString:PKBinaryDataTableSuffix];
-                    DBTable *binaryTable = [self.table.datastore getTable:binaryTableID];
-
-                    NSMutableArray *previousRecords = [[NSMutableArray alloc] init];
-                    NSMutableData *previousData = [[NSMutableData alloc] init];
-                    if (previousValue) {
-                        if ([previousValue isKindOfClass:[NSData class]]) {
-                            [previousData appendData:previousValue];
-                        } else if ([previousValue isKindOfClass:[DBList class]]) {
-                            NSArray *binaryRecordIDs = [previousValue values];
-                            for (NSString *binaryRecordID in binaryRecordIDs) {
-                                DBRecord *record = [binaryTable getRecord:binaryRecordID error:nil];
-                                if (record) {
-                                    NSData *chunk = [record objectForKey:@"data"];
-                                    if (chunk && [chunk isKindOfClass:[NSData class]]) {
-                                        [previousData appendData:chunk];
-                                    }
-                                    [previousRecords addObject:record];
-                                }
+                if (![property isBinary]) {
+                    id fieldValue = value;
+                    if (property && [value isKindOfClass:[NSString class]]) {
+                        PKCompressionCodec codec = [syncPlan compressionCodecForAttribute:property length:[value length]];
+                        if (codec != PKCompressionCodecNone) {
+                            NSData *stringData = [value dataUsingEncoding:NSUTF8StringEncoding];
+                            NSData *encodedData = [PKCompression encodedData:stringData codec:codec];
+                            if (encodedData != stringData) {
+                                fieldValue = encodedData;
                             }
                         }
                     }
                     
-                    // Only sync data if it's changed
+                    if (!PKFieldValueIsEqual(previousValue, fieldValue)) {
+                        [strongSelf setObject:fieldValue forKey:name];
+                    }
+                } else {
+                    DBTable *binaryTable = [syncPlan binaryTableForTable:strongSelf.table];
+                    NSString *digestFieldName = [name stringByAppendingString:PKBinaryDataDigestFieldSuffix];
+                    NSArray *previousRecordIDs = ([previousValue isKindOfClass:[DBList class]] ? [previousValue values] : nil);
+                    NSSet *keptRecordIDs = nil;
+                    
                     NSData *data = value;
-                    if (![data isEqualToData:previousData]) {
-                        previousData = nil;
+                    PKCompressionCodec codec = [syncPlan compressionCodecForAttribute:property length:[data length]];
+                    if ([data length] <= PKMaximumBinaryDataLengthInBytes) {
+                        // Only sync data if it's changed, the codecs are deterministic so encoded data can be compared
+                        NSData *encodedData = [PKCompression encodedData:data codec:codec];
+                        if ([previousValue isKindOfClass:[NSData class]] && [previousValue isEqualToData:encodedData]) return;
                         
-                        if ([value length] <= PKMaximumBinaryDataLengthInBytes) {
-                            [strongSelf setObject:value forKey:name];
-                        } else {
-                            // Split the data into chunks
-                            [self removeObjectForKey:name];
-                            DBList *list = [self getOrCreateList:name];
-
-                            NSUInteger length = [value length];
-                            NSUInteger numberOfChunks = ceil(length / (double)PKMaximumBinaryDataChunkLengthInBytes);
-                            for (NSInteger i = 0; i < numberOfChunks; i++) {
-                                NSUInteger location = i * PKMaximumBinaryDataChunkLengthInBytes;
-                                NSRange range = NSMakeRange(location, MIN(PKMaximumBinaryDataChunkLengthInBytes, length - location));
-                                NSData *chunk = [value subdataWithRange:range];
-                                DBRecord *record = [binaryTable insert:@{@"data": chunk}];
-                                [list addObject:record.recordId];
+                        [strongSelf setObject:encodedData forKey:name];
+                        if ([fields objectForKey:digestFieldName]) {
+                            [strongSelf removeObjectForKey:digestFieldName];
+                        }
+                    } else {
+                        // Compare digests rather than reading back every chunk
+                        NSString *digest = [PKBinaryChunker digestForData:data];
+                        if (previousRecordIDs) {
+                            id previousDigest = [fields objectForKey:digestFieldName];
+                            if ([previousDigest isKindOfClass:[NSString class]]) {
+                                if ([previousDigest isEqualToString:digest]) return;
+                            } else if ([PKChunkedDataWithBinaryRecordIDs(previousRecordIDs, binaryTable) isEqualToData:data]) {
+                                // Data synced before digests were stored, upgrade the record
+                                [strongSelf setObject:digest forKey:digestFieldName];
+                                return;
                             }
                         }
                         
-                        // Delete all previous records
-                        for (DBRecord *record in previousRecords) {
-                            [record deleteRecord];
-                        }
-                    }
-                }
-            } else if ([propertyDescription isKindOfClass:[NSRelationshipDescription class]]) {
-                NSRelationshipDescription *relationshipDescription = (NSRelationshipDescription *)propertyDescription;
-                if ([relationshipDescription isToMany]) {
-                    // See if the inverse relationship is to-one, and if so we don't need
-                    // to bother storing the relationship on this table at all (it'll lead to
-                    // fewer potential inconsistencies if we don't)
-                    NSRelationshipDescription* inverse = [relationshipDescription inverseRelationship];
-                    if ([inverse isToMany]) {
-                        DBList *fieldList = [strongSelf getOrCreateList:name];
-                        NSMutableOrderedSet *previousIdentifiers = [[NSMutableOrderedSet alloc] initWithArray:[fieldList values]];
-                        NSOrderedSet *currentIdentifiers = ([relationshipDescription isOrdered] ? [value valueForKey:syncAttributeName] : [[NSOrderedSet alloc] initWithArray:[[value allObjects] valueForKey:syncAttributeName]]);
-                        NSPredicate* syncablePred = [NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+                        // Split the data into chunks at content-defined boundaries, reusing the records of unchanged chunks
+                        PKTraceScope("writeChunks", name);
+                        NSArray *chunkRanges = [PKBinaryChunker chunkRangesForData:data maximumChunkLength:PKMaximumBinaryDataChunkLengthInBytes];
+                        NSMutableArray *recordIDs = [[NSMutableArray alloc] initWithCapacity:[chunkRanges count]];
+                        NSCountedSet *chunkRecordIDs = [[NSCountedSet alloc] init];
+                        NSMutableArray *newChunks = [[NSMutableArray alloc] init];
+                        NSMutableArray *newRecordIDs = [[NSMutableArray alloc] init];
+                        for (NSValue *range in chunkRanges) {
+                            NSData *chunk = [PKBinaryChunker chunkOfData:data range:[range rangeValue]];
+                            NSString *recordID = PKBinaryRecordIDForChunk(chunk, strongSelf.recordId, name);
                             
-                            if ([object respondsToSelector:@selector(isRecordSyncable)]) {
-                                id<ParcelKitSyncedObject> pkObj = (id<ParcelKitSyncedObject>)object;
-                                // Don't links to un-synced objects
-                                return [pkObj isRecordSyncable];
-                            } else {
-                                return YES;
+                            // Repeated chunks get a record each so the list never contains duplicates
+                            [chunkRecordIDs addObject:recordID];
+                            NSUInteger occurrences = [chunkRecordIDs countForObject:recordID];
+                            if (occurrences > 1) {
+                                recordID = [recordID stringByAppendingFormat:@"_%lu", (unsigned long)occurrences];
                             }
-                        }];
-                        currentIdentifiers = [currentIdentifiers filteredOrderedSetUsingPredicate:syncablePred];
+                            if (![binaryTable getRecord:recordID error:nil]) {
+                                [newChunks addObject:chunk];
+                                [newRecordIDs addObject:recordID];
+                            }
+                            [recordIDs addObject:recordID];
+                        }
                         
-                        NSMutableOrderedSet *deletedIdentifiers = [[NSMutableOrderedSet alloc] initWithOrderedSet:previousIdentifiers];
-                        [deletedIdentifiers minusOrderedSet:currentIdentifiers];
-                        for (NSString *identifier in deletedIdentifiers) {
-                            NSInteger index = [[fieldList values] indexOfObject:identifier];
-                            if (index != NSNotFound) {
-                                [fieldList removeObjectAtIndex:index];
+                        // Chunks are encoded independently of each other, so encode them in parallel
+                        NSUInteger newChunkCount = [newChunks count];
+                        __strong NSData **encodedChunks = (__strong NSData **)calloc(newChunkCount, sizeof(NSData *));
+                        dispatch_apply(newChunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+                            PKTraceScope("encodeChunk", newRecordIDs[i]);
+                            encodedChunks[i] = [PKCompression encodedData:newChunks[i] codec:codec];
+                        });
+                        for (NSUInteger i = 0; i < newChunkCount; i++) {
+                            [binaryTable getOrInsertRecord:newRecordIDs[i] fields:@{@"data": encodedChunks[i]} inserted:NULL error:nil];
+                            encodedChunks[i] = nil;
+                        }
+                        free(encodedChunks);
+                        
+                        if (previousRecordIDs) {
+                            PKApplyListDiff(previousValue, previousRecordIDs, recordIDs);
+                        } else {
+                            [strongSelf removeObjectForKey:name];
+                            DBList *list = [strongSelf getOrCreateList:name];
+                            for (NSString *recordID in recordIDs) {
+                                [list addObject:recordID];
                             }
                         }
+                        [strongSelf setObject:digest forKey:digestFieldName];
+                        keptRecordIDs = [[NSSet alloc] initWithArray:recordIDs];
+                    }
+                    
+                    // Delete the previous records that are no longer used
+                    PKDeleteBinaryRecords(previousRecordIDs, keptRecordIDs, binaryTable);
+                }
+            } else {
+                PKSyncPlanRelationship *relationship = property;
+                if ([relationship isToMany]) {
+                    // If the inverse relationship is to-one we don't need to bother storing the
+                    // relationship on this table at all (it'll lead to fewer potential inconsistencies if we don't)
+                    if ([relationship isSynced]) {
+                        DBList *fieldList = [strongSelf getOrCreateList:name];
+                        NSArray *previousIdentifiers = [fieldList values];
+                        // Values read with pk_fieldValuesWithValues:syncPlan: already hold the sync identifiers
+                        NSArray *identifiers = ([value isKindOfClass:[NSArray class]] ? value : PKSyncIDsForRelatedObjects(value, relationship, syncAttributeName));
+                        NSOrderedSet *currentIdentifiers = [[NSOrderedSet alloc] initWithArray:identifiers];
                         
-                        NSUInteger recordIndex = 0;
-                        for (NSString *identifier in currentIdentifiers) {
-                            NSInteger index = [[fieldList values] indexOfObject:identifier];
-                            if ([relationshipDescription isOrdered]) {
-                                if (index != recordIndex) {
-                                    if (index != NSNotFound) {
-                                        [fieldList moveObjectAtIndex:index toIndex:recordIndex];
-                                    } else {
-                                        [fieldList insertObject:identifier atIndex:recordIndex];
-                                    }
+                        if ([relationship isOrdered]) {
+                            // Apply a minimal edit script so large reorders only produce the necessary list operations
+                            PKApplyListDiff(fieldList, previousIdentifiers, [currentIdentifiers array]);
+                        } else {
+                            NSSet *currentIdentifierSet = [currentIdentifiers set];
+                            NSMutableSet *keptIdentifiers = [[NSMutableSet alloc] initWithCapacity:[previousIdentifiers count]];
+                            NSMutableIndexSet *deletedIndexes = [[NSMutableIndexSet alloc] init];
+                            [previousIdentifiers enumerateObjectsUsingBlock:^(NSString *identifier, NSUInteger index, BOOL *stop) {
+                                if (![currentIdentifierSet containsObject:identifier] || [keptIdentifiers containsObject:identifier]) {
+                                    [deletedIndexes addIndex:index];
+                                } else {
+                                    [keptIdentifiers addObject:identifier];
+                                }
+                            }];
+                            [deletedIndexes enumerateIndexesWithOptions:NSEnumerationReverse usingBlock:^(NSUInteger index, BOOL *stop) {
+                                [fieldList removeObjectAtIndex:index];
+                            }];
+                            
+                            for (NSString *identifier in currentIdentifiers) {
+                                if (![keptIdentifiers containsObject:identifier]) {
+                                    [fieldList addObject:identifier];
                                 }
-                            } else if (index == NSNotFound) {
-                                [fieldList addObject:identifier];
                             }
-                            recordIndex++;
                         }
                     }
                 } else {
-                    [strongSelf setObject:[value valueForKey:syncAttributeName] forKey:name];
+                    NSString *identifier = ([value isKindOfClass:[NSString class]] ? value : [value valueForKey:syncAttributeName]);
+                    if (![[strongSelf objectForKey:name] isEqual:identifier]) {
+                        [strongSelf setObject:identifier forKey:name];
+                    }
                 }
             }
         } else {
-            if ([fieldNames containsObject:name]) {
+            if ([fields objectForKey:name]) {
                 id previousValue = [strongSelf objectForKey:name];
-                if ([propertyDescription isKindOfClass:[NSAttributeDescription class]] && [(NSAttributeDescription *)propertyDescription attributeType] == NSBinaryDataAttributeType && [previousValue isKindOfClass:[DBList class]]) {
-                    NSString *binaryTableID = [self.table.tableId stringByAppendingString:PKBinaryDataTableSuffix];
-                    DBTable *binaryTable = [self.table.datastore getTable:binaryTableID];
-                    NSArray *binaryRecordIDs = [previousValue values];
-                    for (NSString *binaryRecordID in binaryRecordIDs) {
-                        DBRecord *record = [binaryTable getRecord:binaryRecordID error:nil];
-                        if (record) {
-                            [record deleteRecord];
-                        }
+                if (isAttribute && [property isBinary]) {
+                    if ([previousValue isKindOfClass:[DBList class]]) {
+                        PKDeleteBinaryRecords([previousValue values], nil, [syncPlan binaryTableForTable:strongSelf.table]);
+                    }
+                    
+                    NSString *digestFieldName = [name stringByAppendingString:PKBinaryDataDigestFieldSuffix];
+                    if ([fields objectForKey:digestFieldName]) {
+                        [strongSelf removeObjectForKey:digestFieldName];
                     }
                 }
                 
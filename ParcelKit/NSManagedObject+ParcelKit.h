@@ -26,6 +26,9 @@
 #import <CoreData/CoreData.h>
 #import <Dropbox/Dropbox.h>
 
+@class PKSyncIndex;
+@class PKEntitySyncPlan;
+
 extern NSString * const PKInvalidAttributeValueException;
 
 @protocol ParcelKitSyncedObject
@@ -37,4 +40,17 @@ extern NSString * const PKInvalidAttributeValueException;
 
 @interface NSManagedObject (ParcelKit)
 - (void)pk_setPropertiesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName;
+- (void)pk_setPropertiesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName syncIndex:(PKSyncIndex *)syncIndex;
+
+// Records can also be applied in two passes so that the relationships of a whole change set are resolved together:
+// set the attributes of every record, collect the related sync identifiers keyed by destination entity name,
+// resolve them and set the relationships with the resolved objects keyed by entity name and sync identifier.
+- (void)pk_setAttributesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName;
+- (NSDictionary *)pk_relatedSyncIDsWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName;
+- (void)pk_setRelationshipsWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName relatedObjects:(NSDictionary *)relatedObjectsKeyedByEntityName;
+
+// The same passes driven by a precomputed sync plan of the entity
+- (void)pk_setAttributesWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan;
+- (NSDictionary *)pk_relatedSyncIDsWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan;
+- (void)pk_setRelationshipsWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan relatedObjects:(NSDictionary *)relatedObjectsKeyedByEntityName;
 @end
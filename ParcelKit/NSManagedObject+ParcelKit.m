@@ -23,209 +23,397 @@
 //  THE SOFTWARE.
 //
 
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/mman.h>
 #import "NSManagedObject+ParcelKit.h"
 #import <Dropbox/Dropbox.h>
 #import "PKConstants.h"
+#import "PKSyncIndex.h"
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKEntitySyncPlan.h"
+#import "PKListDiff.h"
+#import "PKCompression.h"
+#import "PKBinaryChunker.h"
+#import "PKSyncTracer.h"
 
 NSString * const PKInvalidAttributeValueException = @"Invalid attribute value";
 static NSString * const PKInvalidAttributeValueExceptionFormat = @"“%@.%@” expected “%@” to be of type “%@” but is “%@”";
 
-@implementation NSManagedObject (ParcelKit)
-- (void)pk_setPropertiesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName
+// Setting an equal value still marks a managed object as updated, which saves and merges it for nothing
+static BOOL PKValuesAreEqual(id value, id otherValue)
 {
-    NSString *entityName = [[self entity] name];
-    
-    NSDictionary *propertiesByName = [[self entity] propertiesByName];
-    NSArray *syncedPropertyNames = nil;
-    if ([self respondsToSelector:@selector(syncedPropertiesDictionary:)]) {
-        syncedPropertyNames = [[self performSelector:@selector(syncedPropertiesDictionary:) withObject:propertiesByName] allKeys];
+    return (value == otherValue || [value isEqual:otherValue]);
+}
+
+static NSDictionary *PKRelatedObjectsKeyedBySyncID(NSManagedObjectContext *managedObjectContext, NSArray *syncIDs, NSString *entityName, NSString *syncAttributeName, PKSyncIndex *syncIndex)
+{
+    NSError *error = nil;
+    NSDictionary *managedObjects = nil;
+    if (syncIndex) {
+        managedObjects = [syncIndex managedObjectsKeyedBySyncID:syncIDs entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:YES error:&error];
     } else {
-        syncedPropertyNames = [propertiesByName allKeys];
+        managedObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:syncIDs entityName:entityName syncAttributeName:syncAttributeName error:&error];
     }
     
-    __weak typeof(self) weakSelf = self;
-    [propertiesByName enumerateKeysAndObjectsUsingBlock:^(NSString *propertyName, NSPropertyDescription *propertyDescription, BOOL *stop) {
-        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+    if (!managedObjects) {
+        NSLog(@"Error executing fetch request: %@", error);
+    }
+    return managedObjects;
+}
+
+// Returns the sync identifiers a relationship field refers to, or nil when the relationship is not synced from records.
+static NSArray *PKRecordIdentifiersForRelationship(DBRecord *record, PKSyncPlanRelationship *relationship, NSString *entityName)
+{
+    if (![relationship isSynced]) return nil;
+    NSString *propertyName = relationship.name;
+    
+    if ([relationship isToMany]) {
+        DBList *recordList = [record objectForKey:propertyName];
+        if (recordList && ![recordList isKindOfClass:[DBList class]]) {
+            [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, recordList, [DBList class], [recordList class]];
+        }
         
-        if ([propertyName isEqualToString:syncAttributeName] || ![syncedPropertyNames containsObject:propertyName] || [propertyDescription isTransient]) return;
+        NSMutableArray *recordIdentifiers = [[NSMutableArray alloc] init];
+        for (id value in [recordList values]) {
+            if (![value isKindOfClass:[NSString class]]) {
+                if ([value respondsToSelector:@selector(stringValue)]) {
+                    [recordIdentifiers addObject:[value stringValue]];
+                } else {
+                    [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSString class], [value class]];
+                }
+            } else {
+                [recordIdentifiers addObject:value];
+            }
+        }
+        return recordIdentifiers;
+    } else {
+        id identifier = [record objectForKey:propertyName];
+        if (!identifier) return @[];
         
-        if ([propertyDescription isKindOfClass:[NSAttributeDescription class]]) {
-            NSAttributeType attributeType = [(NSAttributeDescription *)propertyDescription attributeType];
-            
-            id value = [record objectForKey:propertyName];
-            if (value) {
-                if ((attributeType == NSStringAttributeType) && (![value isKindOfClass:[NSString class]])) {
-                    if ([value respondsToSelector:@selector(stringValue)]) {
-                        value = [value stringValue];
-                    } else {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSString class], [value class]];
-                    }
-                } else if (((attributeType == NSInteger16AttributeType) || (attributeType == NSInteger32AttributeType) || (attributeType == NSInteger64AttributeType)) && (![value isKindOfClass:[NSNumber class]])) {
-                    if ([value respondsToSelector:@selector(integerValue)]) {
-                        value = [NSNumber numberWithInteger:[value integerValue]];
-                    } else {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSNumber class], [value class]];
-                    }
-                } else if ((attributeType == NSBooleanAttributeType) && (![value isKindOfClass:[NSNumber class]])) {
-                    if ([value respondsToSelector:@selector(boolValue)]) {
-                        value = [NSNumber numberWithBool:[value boolValue]];
-                    } else {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSNumber class], [value class]];
+        if (![identifier isKindOfClass:[NSString class]]) {
+            if ([identifier respondsToSelector:@selector(stringValue)]) {
+                identifier = [identifier stringValue];
+            } else {
+                [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, identifier, [NSString class], [identifier class]];
+            }
+        }
+        return @[identifier];
+    }
+}
+
+// Copies or decodes every chunk into its place in bytes. Chunks are independent of each other so they are
+// decoded in parallel. Returns NO if a chunk can't be decoded.
+static BOOL PKDecodeChunksIntoBytes(NSArray *chunks, const NSUInteger *offsets, uint8_t *bytes)
+{
+    __block BOOL decoded = YES;
+    dispatch_apply([chunks count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSData *chunk = [chunks objectAtIndex:i];
+        if ([PKCompression isEncodedData:chunk decodedLength:NULL]) {
+            if (![PKCompression decodeData:chunk intoBytes:bytes + offsets[i]]) {
+                decoded = NO;
+            }
+        } else {
+            memcpy(bytes + offsets[i], [chunk bytes], [chunk length]);
+        }
+    });
+    return decoded;
+}
+
+// Decodes the chunks straight into a file pre-sized to their combined length and maps it.
+// The file is unlinked once mapped: the mapping stays valid and its space is released with the data, after the save
+// has copied it into the store, so attachments don't stay on disk twice.
+// Returns nil if the file can't be written, sets decoded to NO if a chunk can't be decoded.
+static NSData *PKMappedDataWithChunks(NSArray *chunks, const NSUInteger *offsets, NSUInteger length, NSURL *fileURL, BOOL *decoded)
+{
+    NSError *error = nil;
+    if (![[[NSFileManager alloc] init] createDirectoryAtURL:[fileURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:&error]) {
+        NSLog(@"Error creating binary data directory: %@", error);
+        return nil;
+    }
+    
+    // A file left by an earlier reassembly may still be mapped, so it is unlinked rather than truncated
+    const char *path = [[fileURL path] fileSystemRepresentation];
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        NSLog(@"Error creating binary data file “%@”: %s", [fileURL path], strerror(errno));
+        return nil;
+    }
+    
+    BOOL written = NO;
+    if (ftruncate(fd, (off_t)length) == 0) {
+        void *bytes = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (bytes != MAP_FAILED) {
+            *decoded = PKDecodeChunksIntoBytes(chunks, offsets, bytes);
+            written = (msync(bytes, length, MS_SYNC) == 0);
+            munmap(bytes, length);
+        }
+    }
+    if (close(fd) != 0) written = NO;
+    if (!written) NSLog(@"Error writing binary data file “%@”: %s", [fileURL path], strerror(errno));
+    
+    NSData *data = nil;
+    if (written && *decoded) {
+        data = [[NSData alloc] initWithContentsOfURL:fileURL options:NSDataReadingMappedAlways error:&error];
+        if (!data) {
+            NSLog(@"Error mapping binary data file: %@", error);
+        }
+    }
+    unlink(path);
+    return data;
+}
+
+// Combines the binary records listed in a field into a single data value, decoding compressed chunks.
+// The value is reassembled in the given file and mapped from it, or in memory without a file.
+static NSData *PKDataWithBinaryRecordIDs(NSArray *binaryRecordIDs, DBTable *binaryTable, NSString *entityName, NSString *propertyName, NSURL *fileURL)
+{
+    NSMutableArray *chunks = [[NSMutableArray alloc] initWithCapacity:[binaryRecordIDs count]];
+    NSMutableData *offsets = [[NSMutableData alloc] initWithLength:[binaryRecordIDs count] * sizeof(NSUInteger)];
+    NSUInteger *chunkOffsets = [offsets mutableBytes];
+    NSUInteger length = 0;
+    for (NSString *binaryRecordID in binaryRecordIDs) {
+        DBError *dberror = nil;
+        DBRecord *record = [binaryTable getRecord:binaryRecordID error:&dberror];
+        if (record) {
+            NSData *chunk = [record objectForKey:@"data"];
+            if (chunk && [chunk isKindOfClass:[NSData class]]) {
+                // The header of encoded chunks holds their decoded length, so the value can be sized up front
+                NSUInteger chunkLength = [chunk length];
+                [PKCompression isEncodedData:chunk decodedLength:&chunkLength];
+                chunkOffsets[[chunks count]] = length;
+                [chunks addObject:chunk];
+                length += chunkLength;
+            } else {
+                [NSException raise:PKInvalidAttributeValueException format:@"Invalid binary record “%@.%@” for “%@.%@” expected “data” to be of type “%@” but is “%@”", binaryTable.tableId, binaryRecordID, entityName, propertyName, [NSData class], [chunk class]];
+            }
+        } else {
+            [NSException raise:PKInvalidAttributeValueException format:@"Could not find binary record “%@.%@” for “%@.%@”", binaryTable.tableId, binaryRecordID, entityName, propertyName];
+        }
+    }
+    
+    NSData *data = nil;
+    BOOL decoded = YES;
+    if (fileURL && length > 0) {
+        data = PKMappedDataWithChunks(chunks, chunkOffsets, length, fileURL, &decoded);
+    }
+    if (!data && decoded) {
+        NSMutableData *mutableData = [[NSMutableData alloc] initWithLength:length];
+        decoded = PKDecodeChunksIntoBytes(chunks, chunkOffsets, [mutableData mutableBytes]);
+        data = mutableData;
+    }
+    if (!decoded) {
+        [NSException raise:PKInvalidAttributeValueException format:@"Could not decode binary records of “%@.%@”", entityName, propertyName];
+    }
+    
+    return data;
+}
+
+@implementation NSManagedObject (ParcelKit)
+- (PKEntitySyncPlan *)pk_syncPlanWithSyncAttributeName:(NSString *)syncAttributeName
+{
+    return [[PKEntitySyncPlan alloc] initWithEntity:[self entity] tableID:nil syncAttributeName:syncAttributeName];
+}
+
+- (void)pk_setPropertiesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName
+{
+    [self pk_setPropertiesWithRecord:record syncAttributeName:syncAttributeName syncIndex:nil];
+}
+
+- (void)pk_setPropertiesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName syncIndex:(PKSyncIndex *)syncIndex
+{
+    PKTraceScope("pk_setPropertiesWithRecord", record.recordId);
+    PKEntitySyncPlan *syncPlan = [self pk_syncPlanWithSyncAttributeName:syncAttributeName];
+    [self pk_setAttributesWithRecord:record syncPlan:syncPlan];
+    
+    NSMutableDictionary *relatedObjects = [[NSMutableDictionary alloc] init];
+    [[self pk_relatedSyncIDsWithRecord:record syncPlan:syncPlan] enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+        NSDictionary *managedObjects = PKRelatedObjectsKeyedBySyncID(self.managedObjectContext, [syncIDs allObjects], entityName, syncAttributeName, syncIndex);
+        if (managedObjects) {
+            [relatedObjects setObject:managedObjects forKey:entityName];
+        }
+    }];
+    
+    [self pk_setRelationshipsWithRecord:record syncPlan:syncPlan relatedObjects:relatedObjects];
+}
+
+- (void)pk_setAttributesWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName
+{
+    [self pk_setAttributesWithRecord:record syncPlan:[self pk_syncPlanWithSyncAttributeName:syncAttributeName]];
+}
+
+- (NSDictionary *)pk_relatedSyncIDsWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName
+{
+    return [self pk_relatedSyncIDsWithRecord:record syncPlan:[self pk_syncPlanWithSyncAttributeName:syncAttributeName]];
+}
+
+- (void)pk_setRelationshipsWithRecord:(DBRecord *)record syncAttributeName:(NSString *)syncAttributeName relatedObjects:(NSDictionary *)relatedObjectsKeyedByEntityName
+{
+    [self pk_setRelationshipsWithRecord:record syncPlan:[self pk_syncPlanWithSyncAttributeName:syncAttributeName] relatedObjects:relatedObjectsKeyedByEntityName];
+}
+
+- (void)pk_setAttributesWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    PKTraceScope("pk_setAttributesWithRecord", record.recordId);
+    NSString *entityName = [[self entity] name];
+    
+    for (PKSyncPlanAttribute *attribute in [syncPlan attributesForManagedObject:self]) {
+        NSString *propertyName = attribute.name;
+        
+        id value = [record objectForKey:propertyName];
+        if (value) {
+            if ([attribute isBinary] && [value isKindOfClass:[DBList class]]) {
+                // Unchanged chunked data is recognized by its digest without reassembling it
+                NSString *digest = [record objectForKey:[propertyName stringByAppendingString:PKBinaryDataDigestFieldSuffix]];
+                if ([digest isKindOfClass:[NSString class]] && [PKBinaryChunker data:[self valueForKey:propertyName] matchesDigest:digest]) continue;
+                
+                PKTraceScope("reassembleChunks", propertyName);
+                NSURL *fileURL = [syncPlan binaryDataFileURLForRecordID:record.recordId attributeName:propertyName];
+                value = PKDataWithBinaryRecordIDs([value values], [syncPlan binaryTableForTable:record.table], entityName, propertyName, fileURL);
+            } else {
+                if ([value isKindOfClass:[NSData class]] && [PKCompression isEncodedData:value decodedLength:NULL]) {
+                    NSData *decodedValue = [PKCompression decodedData:value];
+                    if (!decodedValue) {
+                        [NSException raise:PKInvalidAttributeValueException format:@"Could not decode “%@.%@”", entityName, propertyName];
                     }
-                } else if (((attributeType == NSDoubleAttributeType) || (attributeType == NSFloatAttributeType) || attributeType == NSDecimalAttributeType) && (![value isKindOfClass:[NSNumber class]])) {
-                    if ([value respondsToSelector:@selector(doubleValue)]) {
-                        value = [NSNumber numberWithDouble:[value doubleValue]];
+                    
+                    // Strings are compressed as UTF-8
+                    if (attribute.attributeType == NSStringAttributeType) {
+                        NSString *string = [[NSString alloc] initWithData:decodedValue encoding:NSUTF8StringEncoding];
+                        if (string) value = string;
                     } else {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSNumber class], [value class]];
+                        value = decodedValue;
                     }
-                } else if ((attributeType == NSDateAttributeType) && (![value isKindOfClass:[NSDate class]])) {
-                    [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSDate class], [value class]];
-                } else if ((attributeType == NSBinaryDataAttributeType) && (![value isKindOfClass:[NSData class]])) {
-                    if ([value isKindOfClass:[DBList class]]) {
-                        // Get the corresponding table used to store binary data
-                        NSString *binaryTableID = [record.table.tableId stringByAppendingString:PKBinaryDataTableSuffix];
-                        DBTable *binaryTable = [record.table.datastore getTable:binaryTableID];
-                        
-                        // Loop through the binary records and combine them into a single data value
-                        NSMutableData *data = [[NSMutableData alloc] init];
-                        NSArray *binaryRecordIDs = [value values];
-                        for (NSString *binaryRecordID in binaryRecordIDs) {
-                            DBError *dberror = nil;
-                            DBRecord *record = [binaryTable getRecord:binaryRecordID error:&dberror];
-                            if (record) {
-                                NSData *chunk = [record objectForKey:@"data"];
-                                if (chunk && [chunk isKindOfClass:[NSData class]]) {
-                                    [data appendData:chunk];
-                                } else {
-                                    [NSException raise:PKInvalidAttributeValueException format:@"Invalid binary record “%@.%@” for “%@.%@” expected “data” to be of type “%@” but is “%@”", binaryTableID, binaryRecordID, entityName, propertyName, [NSData class], [chunk class]];
-                                }
-                            } else {
-                                [NSException raise:PKInvalidAttributeValueException format:@"Could not find binary record “%@.%@” for “%@.%@”", binaryTableID, binaryRecordID, entityName, propertyName];
-                            }
-                        }
+                }
+                
+                id coercedValue = attribute.coercion(value);
+                if (!coercedValue) {
+                    [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, attribute.valueClass, [value class]];
+                }
+                value = coercedValue;
+            }
+        } else if (![attribute isOptional] && ![self valueForKey:propertyName]) {
+            [NSException raise:PKInvalidAttributeValueException format:@"“%@.%@” expected to not be null", entityName, propertyName];
+        }
+        
+        if (PKValuesAreEqual([self valueForKey:propertyName], value)) continue;
+        [self setValue:value forKey:propertyName];
+    }
+}
 
-                        value = [[NSData alloc] initWithData:data];
-                    } else {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSData class], [value class]];
-                    }
+- (NSDictionary *)pk_relatedSyncIDsWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan
+{
+    NSString *entityName = [[self entity] name];
+    
+    NSMutableDictionary *relatedSyncIDs = [[NSMutableDictionary alloc] init];
+    for (PKSyncPlanRelationship *relationship in [syncPlan relationshipsForManagedObject:self]) {
+        NSArray *recordIdentifiers = PKRecordIdentifiersForRelationship(record, relationship, entityName);
+        if ([recordIdentifiers count] == 0) continue;
+        
+        NSMutableSet *syncIDs = [relatedSyncIDs objectForKey:relationship.destinationEntityName];
+        if (!syncIDs) {
+            syncIDs = [[NSMutableSet alloc] init];
+            [relatedSyncIDs setObject:syncIDs forKey:relationship.destinationEntityName];
+        }
+        [syncIDs addObjectsFromArray:recordIdentifiers];
+    }
+    return relatedSyncIDs;
+}
+
+- (void)pk_setRelationshipsWithRecord:(DBRecord *)record syncPlan:(PKEntitySyncPlan *)syncPlan relatedObjects:(NSDictionary *)relatedObjectsKeyedByEntityName
+{
+    PKTraceScope("pk_setRelationshipsWithRecord", record.recordId);
+    NSString *entityName = [[self entity] name];
+    NSString *syncAttributeName = syncPlan.syncAttributeName;
+    
+    for (PKSyncPlanRelationship *relationship in [syncPlan relationshipsForManagedObject:self]) {
+        NSString *propertyName = relationship.name;
+        PKTraceScope("relationship", propertyName);
+        NSArray *recordIdentifiers = PKRecordIdentifiersForRelationship(record, relationship, entityName);
+        if (!recordIdentifiers) continue;
+        
+        NSDictionary *relatedObjectsBySyncID = [relatedObjectsKeyedByEntityName objectForKey:relationship.destinationEntityName];
+        
+        if ([relationship isToMany]) {
+            NSSet *recordIdentifierSet = [[NSSet alloc] initWithArray:recordIdentifiers];
+            NSMutableArray *listedObjects = [[NSMutableArray alloc] initWithCapacity:[recordIdentifiers count]];
+            for (NSString *identifier in recordIdentifiers) {
+                NSManagedObject *relatedObject = [relatedObjectsBySyncID objectForKey:identifier];
+                if (relatedObject) {
+                    [listedObjects addObject:relatedObject];
                 }
-            } else if (![propertyDescription isOptional] && ![strongSelf valueForKey:propertyName]) {
-                 [NSException raise:PKInvalidAttributeValueException format:@"“%@.%@” expected to not be null", entityName, propertyName];
             }
             
-            [strongSelf setValue:value forKey:propertyName];
-        } else if ([propertyDescription isKindOfClass:[NSRelationshipDescription class]]) {
-            NSRelationshipDescription *relationshipDescription = (NSRelationshipDescription *)propertyDescription;
-            NSRelationshipDescription *inverse = [relationshipDescription inverseRelationship];
-            NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:[[relationshipDescription destinationEntity] name]];
-            [fetchRequest setFetchLimit:1];
-            
-            if ([relationshipDescription isToMany]) {
-                // If it's a one-to-many relationship, leave all the relationship business
-                // to the "one" side of the equation. Otherwise, carry on and deal with it here
-                if ([inverse isToMany]) {
-                    DBList *recordList = [record objectForKey:propertyName];
-                    if (recordList && ![recordList isKindOfClass:[DBList class]]) {
-                        [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, recordList, [DBList class], [recordList class]];
-                    }
-                    
-                    NSMutableArray *recordIdentifiers = [[NSMutableArray alloc] init];
-                    for (id value in [recordList values]) {
-                        if (![value isKindOfClass:[NSString class]]) {
-                            if ([value respondsToSelector:@selector(stringValue)]) {
-                                [recordIdentifiers addObject:[value stringValue]];
-                            } else {
-                                [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, value, [NSString class], [value class]];
-                            }
-                        } else {
-                            [recordIdentifiers addObject:value];
+            id relatedObjects = ([relationship isOrdered] ? [self mutableOrderedSetValueForKey:propertyName] : [self mutableSetValueForKey:propertyName]);
+            NSMutableArray *keptObjects = [[NSMutableArray alloc] init];
+            NSMutableSet *unrelatedObjects = [[NSMutableSet alloc] init];
+            for (NSManagedObject *relatedObject in relatedObjects) {
+                if (![recordIdentifierSet containsObject:[relatedObject valueForKey:syncAttributeName]]) {
+                    if ([relatedObject respondsToSelector:@selector(isRecordSyncable)]) {
+                        id<ParcelKitSyncedObject> pkRelatedObj = (id<ParcelKitSyncedObject>)relatedObject;
+                        if (![pkRelatedObj isRecordSyncable]) {
+                            // Don't remove links to un-synced objects
+                            [keptObjects addObject:relatedObject];
+                            continue;
                         }
                     }
-                    
-                    id relatedObjects = ([relationshipDescription isOrdered] ? [strongSelf mutableOrderedSetValueForKey:propertyName] : [strongSelf mutableSetValueForKey:propertyName]);
-                    NSMutableSet *unrelatedObjects = [[NSMutableSet alloc] init];
-                    for (NSManagedObject *relatedObject in relatedObjects) {
-                        if (![recordIdentifiers containsObject:[relatedObject valueForKey:syncAttributeName]]) {
-                            if ([relatedObject respondsToSelector:@selector(isRecordSyncable)]) {
-                                id<ParcelKitSyncedObject> pkRelatedObj = (id<ParcelKitSyncedObject>)relatedObject;
-                                if (![pkRelatedObj isRecordSyncable]) {
-                                    // Don't remove links to un-synced objects
-                                    continue;
-                                }
-                            }
-                            if (![inverse isOptional]) {
-                                // We should only be removing non-optional relationships when
-                                // the corresponding record has been deleted
-                                if (![relatedObject isDeleted]) {
-                                    // Let's keep this relationship
-                                    continue;
-                                }
-                            }
-                            [unrelatedObjects addObject:relatedObject];
+                    if (![relationship isInverseOptional]) {
+                        // We should only be removing non-optional relationships when
+                        // the corresponding record has been deleted
+                        if (![relatedObject isDeleted]) {
+                            // Let's keep this relationship
+                            [keptObjects addObject:relatedObject];
+                            continue;
                         }
                     }
-                    [relatedObjects minusSet:unrelatedObjects];
-                    
-                    NSUInteger recordIndex = 0;
-                    for (NSString *identifier in recordIdentifiers) {
-                        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K == %@", syncAttributeName, identifier]];
-                        [fetchRequest setIncludesPropertyValues:NO];
-                        NSError *error = nil;
-                        NSArray *managedObjects = [strongSelf.managedObjectContext executeFetchRequest:fetchRequest error:&error];
-                        if (managedObjects) {
-                            if ([managedObjects count] == 1) {
-                                NSManagedObject *relatedObject = managedObjects[0];
-                                
-                                if ([relationshipDescription isOrdered]) {
-                                    NSUInteger relatedObjectIndex = [relatedObjects indexOfObject:relatedObject];
-                                    if (relatedObjectIndex != recordIndex) {
-                                        if (relatedObjectIndex != NSNotFound) {
-                                            [relatedObjects removeObject:relatedObject];
-                                        }
-                                        [relatedObjects insertObject:relatedObject atIndex:recordIndex];
-                                    }
-                                } else {
-                                    if (![relatedObjects containsObject:relatedObject]) {
-                                        [relatedObjects addObject:relatedObject];
-                                    }
-                                }
-                            }
-                        } else {
-                            NSLog(@"Error executing fetch request: %@", error);
-                        }
-                        
-                        recordIndex++;
-                    };
+                    [unrelatedObjects addObject:relatedObject];
                 }
-            } else {
-                id identifier = [record objectForKey:propertyName];
-                if (identifier) {
-                    if (![identifier isKindOfClass:[NSString class]]) {
-                        if ([identifier respondsToSelector:@selector(stringValue)]) {
-                            identifier = [identifier stringValue];
-                        } else {
-                            [NSException raise:PKInvalidAttributeValueException format:PKInvalidAttributeValueExceptionFormat, entityName, propertyName, identifier, [NSString class], [identifier class]];
-                        }
+            }
+            
+            if ([relationship isOrdered]) {
+                // Objects kept although the record doesn't list them follow the listed objects
+                NSMutableOrderedSet *desiredObjects = [[NSMutableOrderedSet alloc] initWithArray:listedObjects];
+                [desiredObjects addObjectsFromArray:keptObjects];
+                
+                // Listed objects that could not be resolved stay where they are rather than being removed
+                [[relatedObjects array] enumerateObjectsUsingBlock:^(NSManagedObject *relatedObject, NSUInteger index, BOOL *stop) {
+                    NSString *syncID = [relatedObject valueForKey:syncAttributeName];
+                    if ([recordIdentifierSet containsObject:syncID] && ![relatedObjectsBySyncID objectForKey:syncID]) {
+                        [desiredObjects insertObject:relatedObject atIndex:MIN(index, [desiredObjects count])];
                     }
-                    [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K == %@", syncAttributeName, identifier]];
-                    NSError *error = nil;
-                    NSArray *managedObjects = [strongSelf.managedObjectContext executeFetchRequest:fetchRequest error:&error];
-                    if (managedObjects) {
-                        if ([managedObjects count] == 1) {
-                            NSManagedObject *relatedObject = managedObjects[0];
-                            if (![[strongSelf valueForKey:propertyName] isEqual:relatedObject]) {
-                                [strongSelf setValue:relatedObject forKey:propertyName];
-                            }
-                        }
-                    } else {
-                        NSLog(@"Error executing fetch request: %@", error);
+                }];
+                
+                for (PKListDiffOperation *operation in [PKListDiff operationsFromArray:[relatedObjects array] toArray:[desiredObjects array]]) {
+                    switch (operation.type) {
+                        case PKListDiffOperationRemove:
+                            [relatedObjects removeObjectAtIndex:operation.index];
+                            break;
+                        case PKListDiffOperationInsert:
+                            [relatedObjects insertObject:operation.object atIndex:operation.index];
+                            break;
+                        case PKListDiffOperationMove:
+                            [relatedObjects moveObjectsAtIndexes:[NSIndexSet indexSetWithIndex:operation.index] toIndex:operation.toIndex];
+                            break;
                     }
-                } else {
-                    [strongSelf setValue:nil forKey:propertyName];
                 }
+            } else {
+                NSMutableSet *addedObjects = [[NSMutableSet alloc] initWithArray:listedObjects];
+                [addedObjects minusSet:relatedObjects];
+                if ([unrelatedObjects count] > 0) [relatedObjects minusSet:unrelatedObjects];
+                if ([addedObjects count] > 0) [relatedObjects unionSet:addedObjects];
+            }
+        } else {
+            NSString *identifier = [recordIdentifiers lastObject];
+            if (identifier) {
+                NSManagedObject *relatedObject = [relatedObjectsBySyncID objectForKey:identifier];
+                if (relatedObject && ![[self valueForKey:propertyName] isEqual:relatedObject]) {
+                    [self setValue:relatedObject forKey:propertyName];
+                }
+            } else if ([self valueForKey:propertyName]) {
+                [self setValue:nil forKey:propertyName];
             }
         }
-    }];
+    }
     
     if ([self respondsToSelector:@selector(parcelKitWasSyncedFromDropbox)]) {
         // Give objects an opportunity to respond to the sync
@@ -0,0 +1,71 @@
+//
+//  NSManagedObjectContext+ParcelKit.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <CoreData/CoreData.h>
+
+@class PKSyncMetrics;
+
+@interface NSManagedObjectContext (ParcelKit)
+/**
+ Returns the managed objects of the given entity whose sync attribute matches one of the given sync identifiers.
+ 
+ The identifiers are resolved with one `IN` fetch per `PKSyncIDFetchBatchSize` identifiers instead of one fetch per identifier.
+ @param syncIDs The sync identifiers to look up.
+ @param entityName The name of the entity to fetch.
+ @param syncAttributeName The name of the entity attribute holding the sync identifier.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return A dictionary of managed objects keyed by their sync identifier, or nil if an error occurred.
+ */
+- (NSDictionary *)pk_managedObjectsKeyedBySyncID:(NSArray *)syncIDs entityName:(NSString *)entityName syncAttributeName:(NSString *)syncAttributeName error:(NSError **)error;
+
+/**
+ Returns the sync identifiers of the managed objects with the given IDs without registering the managed objects in the context.
+ 
+ The identifiers are read from the persistent store with one dictionary result fetch per `PKSyncIDFetchBatchSize` managed object IDs,
+ so unsaved changes are not taken into account.
+ @param objectIDs The managed object IDs to look up.
+ @param entityName The name of the entity the managed objects belong to.
+ @param syncAttributeName The name of the entity attribute holding the sync identifier.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return A dictionary of sync identifiers keyed by managed object ID, or nil if an error occurred.
+ */
+- (NSDictionary *)pk_syncIDsKeyedByObjectID:(NSArray *)objectIDs entityName:(NSString *)entityName syncAttributeName:(NSString *)syncAttributeName error:(NSError **)error;
+
+/**
+ Returns the metrics the fetches of the context are counted in, or nil if they are not counted.
+ 
+ Kept in the user info of the context. Must be called on the queue of the context.
+ @return The metrics of the sync session the context is used in.
+ */
+- (PKSyncMetrics *)pk_syncMetrics;
+
+/**
+ Sets the metrics the fetches of the context are counted in.
+ 
+ Must be called on the queue of the context.
+ @param syncMetrics The metrics of the sync session the context is used in, or nil to stop counting.
+ */
+- (void)pk_setSyncMetrics:(PKSyncMetrics *)syncMetrics;
+@end
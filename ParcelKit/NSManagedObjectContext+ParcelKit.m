@@ -0,0 +1,110 @@
+//
+//  NSManagedObjectContext+ParcelKit.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKConstants.h"
+#import "PKSyncMetrics.h"
+
+static NSString * const PKSyncMetricsUserInfoKey = @"PKSyncMetrics";
+
+@implementation NSManagedObjectContext (ParcelKit)
+- (NSDictionary *)pk_managedObjectsKeyedBySyncID:(NSArray *)syncIDs entityName:(NSString *)entityName syncAttributeName:(NSString *)syncAttributeName error:(NSError **)error
+{
+    NSUInteger count = [syncIDs count];
+    NSMutableDictionary *managedObjects = [[NSMutableDictionary alloc] initWithCapacity:count];
+    if (count == 0) return managedObjects;
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    [fetchRequest setReturnsObjectsAsFaults:NO];
+    
+    for (NSUInteger location = 0; location < count; location += PKSyncIDFetchBatchSize) {
+        NSRange range = NSMakeRange(location, MIN((NSUInteger)PKSyncIDFetchBatchSize, count - location));
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K IN %@", syncAttributeName, [syncIDs subarrayWithRange:range]]];
+        
+        NSArray *results = [self executeFetchRequest:fetchRequest error:error];
+        [[self pk_syncMetrics] addFetches:1];
+        if (!results) return nil;
+        
+        for (NSManagedObject *managedObject in results) {
+            NSString *syncID = [managedObject valueForKey:syncAttributeName];
+            if (syncID) {
+                [managedObjects setObject:managedObject forKey:syncID];
+            }
+        }
+    }
+    
+    return managedObjects;
+}
+
+- (NSDictionary *)pk_syncIDsKeyedByObjectID:(NSArray *)objectIDs entityName:(NSString *)entityName syncAttributeName:(NSString *)syncAttributeName error:(NSError **)error
+{
+    NSUInteger count = [objectIDs count];
+    NSMutableDictionary *syncIDs = [[NSMutableDictionary alloc] initWithCapacity:count];
+    if (count == 0) return syncIDs;
+    
+    static NSString * const PKObjectIDKey = @"objectID";
+    NSExpressionDescription *objectIDDescription = [[NSExpressionDescription alloc] init];
+    [objectIDDescription setName:PKObjectIDKey];
+    [objectIDDescription setExpression:[NSExpression expressionForEvaluatedObject]];
+    [objectIDDescription setExpressionResultType:NSObjectIDAttributeType];
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    [fetchRequest setResultType:NSDictionaryResultType];
+    [fetchRequest setPropertiesToFetch:@[objectIDDescription, syncAttributeName]];
+    [fetchRequest setIncludesPendingChanges:NO];
+    
+    for (NSUInteger location = 0; location < count; location += PKSyncIDFetchBatchSize) {
+        NSRange range = NSMakeRange(location, MIN((NSUInteger)PKSyncIDFetchBatchSize, count - location));
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"self IN %@", [objectIDs subarrayWithRange:range]]];
+        
+        NSArray *results = [self executeFetchRequest:fetchRequest error:error];
+        [[self pk_syncMetrics] addFetches:1];
+        if (!results) return nil;
+        
+        for (NSDictionary *result in results) {
+            NSString *syncID = [result objectForKey:syncAttributeName];
+            if (syncID) {
+                [syncIDs setObject:syncID forKey:[result objectForKey:PKObjectIDKey]];
+            }
+        }
+    }
+    
+    return syncIDs;
+}
+
+- (PKSyncMetrics *)pk_syncMetrics
+{
+    return [[self userInfo] objectForKey:PKSyncMetricsUserInfoKey];
+}
+
+- (void)pk_setSyncMetrics:(PKSyncMetrics *)syncMetrics
+{
+    if (syncMetrics) {
+        [[self userInfo] setObject:syncMetrics forKey:PKSyncMetricsUserInfoKey];
+    } else {
+        [[self userInfo] removeObjectForKey:PKSyncMetricsUserInfoKey];
+    }
+}
+@end
@@ -0,0 +1,48 @@
+//
+//  PKBinaryChunker.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <Foundation/Foundation.h>
+
+// Splits binary data into chunks at content-defined boundaries found with a gear rolling hash.
+// Editing a region of the data only changes the chunks around it, so the remaining chunks keep
+// their contents and can be reused.
+@interface PKBinaryChunker : NSObject
+
+// Returns the ranges, wrapped in NSValue, of the chunks the data splits into.
+// Chunks are at most maximumChunkLength long and, other than the last one, at least a quarter of it.
++ (NSArray *)chunkRangesForData:(NSData *)data maximumChunkLength:(NSUInteger)maximumChunkLength;
+
+// Returns the bytes of data in range without copying them, the chunk keeps data alive.
+// Slicing data memory mapped from a file only pages in the chunks that are read.
++ (NSData *)chunkOfData:(NSData *)data range:(NSRange)range;
+
+// Returns the MD5 of the data followed by its length, e.g. “9e107d9d372bb6826bd81d3542a419d6:43”.
++ (NSString *)digestForData:(NSData *)data;
+
+// Returns whether data has the given digest, the length is compared first so most differing data isn't hashed.
++ (BOOL)data:(NSData *)data matchesDigest:(NSString *)digest;
+
+@end
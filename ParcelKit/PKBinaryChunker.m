@@ -0,0 +1,177 @@
+//
+//  PKBinaryChunker.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <CommonCrypto/CommonDigest.h>
+#import "PKBinaryChunker.h"
+
+// The hash only depends on the last 64 bytes, anything earlier has been shifted out
+static const NSUInteger PKGearWindowLength = 64;
+
+// Boundaries are tested against at least this many of the high bits of the hash
+static const NSUInteger PKGearMinimumMaskBits = 8;
+
+static uint64_t PKGearTable[256];
+
+static void PKGearTableInitialize(void)
+{
+    // splitmix64, so every client derives the same table and therefore the same boundaries
+    uint64_t x = 0x5061726365C4B17ULL;
+    for (NSUInteger i = 0; i < 256; i++) {
+        x += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        PKGearTable[i] = z ^ (z >> 31);
+    }
+}
+
+// Returns the length of the chunk starting at bytes
+static NSUInteger PKGearChunkLength(const uint8_t *bytes, NSUInteger length, NSUInteger minimumLength, uint64_t mask)
+{
+    if (length <= minimumLength) return length;
+    
+    // Nothing before the minimum length can be a boundary, so only the window leading up to it needs hashing
+    NSUInteger i = (minimumLength > PKGearWindowLength ? minimumLength - PKGearWindowLength : 0);
+    uint64_t hash = 0;
+    
+#define PKGearStep() hash = (hash << 1) + PKGearTable[bytes[i++]]
+    for (; i + 8 <= minimumLength; ) {
+        PKGearStep(); PKGearStep(); PKGearStep(); PKGearStep();
+        PKGearStep(); PKGearStep(); PKGearStep(); PKGearStep();
+    }
+    while (i < minimumLength) {
+        PKGearStep();
+    }
+    
+#define PKGearTestStep() PKGearStep(); if ((hash & mask) == 0) return i
+    if (minimumLength > 0 && (hash & mask) == 0) return i;
+    for (; i + 4 <= length; ) {
+        PKGearTestStep(); PKGearTestStep(); PKGearTestStep(); PKGearTestStep();
+    }
+    while (i < length) {
+        PKGearTestStep();
+    }
+#undef PKGearTestStep
+#undef PKGearStep
+    
+    return length;
+}
+
+// An immutable view of a range of another data object
+@interface PKDataSlice : NSData
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range;
+@end
+
+@implementation PKDataSlice {
+    NSData *_data;
+    NSRange _range;
+}
+
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range
+{
+    self = [super init];
+    if (self) {
+        _data = data;
+        _range = range;
+    }
+    return self;
+}
+
+- (NSUInteger)length
+{
+    return _range.length;
+}
+
+- (const void *)bytes
+{
+    return (const uint8_t *)[_data bytes] + _range.location;
+}
+
+@end
+
+@implementation PKBinaryChunker
+
++ (NSArray *)chunkRangesForData:(NSData *)data maximumChunkLength:(NSUInteger)maximumChunkLength
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        PKGearTableInitialize();
+    });
+    
+    NSParameterAssert(maximumChunkLength > 0);
+    NSUInteger minimumChunkLength = MAX(maximumChunkLength / 4, (NSUInteger)1);
+    
+    // Aim for an average chunk length of around the minimum plus a quarter of the maximum
+    NSUInteger maskBits = 0;
+    while (((NSUInteger)2 << maskBits) <= maximumChunkLength / 4) maskBits++;
+    maskBits = MAX(maskBits, PKGearMinimumMaskBits);
+    uint64_t mask = ~(uint64_t)0 << (64 - maskBits);
+    
+    const uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSMutableArray *ranges = [[NSMutableArray alloc] initWithCapacity:(length / minimumChunkLength) + 1];
+    
+    NSUInteger location = 0;
+    while (location < length) {
+        NSUInteger chunkLength = PKGearChunkLength(bytes + location, MIN(maximumChunkLength, length - location), minimumChunkLength, mask);
+        [ranges addObject:[NSValue valueWithRange:NSMakeRange(location, chunkLength)]];
+        location += chunkLength;
+    }
+    
+    return ranges;
+}
+
++ (NSData *)chunkOfData:(NSData *)data range:(NSRange)range
+{
+    NSParameterAssert(NSMaxRange(range) <= [data length]);
+    return [[PKDataSlice alloc] initWithData:data range:range];
+}
+
++ (NSString *)digestForData:(NSData *)data
+{
+    unsigned char digest[CC_MD5_DIGEST_LENGTH];
+    CC_MD5([data bytes], (CC_LONG)[data length], digest);
+    
+    NSMutableString *string = [[NSMutableString alloc] initWithCapacity:CC_MD5_DIGEST_LENGTH * 2 + 21];
+    for (NSUInteger i = 0; i < CC_MD5_DIGEST_LENGTH; i++) {
+        [string appendFormat:@"%02x", digest[i]];
+    }
+    [string appendFormat:@":%lu", (unsigned long)[data length]];
+    return string;
+}
+
++ (BOOL)data:(NSData *)data matchesDigest:(NSString *)digest
+{
+    if (!data || !digest) return NO;
+    
+    NSRange separator = [digest rangeOfString:@":" options:NSBackwardsSearch];
+    if (separator.location == NSNotFound) return NO;
+    if (![[digest substringFromIndex:NSMaxRange(separator)] isEqualToString:[NSString stringWithFormat:@"%lu", (unsigned long)[data length]]]) return NO;
+    
+    return [[self digestForData:data] isEqualToString:digest];
+}
+
+@end
@@ -0,0 +1,95 @@
+//
+//  PKChangeRecorder.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <Foundation/Foundation.h>
+
+// Keys of the dictionaries recorded change sets hold for each record
+extern NSString * const PKChangeRecorderRecordIDKey;
+// The fields of a record that is not deleted, with the values of lists as arrays
+extern NSString * const PKChangeRecorderFieldsKey;
+// An NSNumber that is `YES` for a deleted record, which has no fields
+extern NSString * const PKChangeRecorderDeletedKey;
+
+/**
+ A recording of the change sets returned by `-[DBDatastore sync:]`, kept in a compact binary file.
+ 
+ The file starts with the tables of the recorded entities and the sync attribute name, followed by one frame per
+ change set holding the date it was recorded and every record with its identifier, fields or deletion. Frames are
+ binary property lists compressed with `PKCompressionCodecFast`, so change sets are appended without rewriting the
+ file. A frame left unfinished when the app was killed is skipped when reading and cut off before the next change set
+ is appended.
+ 
+ Recordings reproduce the exact sync workload of a device, and can be replayed against a scratch store to profile it.
+ */
+@interface PKChangeRecorder : NSObject
+
+/** The file the change sets are recorded in. */
+@property (nonatomic, copy, readonly) NSURL *URL;
+
+/** The DBDatastore table IDs of the recorded entities, keyed by entity name. */
+@property (nonatomic, copy, readonly) NSDictionary *tablesByEntityName;
+
+/** The sync attribute name of the recorded entities. */
+@property (nonatomic, copy, readonly) NSString *syncAttributeName;
+
+/**
+ Returns a recorder of an existing recording, with the tables and sync attribute name it was recorded with.
+ 
+ @param URL The file URL of the recording
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return The recorder, or nil if the file couldn't be read or isn't a recording.
+ */
++ (instancetype)recorderWithContentsOfURL:(NSURL *)URL error:(NSError **)error;
+
+/**
+ Designated initializer.
+ 
+ @param URL The file URL change sets are appended to; the file is created with the first change set
+ @param tablesByEntityName The DBDatastore table IDs of the recorded entities, keyed by entity name
+ @param syncAttributeName The sync attribute name of the recorded entities
+ */
+- (instancetype)initWithURL:(NSURL *)URL tablesByEntityName:(NSDictionary *)tablesByEntityName syncAttributeName:(NSString *)syncAttributeName;
+
+/**
+ Appends a change set to the recording, after cutting off a change set the app was killed while recording.
+ 
+ @param changes The DBRecord objects of each table keyed by table ID, as returned by `-[DBDatastore sync:]`
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return `YES` if the change set was recorded, otherwise `NO`.
+ */
+- (BOOL)recordChanges:(NSDictionary *)changes error:(NSError **)error;
+
+/**
+ Reads the recorded change sets in the order they were recorded.
+ 
+ @param block The block called with each change set, the arrays of record dictionaries of each table keyed by table ID,
+ and the date it was recorded. Set `stop` to `YES` to stop reading.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return `YES` if the recording was read, otherwise `NO`.
+ */
+- (BOOL)enumerateChangeSetsUsingBlock:(void (^)(NSDictionary *changes, NSDate *date, BOOL *stop))block error:(NSError **)error;
+
+@end
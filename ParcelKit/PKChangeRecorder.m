@@ -0,0 +1,283 @@
+//
+//  PKChangeRecorder.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import "PKChangeRecorder.h"
+#import "PKCompression.h"
+#import <Dropbox/Dropbox.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NSString * const PKChangeRecorderRecordIDKey = @"id";
+NSString * const PKChangeRecorderFieldsKey = @"fields";
+NSString * const PKChangeRecorderDeletedKey = @"deleted";
+
+static NSString * const PKChangeRecorderTablesByEntityNameKey = @"entities";
+static NSString * const PKChangeRecorderSyncAttributeNameKey = @"syncAttribute";
+static NSString * const PKChangeRecorderDateKey = @"date";
+static NSString * const PKChangeRecorderTablesKey = @"tables";
+
+static const char PKChangeRecorderMagic[4] = {'P', 'K', 'R', 'C'};
+static const uint8_t PKChangeRecorderVersion = 1;
+static const NSUInteger PKChangeRecorderPreambleLength = sizeof(PKChangeRecorderMagic) + sizeof(PKChangeRecorderVersion);
+
+static BOOL PKChangeRecorderCorruptFileError(NSURL *URL, NSError **error)
+{
+    if (error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSURLErrorKey: URL}];
+    return NO;
+}
+
+static BOOL PKChangeRecorderPOSIXError(NSURL *URL, int code, NSError **error)
+{
+    if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:@{NSURLErrorKey: URL}];
+    return NO;
+}
+
+// A frame is the big-endian length of the encoded property list followed by the encoded property list
+static BOOL PKChangeRecorderAppendFrame(NSMutableData *data, id propertyList, NSError **error)
+{
+    NSData *frame = [NSPropertyListSerialization dataWithPropertyList:propertyList format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (!frame) return NO;
+    frame = [PKCompression encodedData:frame codec:PKCompressionCodecFast];
+    
+    uint32_t length = CFSwapInt32HostToBig((uint32_t)[frame length]);
+    [data appendBytes:&length length:sizeof(length)];
+    [data appendData:frame];
+    return YES;
+}
+
+// Reads the frame at the offset and moves the offset past it. The property list is nil at the end of the data,
+// which includes a frame cut short by a write that didn't finish.
+static BOOL PKChangeRecorderReadFrame(NSData *data, NSUInteger *offset, id *propertyList, NSError **error)
+{
+    *propertyList = nil;
+    
+    uint32_t length = 0;
+    if ([data length] - *offset < sizeof(length)) return YES;
+    [data getBytes:&length range:NSMakeRange(*offset, sizeof(length))];
+    length = CFSwapInt32BigToHost(length);
+    if ([data length] - *offset - sizeof(length) < length) return YES;
+    
+    NSData *frame = [PKCompression decodedData:[data subdataWithRange:NSMakeRange(*offset + sizeof(length), length)]];
+    if (!frame) return NO;
+    *propertyList = [NSPropertyListSerialization propertyListWithData:frame options:NSPropertyListImmutable format:NULL error:error];
+    if (![*propertyList isKindOfClass:[NSDictionary class]]) {
+        *propertyList = nil;
+        return NO;
+    }
+    
+    *offset += sizeof(length) + length;
+    return YES;
+}
+
+// Returns the length of the preamble and the complete frames that follow it, leaving out a frame cut short by a write
+// that didn't finish. Returns 0 when not even the preamble and header made it, and leaves a file that isn't a recording
+// as it is.
+static off_t PKChangeRecorderCompleteLength(int fd, off_t size)
+{
+    uint8_t preamble[sizeof(PKChangeRecorderMagic) + sizeof(PKChangeRecorderVersion)];
+    if (size < (off_t)PKChangeRecorderPreambleLength) return 0;
+    if (pread(fd, preamble, PKChangeRecorderPreambleLength, 0) != (ssize_t)PKChangeRecorderPreambleLength) return size;
+    if (memcmp(preamble, PKChangeRecorderMagic, sizeof(PKChangeRecorderMagic)) != 0 || preamble[sizeof(PKChangeRecorderMagic)] != PKChangeRecorderVersion) {
+        return size;
+    }
+    
+    off_t offset = PKChangeRecorderPreambleLength;
+    uint32_t length = 0;
+    while (size - offset >= (off_t)sizeof(length)) {
+        if (pread(fd, &length, sizeof(length), offset) != (ssize_t)sizeof(length)) return size;
+        length = CFSwapInt32BigToHost(length);
+        if (size - offset - (off_t)sizeof(length) < (off_t)length) break;
+        offset += sizeof(length) + length;
+    }
+    return (offset > (off_t)PKChangeRecorderPreambleLength ? offset : 0);
+}
+
+static NSDictionary *PKChangeRecorderDictionaryWithRecord(DBRecord *record)
+{
+    if ([record isDeleted]) {
+        return @{PKChangeRecorderRecordIDKey: record.recordId, PKChangeRecorderDeletedKey: @YES};
+    }
+    
+    NSDictionary *recordFields = [record fields];
+    NSMutableDictionary *fields = [recordFields mutableCopy];
+    [recordFields enumerateKeysAndObjectsUsingBlock:^(NSString *name, id value, BOOL *stop) {
+        if ([value isKindOfClass:[DBList class]]) {
+            [fields setObject:[(DBList *)value values] forKey:name];
+        }
+    }];
+    return @{PKChangeRecorderRecordIDKey: record.recordId, PKChangeRecorderFieldsKey: fields};
+}
+
+@interface PKChangeRecorder ()
+@property (nonatomic, copy, readwrite) NSURL *URL;
+@property (nonatomic, copy, readwrite) NSDictionary *tablesByEntityName;
+@property (nonatomic, copy, readwrite) NSString *syncAttributeName;
+@property (nonatomic) off_t recordedLength;
+@end
+
+@implementation PKChangeRecorder
+
++ (instancetype)recorderWithContentsOfURL:(NSURL *)URL error:(NSError **)error
+{
+    NSData *data = [[NSData alloc] initWithContentsOfURL:URL options:NSDataReadingMappedIfSafe error:error];
+    if (!data) return nil;
+    
+    NSUInteger offset = 0;
+    id header = nil;
+    if (![self readPreambleOfData:data URL:URL offset:&offset error:error]) return nil;
+    if (!PKChangeRecorderReadFrame(data, &offset, &header, error) || !header) {
+        PKChangeRecorderCorruptFileError(URL, error);
+        return nil;
+    }
+    
+    return [[self alloc] initWithURL:URL tablesByEntityName:[header objectForKey:PKChangeRecorderTablesByEntityNameKey] syncAttributeName:[header objectForKey:PKChangeRecorderSyncAttributeNameKey]];
+}
+
++ (BOOL)readPreambleOfData:(NSData *)data URL:(NSURL *)URL offset:(NSUInteger *)offset error:(NSError **)error
+{
+    uint8_t preamble[sizeof(PKChangeRecorderMagic) + sizeof(PKChangeRecorderVersion)];
+    if ([data length] < PKChangeRecorderPreambleLength) return PKChangeRecorderCorruptFileError(URL, error);
+    [data getBytes:preamble length:PKChangeRecorderPreambleLength];
+    if (memcmp(preamble, PKChangeRecorderMagic, sizeof(PKChangeRecorderMagic)) != 0 || preamble[sizeof(PKChangeRecorderMagic)] != PKChangeRecorderVersion) {
+        return PKChangeRecorderCorruptFileError(URL, error);
+    }
+    
+    *offset = PKChangeRecorderPreambleLength;
+    return YES;
+}
+
+- (instancetype)initWithURL:(NSURL *)URL tablesByEntityName:(NSDictionary *)tablesByEntityName syncAttributeName:(NSString *)syncAttributeName
+{
+    self = [super init];
+    if (self) {
+        _URL = [URL copy];
+        _tablesByEntityName = [tablesByEntityName copy] ?: @{};
+        _syncAttributeName = [syncAttributeName copy] ?: @"";
+        _recordedLength = -1;
+    }
+    return self;
+}
+
+- (BOOL)recordChanges:(NSDictionary *)changes error:(NSError **)error
+{
+    NSMutableDictionary *tables = [[NSMutableDictionary alloc] initWithCapacity:[changes count]];
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, id records, BOOL *stop) {
+        NSMutableArray *recordDictionaries = [[NSMutableArray alloc] initWithCapacity:[records count]];
+        for (DBRecord *record in records) {
+            [recordDictionaries addObject:PKChangeRecorderDictionaryWithRecord(record)];
+        }
+        [tables setObject:recordDictionaries forKey:tableID];
+    }];
+    
+    NSMutableData *frame = [[NSMutableData alloc] init];
+    if (!PKChangeRecorderAppendFrame(frame, @{PKChangeRecorderDateKey: [NSDate date], PKChangeRecorderTablesKey: tables}, error)) return NO;
+    
+    @synchronized(self) {
+        int fd = open([[self.URL path] fileSystemRepresentation], O_RDWR | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) return PKChangeRecorderPOSIXError(self.URL, errno, error);
+        
+        NSMutableData *data = frame;
+        struct stat info;
+        BOOL written = (fstat(fd, &info) == 0);
+        off_t size = info.st_size;
+        if (written && size != self.recordedLength) {
+            // A frame cut short when the app was killed would swallow the frames appended after it
+            off_t completeLength = PKChangeRecorderCompleteLength(fd, size);
+            if (completeLength < size) {
+                NSLog(@"Removing unfinished change set at the end of %@", self.URL);
+                written = (ftruncate(fd, completeLength) == 0);
+                size = completeLength;
+            }
+        }
+        if (written && size == 0) {
+            // A new recording starts with what it takes to replay it
+            data = [[NSMutableData alloc] initWithBytes:PKChangeRecorderMagic length:sizeof(PKChangeRecorderMagic)];
+            [data appendBytes:&PKChangeRecorderVersion length:sizeof(PKChangeRecorderVersion)];
+            NSDictionary *header = @{PKChangeRecorderTablesByEntityNameKey: self.tablesByEntityName, PKChangeRecorderSyncAttributeNameKey: self.syncAttributeName};
+            if (!PKChangeRecorderAppendFrame(data, header, error)) {
+                close(fd);
+                return NO;
+            }
+            [data appendData:frame];
+        }
+        
+        const uint8_t *bytes = [data bytes];
+        NSUInteger remaining = [data length];
+        while (written && remaining > 0) {
+            ssize_t count = write(fd, bytes, remaining);
+            if (count < 0 && errno == EINTR) continue;
+            written = (count > 0);
+            if (written) {
+                bytes += count;
+                remaining -= (NSUInteger)count;
+            }
+        }
+        
+        int code = errno;
+        if (written) {
+            self.recordedLength = size + (off_t)[data length];
+        } else {
+            // Nothing of a change set that could not be written is left behind
+            ftruncate(fd, size);
+            self.recordedLength = -1;
+        }
+        close(fd);
+        if (!written) return PKChangeRecorderPOSIXError(self.URL, code, error);
+    }
+    
+    return YES;
+}
+
+- (BOOL)enumerateChangeSetsUsingBlock:(void (^)(NSDictionary *changes, NSDate *date, BOOL *stop))block error:(NSError **)error
+{
+    NSData *data = [[NSData alloc] initWithContentsOfURL:self.URL options:NSDataReadingMappedIfSafe error:error];
+    if (!data) return NO;
+    
+    NSUInteger offset = 0;
+    id header = nil;
+    if (![[self class] readPreambleOfData:data URL:self.URL offset:&offset error:error]) return NO;
+    if (!PKChangeRecorderReadFrame(data, &offset, &header, error)) return PKChangeRecorderCorruptFileError(self.URL, error);
+    
+    BOOL stop = NO;
+    while (!stop) {
+        @autoreleasepool {
+            id changeSet = nil;
+            if (!PKChangeRecorderReadFrame(data, &offset, &changeSet, error)) return PKChangeRecorderCorruptFileError(self.URL, error);
+            if (!changeSet) break;
+            
+            block([changeSet objectForKey:PKChangeRecorderTablesKey], [changeSet objectForKey:PKChangeRecorderDateKey], &stop);
+        }
+    }
+    
+    if (!stop && offset < [data length]) {
+        NSLog(@"Ignoring unfinished change set at the end of %@", self.URL);
+    }
+    return YES;
+}
+
+@end
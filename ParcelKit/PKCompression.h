@@ -0,0 +1,60 @@
+//
+//  PKCompression.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(uint8_t, PKCompressionCodec) {
+    // Stored as is, only used to frame data that would otherwise look compressed
+    PKCompressionCodecNone = 0,
+    // zlib at its fastest level
+    PKCompressionCodecFast = 1,
+    // zlib at its highest compression level
+    PKCompressionCodecBest = 2
+};
+
+// Encodes field values with a self-describing header: the bytes “PKZ”, the codec and the decoded length
+// as a big-endian 64-bit integer followed by the encoded bytes. Values without the header are left as is,
+// so encoded and plain values can be mixed and decoding is transparent.
+@interface PKCompression : NSObject
+
+// Returns the codec named by an attribute's `PKCompressionUserInfoKey` user info value (“none”, “fast” or “best”),
+// or -1 if the name isn't a codec.
++ (NSInteger)codecNamed:(NSString *)name;
+
+// Returns the encoded data if it is smaller than data, otherwise data itself.
+// Data that starts with the header is framed with PKCompressionCodecNone so it can't be mistaken for encoded data.
++ (NSData *)encodedData:(NSData *)data codec:(PKCompressionCodec)codec;
+
+// Returns whether data starts with a valid header and, if so, the length of the decoded data.
++ (BOOL)isEncodedData:(NSData *)data decodedLength:(NSUInteger *)decodedLength;
+
+// Decodes encoded data into bytes, which must hold the decoded length. Returns NO if the data is corrupt.
++ (BOOL)decodeData:(NSData *)data intoBytes:(void *)bytes;
+
+// Returns the decoded data, data itself if it isn't encoded or nil if it is corrupt.
++ (NSData *)decodedData:(NSData *)data;
+
+@end
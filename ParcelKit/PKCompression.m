@@ -0,0 +1,136 @@
+//
+//  PKCompression.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <zlib.h>
+#import "PKCompression.h"
+
+static const uint8_t PKCompressionMagic[3] = {'P', 'K', 'Z'};
+static const NSUInteger PKCompressionHeaderLength = sizeof(PKCompressionMagic) + 1 + sizeof(uint64_t);
+
+static BOOL PKCompressionHasMagic(NSData *data)
+{
+    return [data length] >= sizeof(PKCompressionMagic) && memcmp([data bytes], PKCompressionMagic, sizeof(PKCompressionMagic)) == 0;
+}
+
+static NSMutableData *PKCompressionDataWithHeader(PKCompressionCodec codec, NSUInteger decodedLength, NSUInteger capacity)
+{
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity:PKCompressionHeaderLength + capacity];
+    [data appendBytes:PKCompressionMagic length:sizeof(PKCompressionMagic)];
+    [data appendBytes:&codec length:1];
+    uint64_t length = CFSwapInt64HostToBig((uint64_t)decodedLength);
+    [data appendBytes:&length length:sizeof(length)];
+    return data;
+}
+
+@implementation PKCompression
+
++ (NSInteger)codecNamed:(NSString *)name
+{
+    if ([name isEqualToString:@"none"]) return PKCompressionCodecNone;
+    if ([name isEqualToString:@"fast"]) return PKCompressionCodecFast;
+    if ([name isEqualToString:@"best"]) return PKCompressionCodecBest;
+    return -1;
+}
+
++ (NSData *)encodedData:(NSData *)data codec:(PKCompressionCodec)codec
+{
+    NSUInteger length = [data length];
+    if (codec != PKCompressionCodecNone && length > PKCompressionHeaderLength) {
+        // Only leave room for output that ends up smaller than the input
+        uLongf compressedLength = (uLongf)MIN((NSUInteger)compressBound((uLong)length), length - PKCompressionHeaderLength - 1);
+        
+        NSMutableData *encodedData = PKCompressionDataWithHeader(codec, length, compressedLength);
+        [encodedData setLength:PKCompressionHeaderLength + compressedLength];
+        int level = (codec == PKCompressionCodecBest ? Z_BEST_COMPRESSION : Z_BEST_SPEED);
+        uint8_t *bytes = (uint8_t *)[encodedData mutableBytes] + PKCompressionHeaderLength;
+        
+        // Z_BUF_ERROR means the output wouldn't have been smaller than the input
+        if (compress2(bytes, &compressedLength, [data bytes], (uLong)length, level) == Z_OK) {
+            [encodedData setLength:PKCompressionHeaderLength + compressedLength];
+            return encodedData;
+        }
+    }
+    
+    if (PKCompressionHasMagic(data)) {
+        NSMutableData *encodedData = PKCompressionDataWithHeader(PKCompressionCodecNone, length, length);
+        [encodedData appendData:data];
+        return encodedData;
+    }
+    
+    return data;
+}
+
++ (BOOL)isEncodedData:(NSData *)data decodedLength:(NSUInteger *)decodedLength
+{
+    if ([data length] < PKCompressionHeaderLength || !PKCompressionHasMagic(data)) return NO;
+    
+    const uint8_t *bytes = [data bytes];
+    uint8_t codec = bytes[sizeof(PKCompressionMagic)];
+    if (codec > PKCompressionCodecBest) return NO;
+    
+    uint64_t length = 0;
+    memcpy(&length, bytes + sizeof(PKCompressionMagic) + 1, sizeof(length));
+    length = CFSwapInt64BigToHost(length);
+    if (length > NSUIntegerMax) return NO;
+    NSUInteger encodedLength = [data length] - PKCompressionHeaderLength;
+    if (codec == PKCompressionCodecNone && length != encodedLength) return NO;
+    
+    // zlib can't expand data by more than about 1032 times, anything else is not a header of ours
+    if (codec != PKCompressionCodecNone && length / 1032 > encodedLength) return NO;
+    
+    if (decodedLength) *decodedLength = (NSUInteger)length;
+    return YES;
+}
+
++ (BOOL)decodeData:(NSData *)data intoBytes:(void *)bytes
+{
+    NSUInteger decodedLength = 0;
+    if (![self isEncodedData:data decodedLength:&decodedLength]) return NO;
+    
+    const uint8_t *encodedBytes = (const uint8_t *)[data bytes] + PKCompressionHeaderLength;
+    NSUInteger encodedLength = [data length] - PKCompressionHeaderLength;
+    PKCompressionCodec codec = ((const uint8_t *)[data bytes])[sizeof(PKCompressionMagic)];
+    
+    if (codec == PKCompressionCodecNone) {
+        memcpy(bytes, encodedBytes, encodedLength);
+        return YES;
+    }
+    
+    uLongf length = (uLongf)decodedLength;
+    return uncompress(bytes, &length, encodedBytes, (uLong)encodedLength) == Z_OK && length == decodedLength;
+}
+
++ (NSData *)decodedData:(NSData *)data
+{
+    NSUInteger decodedLength = 0;
+    if (![self isEncodedData:data decodedLength:&decodedLength]) return data;
+    
+    NSMutableData *decodedData = [[NSMutableData alloc] initWithLength:decodedLength];
+    if (![self decodeData:data intoBytes:[decodedData mutableBytes]]) return nil;
+    return decodedData;
+}
+
+@end
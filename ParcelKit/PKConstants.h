@@ -30,8 +30,54 @@
 #define PKBinaryDataTableSuffix @".bin"
 #endif
 
+// Chunked binary data stores a digest of its contents in a field named by appending a suffix
+// to the attribute name, so unchanged data can be detected without reading back the chunks.
+// The suffix can be overridden by defining PKBinaryDataDigestFieldSuffix before including ParcelKit.
+#ifndef PKBinaryDataDigestFieldSuffix
+#define PKBinaryDataDigestFieldSuffix @"_digest"
+#endif
+
+// Binary and string attributes can choose a compression codec with an entry in their user info in the
+// Core Data model, the value is “none”, “fast” or “best”.
+// The key can be overridden by defining PKCompressionUserInfoKey before including ParcelKit.
+#ifndef PKCompressionUserInfoKey
+#define PKCompressionUserInfoKey @"PKCompression"
+#endif
+
 // By default binary data will use up to half the maximum record size of 100 KiB.
 // Can be overridden by defining PKMaximumBinaryDataLengthInBytes before including ParcelKit.
 #ifndef PKMaximumBinaryDataLengthInBytes
 #define PKMaximumBinaryDataLengthInBytes 50000
 #endif
+
+// Binary data larger than PKMaximumBinaryDataLengthInBytes is split into chunks of at most this many bytes.
+// Can be overridden by defining PKMaximumBinaryDataChunkLengthInBytes before including ParcelKit.
+#ifndef PKMaximumBinaryDataChunkLengthInBytes
+#define PKMaximumBinaryDataChunkLengthInBytes 95000
+#endif
+
+// Incoming records are looked up with one fetch per batch of sync identifiers.
+// Can be overridden by defining PKSyncIDFetchBatchSize before including ParcelKit.
+#ifndef PKSyncIDFetchBatchSize
+#define PKSyncIDFetchBatchSize 500
+#endif
+
+// Exporting existing managed objects fetches, writes and checkpoints this many objects at a time.
+// Can be overridden by defining PKExportBatchSize before including ParcelKit.
+#ifndef PKExportBatchSize
+#define PKExportBatchSize 500
+#endif
+
+// Incoming records of entities without objects are inserted and saved this many at a time
+// unless the sync manager has an incoming changes window size of its own.
+// Can be overridden by defining PKBootstrapBatchSize before including ParcelKit.
+#ifndef PKBootstrapBatchSize
+#define PKBootstrapBatchSize 5000
+#endif
+
+// Outgoing changes are synced whenever the next record would take the estimated size of the unsynced changes
+// past this many bytes. The Datastore API accepts at most 2 MiB of unsynced changes, the default leaves some headroom.
+// Can be overridden by defining PKSyncBatchByteLimit before including ParcelKit.
+#ifndef PKSyncBatchByteLimit
+#define PKSyncBatchByteLimit (1984 * 1024)
+#endif
@@ -0,0 +1,150 @@
+//
+//  PKEntitySyncPlan.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+#import <Dropbox/Dropbox.h>
+#import "PKCompression.h"
+
+// Converts a record value to the type of a Core Data attribute, returns nil if the value cannot be converted.
+typedef id (*PKSyncPlanCoercion)(id value);
+
+@interface PKSyncPlanAttribute : NSObject
+@property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, readonly) NSAttributeType attributeType;
+@property (nonatomic, readonly, getter=isOptional) BOOL optional;
+@property (nonatomic, readonly, getter=isBinary) BOOL binary;
+@property (nonatomic, readonly) Class valueClass;
+@property (nonatomic, readonly) PKSyncPlanCoercion coercion;
+
+// The codec chosen in the model, or -1 if the codec is picked by size.
+@property (nonatomic, readonly) NSInteger compressionCodec;
+@end
+
+@interface PKSyncPlanRelationship : NSObject
+@property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, copy, readonly) NSString *destinationEntityName;
+@property (nonatomic, readonly, getter=isToMany) BOOL toMany;
+@property (nonatomic, readonly, getter=isOrdered) BOOL ordered;
+@property (nonatomic, readonly, getter=isInverseOptional) BOOL inverseOptional;
+
+// One-to-many relationships are left to the "one" side of the equation and are not stored in records.
+@property (nonatomic, readonly, getter=isSynced) BOOL synced;
+@end
+
+/**
+ A sync plan holds everything needed to map one Core Data entity to records that can be computed once:
+ the synced attributes with their coercions, the synced relationships and the Dropbox table handles.
+ */
+@interface PKEntitySyncPlan : NSObject
+
+@property (nonatomic, copy, readonly) NSString *entityName;
+@property (nonatomic, copy, readonly) NSString *tableID;
+@property (nonatomic, copy, readonly) NSString *syncAttributeName;
+
+/** The synced attributes, excluding the sync attribute and transient attributes. */
+@property (nonatomic, copy, readonly) NSArray *attributes;
+
+/** The synced relationships, excluding transient relationships. */
+@property (nonatomic, copy, readonly) NSArray *relationships;
+
+/** The names of all synced attributes and relationships. */
+@property (nonatomic, copy, readonly) NSArray *propertyNames;
+
+/**
+ Whether managed objects of the entity choose their synced properties with `syncedPropertiesDictionary:`,
+ in which case the properties have to be asked for per managed object.
+ */
+@property (nonatomic, readonly) BOOL usesSyncedPropertiesDictionary;
+
+/**
+ The directory chunked binary data of incoming records is reassembled in, or nil to reassemble it in memory.
+ 
+ Reassembled data is memory mapped from its file so large attachments don't have to fit in memory twice. The file is
+ unlinked once mapped, so it doesn't outlive the data.
+ */
+@property (nonatomic, copy) NSURL *binaryDataDirectoryURL;
+
+/**
+ Binary and string values at least this long are compressed with `PKCompressionCodecFast`
+ unless their attribute chooses a codec in the model. Zero turns compression by size off.
+ */
+@property (nonatomic) NSUInteger compressionThresholdInBytes;
+
+/**
+ Returns a sync plan for the given entity.
+ @param entity The Core Data entity the plan is for.
+ @param tableID The Dropbox data store tableID the entity maps to, or nil if the plan is not used to access tables.
+ @param syncAttributeName The Core Data entity attribute name used for keeping managed objects in sync.
+ @return A newly initialized `PKEntitySyncPlan` object.
+ */
+- (instancetype)initWithEntity:(NSEntityDescription *)entity tableID:(NSString *)tableID syncAttributeName:(NSString *)syncAttributeName;
+
+/** Returns the synced attribute or relationship with the given name. */
+- (id)propertyForName:(NSString *)name;
+
+/** Returns whether the property with the given name is never synced, like the sync attribute or transient properties. */
+- (BOOL)excludesPropertyName:(NSString *)name;
+
+/** Returns the synced attributes of the given managed object. */
+- (NSArray *)attributesForManagedObject:(NSManagedObject *)managedObject;
+
+/** Returns the synced relationships of the given managed object. */
+- (NSArray *)relationshipsForManagedObject:(NSManagedObject *)managedObject;
+
+/** Returns the values to sync of the given managed object keyed by field name. */
+- (NSDictionary *)syncedValuesForManagedObject:(NSManagedObject *)managedObject;
+
+/**
+ Returns the values to sync of the properties changed since the managed object was last saved, without reading the others.
+ Managed objects that choose their synced properties with `syncedPropertiesDictionary:` return all their values.
+ */
+- (NSDictionary *)changedSyncedValuesForManagedObject:(NSManagedObject *)managedObject;
+
+/**
+ Returns the values writing the given managed object sets on its record: the changed values of updated objects,
+ otherwise all synced values.
+ */
+- (NSDictionary *)valuesToWriteForManagedObject:(NSManagedObject *)managedObject;
+
+/**
+ Returns an upper bound of the bytes writing the given values adds to the unsynced changes of a datastore,
+ following the size accounting of the Datastore API.
+ */
+- (NSUInteger)estimatedChangeSizeOfValues:(NSDictionary *)values;
+
+/** Returns the table of the entity, the handle is cached per datastore. */
+- (DBTable *)tableInDatastore:(DBDatastore *)datastore;
+
+/** Returns the table binary data of records in the given table is stored in, the handle is cached per table. */
+- (DBTable *)binaryTableForTable:(DBTable *)table;
+
+/** Returns the codec to encode a value of the given attribute and length with. */
+- (PKCompressionCodec)compressionCodecForAttribute:(PKSyncPlanAttribute *)attribute length:(NSUInteger)length;
+
+/** Returns the file the binary data of the given attribute of a record is reassembled in, or nil without a `binaryDataDirectoryURL`. */
+- (NSURL *)binaryDataFileURLForRecordID:(NSString *)recordID attributeName:(NSString *)attributeName;
+
+@end
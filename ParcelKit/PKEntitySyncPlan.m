@@ -0,0 +1,374 @@
+//
+//  PKEntitySyncPlan.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKEntitySyncPlan.h"
+#import "PKConstants.h"
+#import "NSManagedObject+ParcelKit.h"
+
+static id PKCoerceString(id value)
+{
+    if ([value isKindOfClass:[NSString class]]) return value;
+    return [value respondsToSelector:@selector(stringValue)] ? [value stringValue] : nil;
+}
+
+static id PKCoerceInteger(id value)
+{
+    if ([value isKindOfClass:[NSNumber class]]) return value;
+    return [value respondsToSelector:@selector(integerValue)] ? [NSNumber numberWithInteger:[value integerValue]] : nil;
+}
+
+static id PKCoerceBoolean(id value)
+{
+    if ([value isKindOfClass:[NSNumber class]]) return value;
+    return [value respondsToSelector:@selector(boolValue)] ? [NSNumber numberWithBool:[value boolValue]] : nil;
+}
+
+static id PKCoerceDouble(id value)
+{
+    if ([value isKindOfClass:[NSNumber class]]) return value;
+    return [value respondsToSelector:@selector(doubleValue)] ? [NSNumber numberWithDouble:[value doubleValue]] : nil;
+}
+
+static id PKCoerceDate(id value)
+{
+    return [value isKindOfClass:[NSDate class]] ? value : nil;
+}
+
+static id PKCoerceData(id value)
+{
+    return [value isKindOfClass:[NSData class]] ? value : nil;
+}
+
+static id PKCoerceNone(id value)
+{
+    return value;
+}
+
+// The sizes the Datastore API accounts records, fields, list items and changes with, on top of their values
+static const NSUInteger PKRecordBaseSize = 100;
+static const NSUInteger PKFieldBaseSize = 100;
+static const NSUInteger PKListItemBaseSize = 20;
+static const NSUInteger PKChangeBaseSize = 100;
+
+// Record identifiers are at most 64 characters long
+static const NSUInteger PKRecordIDMaximumSize = 64;
+
+static NSUInteger PKEstimatedValueSize(id value)
+{
+    if ([value isKindOfClass:[NSString class]]) return [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    if ([value isKindOfClass:[NSData class]]) return [value length];
+    return 8;
+}
+
+@interface PKSyncPlanAttribute ()
+@property (nonatomic, copy, readwrite) NSString *name;
+@property (nonatomic, readwrite) NSAttributeType attributeType;
+@property (nonatomic, readwrite, getter=isOptional) BOOL optional;
+@property (nonatomic, readwrite, getter=isBinary) BOOL binary;
+@property (nonatomic, readwrite) Class valueClass;
+@property (nonatomic, readwrite) PKSyncPlanCoercion coercion;
+@property (nonatomic, readwrite) NSInteger compressionCodec;
+@end
+
+@implementation PKSyncPlanAttribute
+- (instancetype)initWithAttributeDescription:(NSAttributeDescription *)attributeDescription
+{
+    self = [super init];
+    if (self) {
+        _name = [[attributeDescription name] copy];
+        _attributeType = [attributeDescription attributeType];
+        _optional = [attributeDescription isOptional];
+        _binary = (_attributeType == NSBinaryDataAttributeType);
+        
+        _compressionCodec = -1;
+        NSString *codecName = [[attributeDescription userInfo] objectForKey:PKCompressionUserInfoKey];
+        if (codecName) {
+            _compressionCodec = [PKCompression codecNamed:codecName];
+            NSAssert(_compressionCodec >= 0, @"Attribute “%@” has unknown compression codec “%@”", _name, codecName);
+        }
+        
+        switch (_attributeType) {
+            case NSStringAttributeType:
+                _valueClass = [NSString class];
+                _coercion = PKCoerceString;
+                break;
+            case NSInteger16AttributeType:
+            case NSInteger32AttributeType:
+            case NSInteger64AttributeType:
+                _valueClass = [NSNumber class];
+                _coercion = PKCoerceInteger;
+                break;
+            case NSBooleanAttributeType:
+                _valueClass = [NSNumber class];
+                _coercion = PKCoerceBoolean;
+                break;
+            case NSDoubleAttributeType:
+            case NSFloatAttributeType:
+            case NSDecimalAttributeType:
+                _valueClass = [NSNumber class];
+                _coercion = PKCoerceDouble;
+                break;
+            case NSDateAttributeType:
+                _valueClass = [NSDate class];
+                _coercion = PKCoerceDate;
+                break;
+            case NSBinaryDataAttributeType:
+                _valueClass = [NSData class];
+                _coercion = PKCoerceData;
+                break;
+            default:
+                _valueClass = [NSObject class];
+                _coercion = PKCoerceNone;
+                break;
+        }
+    }
+    return self;
+}
+@end
+
+@interface PKSyncPlanRelationship ()
+@property (nonatomic, copy, readwrite) NSString *name;
+@property (nonatomic, copy, readwrite) NSString *destinationEntityName;
+@property (nonatomic, readwrite, getter=isToMany) BOOL toMany;
+@property (nonatomic, readwrite, getter=isOrdered) BOOL ordered;
+@property (nonatomic, readwrite, getter=isInverseOptional) BOOL inverseOptional;
+@property (nonatomic, readwrite, getter=isSynced) BOOL synced;
+@end
+
+@implementation PKSyncPlanRelationship
+- (instancetype)initWithRelationshipDescription:(NSRelationshipDescription *)relationshipDescription
+{
+    self = [super init];
+    if (self) {
+        NSRelationshipDescription *inverse = [relationshipDescription inverseRelationship];
+        _name = [[relationshipDescription name] copy];
+        _destinationEntityName = [[[relationshipDescription destinationEntity] name] copy];
+        _toMany = [relationshipDescription isToMany];
+        _ordered = [relationshipDescription isOrdered];
+        _inverseOptional = [inverse isOptional];
+        _synced = (!_toMany || [inverse isToMany]);
+    }
+    return self;
+}
+@end
+
+@interface PKEntitySyncPlan ()
+@property (nonatomic, copy, readwrite) NSString *entityName;
+@property (nonatomic, copy, readwrite) NSString *tableID;
+@property (nonatomic, copy, readwrite) NSString *syncAttributeName;
+@property (nonatomic, copy, readwrite) NSArray *attributes;
+@property (nonatomic, copy, readwrite) NSArray *relationships;
+@property (nonatomic, copy, readwrite) NSArray *propertyNames;
+@property (nonatomic, readwrite) BOOL usesSyncedPropertiesDictionary;
+@property (nonatomic, strong) NSDictionary *propertiesByName;
+@property (nonatomic, strong) NSDictionary *entityPropertiesByName;
+@property (nonatomic, strong) NSSet *excludedPropertyNames;
+@property (nonatomic, strong) DBDatastore *tableDatastore;
+@property (nonatomic, strong) DBTable *table;
+@property (nonatomic, strong) NSMapTable *binaryTables;
+@end
+
+@implementation PKEntitySyncPlan
+
+- (instancetype)initWithEntity:(NSEntityDescription *)entity tableID:(NSString *)tableID syncAttributeName:(NSString *)syncAttributeName
+{
+    self = [super init];
+    if (self) {
+        _entityName = [[entity name] copy];
+        _tableID = [tableID copy];
+        _syncAttributeName = [syncAttributeName copy];
+        _entityPropertiesByName = [entity propertiesByName];
+        _binaryTables = [NSMapTable strongToStrongObjectsMapTable];
+        
+        Class managedObjectClass = NSClassFromString([entity managedObjectClassName]);
+        _usesSyncedPropertiesDictionary = [managedObjectClass instancesRespondToSelector:@selector(syncedPropertiesDictionary:)];
+        
+        NSMutableArray *attributes = [[NSMutableArray alloc] init];
+        NSMutableArray *relationships = [[NSMutableArray alloc] init];
+        NSMutableDictionary *propertiesByName = [[NSMutableDictionary alloc] init];
+        NSMutableSet *excludedPropertyNames = [[NSMutableSet alloc] initWithObjects:syncAttributeName, nil];
+        [_entityPropertiesByName enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSPropertyDescription *propertyDescription, BOOL *stop) {
+            if ([name isEqualToString:syncAttributeName] || [propertyDescription isTransient]) {
+                [excludedPropertyNames addObject:name];
+                return;
+            }
+            
+            id property = nil;
+            if ([propertyDescription isKindOfClass:[NSAttributeDescription class]]) {
+                property = [[PKSyncPlanAttribute alloc] initWithAttributeDescription:(NSAttributeDescription *)propertyDescription];
+                [attributes addObject:property];
+            } else if ([propertyDescription isKindOfClass:[NSRelationshipDescription class]]) {
+                property = [[PKSyncPlanRelationship alloc] initWithRelationshipDescription:(NSRelationshipDescription *)propertyDescription];
+                [relationships addObject:property];
+            }
+            
+            if (property) {
+                [propertiesByName setObject:property forKey:name];
+            }
+        }];
+        
+        _attributes = [attributes copy];
+        _relationships = [relationships copy];
+        _propertiesByName = [propertiesByName copy];
+        _propertyNames = [[propertiesByName allKeys] copy];
+        _excludedPropertyNames = [excludedPropertyNames copy];
+    }
+    return self;
+}
+
+- (id)propertyForName:(NSString *)name
+{
+    return [self.propertiesByName objectForKey:name];
+}
+
+- (BOOL)excludesPropertyName:(NSString *)name
+{
+    return [self.excludedPropertyNames containsObject:name];
+}
+
+- (NSArray *)propertiesOfClass:(Class)propertyClass forManagedObject:(NSManagedObject *)managedObject defaultProperties:(NSArray *)defaultProperties
+{
+    if (!self.usesSyncedPropertiesDictionary) return defaultProperties;
+    
+    NSMutableArray *properties = [[NSMutableArray alloc] init];
+    for (NSString *name in [[self syncedValuesForManagedObject:managedObject] allKeys]) {
+        id property = [self.propertiesByName objectForKey:name];
+        if ([property isKindOfClass:propertyClass]) {
+            [properties addObject:property];
+        }
+    }
+    return properties;
+}
+
+- (NSArray *)attributesForManagedObject:(NSManagedObject *)managedObject
+{
+    return [self propertiesOfClass:[PKSyncPlanAttribute class] forManagedObject:managedObject defaultProperties:self.attributes];
+}
+
+- (NSArray *)relationshipsForManagedObject:(NSManagedObject *)managedObject
+{
+    return [self propertiesOfClass:[PKSyncPlanRelationship class] forManagedObject:managedObject defaultProperties:self.relationships];
+}
+
+- (NSDictionary *)syncedValuesForManagedObject:(NSManagedObject *)managedObject
+{
+    if (self.usesSyncedPropertiesDictionary && [managedObject respondsToSelector:@selector(syncedPropertiesDictionary:)]) {
+        // Get the custom properties dictionary
+        return [managedObject performSelector:@selector(syncedPropertiesDictionary:) withObject:self.entityPropertiesByName];
+    } else {
+        // Get the standard properties dictionary
+        return [managedObject dictionaryWithValuesForKeys:self.propertyNames];
+    }
+}
+
+- (NSDictionary *)changedSyncedValuesForManagedObject:(NSManagedObject *)managedObject
+{
+    // Custom properties can be derived from any property, so there is no telling which of them changed
+    if (self.usesSyncedPropertiesDictionary) return [self syncedValuesForManagedObject:managedObject];
+    
+    NSDictionary *changedValues = [managedObject changedValues];
+    NSMutableDictionary *values = [[NSMutableDictionary alloc] initWithCapacity:[changedValues count]];
+    [changedValues enumerateKeysAndObjectsUsingBlock:^(NSString *name, id value, BOOL *stop) {
+        if ([self.propertiesByName objectForKey:name]) {
+            [values setObject:value forKey:name];
+        }
+    }];
+    return values;
+}
+
+- (NSDictionary *)valuesToWriteForManagedObject:(NSManagedObject *)managedObject
+{
+    // Updated objects only write their changed fields
+    return ([managedObject isUpdated] ? [self changedSyncedValuesForManagedObject:managedObject] : [self syncedValuesForManagedObject:managedObject]);
+}
+
+- (NSUInteger)estimatedChangeSizeOfValues:(NSDictionary *)values
+{
+    __block NSUInteger size = PKChangeBaseSize + PKRecordBaseSize;
+    [values enumerateKeysAndObjectsUsingBlock:^(NSString *name, id value, BOOL *stop) {
+        if ([self excludesPropertyName:name] || value == [NSNull null]) return;
+        
+        id property = [self.propertiesByName objectForKey:name];
+        if ([property isKindOfClass:[PKSyncPlanRelationship class]]) {
+            if (![property isSynced]) return;
+            size += PKFieldBaseSize + ([property isToMany] ? [value count] * (PKListItemBaseSize + PKRecordIDMaximumSize) : PKRecordIDMaximumSize);
+        } else if ([property isBinary] && [value length] > PKMaximumBinaryDataLengthInBytes) {
+            // Chunks are at least a quarter of the maximum chunk length, each is a record of its own listed in the field
+            NSUInteger chunkCount = [value length] / MAX(PKMaximumBinaryDataChunkLengthInBytes / 4, 1) + 1;
+            size += [value length] + chunkCount * (PKChangeBaseSize + PKRecordBaseSize + PKFieldBaseSize + PKListItemBaseSize + PKRecordIDMaximumSize);
+            // The list field and the digest field next to it
+            size += PKFieldBaseSize + PKFieldBaseSize + 64;
+        } else {
+            size += PKFieldBaseSize + PKEstimatedValueSize(value);
+        }
+    }];
+    return size;
+}
+
+- (DBTable *)tableInDatastore:(DBDatastore *)datastore
+{
+    @synchronized(self) {
+        if (!self.table || self.tableDatastore != datastore) {
+            self.table = [datastore getTable:self.tableID];
+            self.tableDatastore = datastore;
+        }
+        return self.table;
+    }
+}
+
+- (DBTable *)binaryTableForTable:(DBTable *)table
+{
+    @synchronized(self) {
+        DBTable *binaryTable = [self.binaryTables objectForKey:table];
+        if (!binaryTable) {
+            NSString *binaryTableID = [table.tableId stringByAppendingString:PKBinaryDataTableSuffix];
+            binaryTable = [table.datastore getTable:binaryTableID];
+            if (binaryTable) {
+                [self.binaryTables setObject:binaryTable forKey:table];
+            }
+        }
+        return binaryTable;
+    }
+}
+
+- (PKCompressionCodec)compressionCodecForAttribute:(PKSyncPlanAttribute *)attribute length:(NSUInteger)length
+{
+    if (attribute.attributeType != NSBinaryDataAttributeType && attribute.attributeType != NSStringAttributeType) return PKCompressionCodecNone;
+    if (attribute.compressionCodec >= 0) return (PKCompressionCodec)attribute.compressionCodec;
+    
+    NSUInteger compressionThresholdInBytes = self.compressionThresholdInBytes;
+    return (compressionThresholdInBytes > 0 && length >= compressionThresholdInBytes ? PKCompressionCodecFast : PKCompressionCodecNone);
+}
+
+- (NSURL *)binaryDataFileURLForRecordID:(NSString *)recordID attributeName:(NSString *)attributeName
+{
+    NSURL *directoryURL = self.binaryDataDirectoryURL;
+    if (!directoryURL) return nil;
+    
+    NSString *fileName = [[NSString stringWithFormat:@"%@-%@-%@", self.entityName, recordID, attributeName] stringByReplacingOccurrencesOfString:@"/" withString:@"_"];
+    return [directoryURL URLByAppendingPathComponent:fileName];
+}
+
+@end
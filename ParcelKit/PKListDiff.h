@@ -0,0 +1,54 @@
+//
+//  PKListDiff.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, PKListDiffOperationType) {
+    PKListDiffOperationRemove,
+    PKListDiffOperationInsert,
+    PKListDiffOperationMove
+};
+
+@interface PKListDiffOperation : NSObject
+@property (nonatomic, readonly) PKListDiffOperationType type;
+@property (nonatomic, strong, readonly) id object;
+
+// Remove and move: the index of the object before the operation. Insert: the index the object is inserted at.
+@property (nonatomic, readonly) NSUInteger index;
+
+// Move: the index of the object after the operation, as if it was removed first and then inserted.
+@property (nonatomic, readonly) NSUInteger toIndex;
+@end
+
+@interface PKListDiff : NSObject
+
+// Returns the operations that turn fromArray into toArray when applied in order.
+// Objects that stay in the longest run already in order are never touched, so the script is minimal in moves.
+// Duplicate objects in fromArray are removed and duplicates in toArray are ignored.
++ (NSArray *)operationsFromArray:(NSArray *)fromArray toArray:(NSArray *)toArray;
+
++ (void)applyOperations:(NSArray *)operations toArray:(NSMutableArray *)array;
+
+@end
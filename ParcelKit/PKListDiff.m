@@ -0,0 +1,180 @@
+//
+//  PKListDiff.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKListDiff.h"
+
+@interface PKListDiffOperation ()
+@property (nonatomic, readwrite) PKListDiffOperationType type;
+@property (nonatomic, strong, readwrite) id object;
+@property (nonatomic, readwrite) NSUInteger index;
+@property (nonatomic, readwrite) NSUInteger toIndex;
+@end
+
+@implementation PKListDiffOperation
++ (instancetype)operationWithType:(PKListDiffOperationType)type object:(id)object index:(NSUInteger)index toIndex:(NSUInteger)toIndex
+{
+    PKListDiffOperation *operation = [[self alloc] init];
+    operation.type = type;
+    operation.object = object;
+    operation.index = index;
+    operation.toIndex = toIndex;
+    return operation;
+}
+
+- (NSString *)description
+{
+    switch (self.type) {
+        case PKListDiffOperationRemove: return [NSString stringWithFormat:@"remove %@ at %lu", self.object, (unsigned long)self.index];
+        case PKListDiffOperationInsert: return [NSString stringWithFormat:@"insert %@ at %lu", self.object, (unsigned long)self.index];
+        case PKListDiffOperationMove: return [NSString stringWithFormat:@"move %@ from %lu to %lu", self.object, (unsigned long)self.index, (unsigned long)self.toIndex];
+    }
+    return [super description];
+}
+@end
+
+// Returns the indexes of a longest strictly increasing subsequence of values in O(n log n)
+static NSIndexSet *PKLongestIncreasingSubsequence(const NSUInteger *values, NSUInteger count)
+{
+    NSMutableIndexSet *indexes = [[NSMutableIndexSet alloc] init];
+    if (count == 0) return indexes;
+    
+    NSUInteger *tails = malloc(count * sizeof(NSUInteger));
+    NSUInteger *previous = malloc(count * sizeof(NSUInteger));
+    NSUInteger length = 0;
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger low = 0, high = length;
+        while (low < high) {
+            NSUInteger middle = low + (high - low) / 2;
+            if (values[tails[middle]] < values[i]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        
+        previous[i] = (low > 0) ? tails[low - 1] : NSNotFound;
+        tails[low] = i;
+        if (low == length) length++;
+    }
+    
+    for (NSUInteger index = tails[length - 1]; index != NSNotFound; index = previous[index]) {
+        [indexes addIndex:index];
+    }
+    
+    free(tails);
+    free(previous);
+    return indexes;
+}
+
+@implementation PKListDiff
+
++ (NSArray *)operationsFromArray:(NSArray *)fromArray toArray:(NSArray *)toArray
+{
+    NSMutableArray *operations = [[NSMutableArray alloc] init];
+    
+    NSMutableArray *targetObjects = [[NSMutableArray alloc] initWithCapacity:[toArray count]];
+    NSMutableDictionary *targetIndexes = [[NSMutableDictionary alloc] initWithCapacity:[toArray count]];
+    for (id object in toArray) {
+        if ([targetIndexes objectForKey:object]) continue;
+        [targetIndexes setObject:@([targetObjects count]) forKey:object];
+        [targetObjects addObject:object];
+    }
+    
+    // Remove unwanted objects from the end so that the indexes of earlier removals stay valid
+    NSMutableIndexSet *removedIndexes = [[NSMutableIndexSet alloc] init];
+    NSMutableSet *keptObjects = [[NSMutableSet alloc] initWithCapacity:[fromArray count]];
+    [fromArray enumerateObjectsUsingBlock:^(id object, NSUInteger index, BOOL *stop) {
+        if (![targetIndexes objectForKey:object] || [keptObjects containsObject:object]) {
+            [removedIndexes addIndex:index];
+        } else {
+            [keptObjects addObject:object];
+        }
+    }];
+    [removedIndexes enumerateIndexesWithOptions:NSEnumerationReverse usingBlock:^(NSUInteger index, BOOL *stop) {
+        [operations addObject:[PKListDiffOperation operationWithType:PKListDiffOperationRemove object:fromArray[index] index:index toIndex:NSNotFound]];
+    }];
+    
+    NSMutableArray *workingObjects = [fromArray mutableCopy];
+    [workingObjects removeObjectsAtIndexes:removedIndexes];
+    
+    // Objects in the longest run that is already in target order stay where they are
+    NSUInteger count = [workingObjects count];
+    NSUInteger *positions = malloc(MAX(count, 1) * sizeof(NSUInteger));
+    for (NSUInteger i = 0; i < count; i++) {
+        positions[i] = [[targetIndexes objectForKey:workingObjects[i]] unsignedIntegerValue];
+    }
+    NSSet *stableObjects = [[NSSet alloc] initWithArray:[workingObjects objectsAtIndexes:PKLongestIncreasingSubsequence(positions, count)]];
+    free(positions);
+    
+    // Every other object is placed in front of its successor, from the last one to the first
+    id anchor = nil;
+    for (NSUInteger i = [targetObjects count]; i > 0; i--) {
+        id object = targetObjects[i - 1];
+        if ([stableObjects containsObject:object]) {
+            anchor = object;
+            continue;
+        }
+        
+        NSUInteger anchorIndex = anchor ? [workingObjects indexOfObject:anchor] : [workingObjects count];
+        if (![keptObjects containsObject:object]) {
+            [workingObjects insertObject:object atIndex:anchorIndex];
+            [operations addObject:[PKListDiffOperation operationWithType:PKListDiffOperationInsert object:object index:anchorIndex toIndex:NSNotFound]];
+        } else {
+            NSUInteger index = [workingObjects indexOfObject:object];
+            NSUInteger toIndex = (index < anchorIndex) ? anchorIndex - 1 : anchorIndex;
+            if (index != toIndex) {
+                [workingObjects removeObjectAtIndex:index];
+                [workingObjects insertObject:object atIndex:toIndex];
+                [operations addObject:[PKListDiffOperation operationWithType:PKListDiffOperationMove object:object index:index toIndex:toIndex]];
+            }
+        }
+        anchor = object;
+    }
+    
+    return operations;
+}
+
++ (void)applyOperations:(NSArray *)operations toArray:(NSMutableArray *)array
+{
+    for (PKListDiffOperation *operation in operations) {
+        switch (operation.type) {
+            case PKListDiffOperationRemove:
+                [array removeObjectAtIndex:operation.index];
+                break;
+            case PKListDiffOperationInsert:
+                [array insertObject:operation.object atIndex:operation.index];
+                break;
+            case PKListDiffOperationMove: {
+                id object = array[operation.index];
+                [array removeObjectAtIndex:operation.index];
+                [array insertObject:object atIndex:operation.toIndex];
+                break;
+            }
+        }
+    }
+}
+
+@end
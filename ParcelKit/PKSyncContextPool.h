@@ -0,0 +1,79 @@
+//
+//  PKSyncContextPool.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+/**
+ A pool of private queue managed object contexts that are reused from one sync to the next.
+ 
+ Each context keeps the objects it last worked with registered, up to `hotObjectLimit`, so the next sync finds them
+ without fetching or faulting. Objects reported through `addUsedManagedObjects:inManagedObjectContext:` are kept first,
+ most recently used first, followed by the objects kept before. The saves of every managed object context connected directly to the persistent store
+ coordinator turn the changed objects of the pooled contexts back into faults, so they are read again when next used.
+ */
+@interface PKSyncContextPool : NSObject
+
+/** The persistent store coordinator of the pooled contexts. */
+@property (nonatomic, strong, readonly) NSPersistentStoreCoordinator *persistentStoreCoordinator;
+
+/**
+ The number of objects each pooled context keeps registered between uses.
+ 
+ The default value is “1000”.
+ */
+@property (nonatomic) NSUInteger hotObjectLimit;
+
+/**
+ The designated initializer.
+ @param persistentStoreCoordinator The persistent store coordinator the pooled contexts should be connected to.
+ @return A newly initialized `PKSyncContextPool` object.
+ */
+- (instancetype)initWithPersistentStoreCoordinator:(NSPersistentStoreCoordinator *)persistentStoreCoordinator;
+
+/**
+ Synchronously performs the block on the queue of an idle pooled context, a context is created when all are in use.
+ 
+ The context is not used by anything else until the block returns. It must not be reset directly, use
+ `resetManagedObjectContext:` instead.
+ @param block The block to perform, it is given the pooled context.
+ */
+- (void)performBlockAndWait:(void (^)(NSManagedObjectContext *managedObjectContext))block;
+
+/**
+ Reports objects used by the current use of a pooled context, so they are the first to be kept registered. Only called
+ from a block given to `performBlockAndWait:`.
+ @param managedObjects The objects used, in the order they were used.
+ @param managedObjectContext The pooled context the objects are registered in.
+ */
+- (void)addUsedManagedObjects:(NSArray *)managedObjects inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext;
+
+/**
+ Resets a pooled context and forgets its hot objects. Only called from a block given to `performBlockAndWait:`.
+ @param managedObjectContext The pooled context to reset.
+ */
+- (void)resetManagedObjectContext:(NSManagedObjectContext *)managedObjectContext;
+
+@end
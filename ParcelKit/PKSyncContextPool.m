@@ -0,0 +1,194 @@
+//
+//  PKSyncContextPool.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKSyncContextPool.h"
+
+@interface PKSyncContextPool ()
+@property (nonatomic, strong, readwrite) NSPersistentStoreCoordinator *persistentStoreCoordinator;
+@property (nonatomic, strong) NSMutableArray *managedObjectContexts;
+@property (nonatomic, strong) NSMutableArray *idleManagedObjectContexts;
+@property (nonatomic, strong) NSMapTable *hotObjectsKeyedByContext;
+@property (nonatomic, strong) NSMapTable *usedObjectsKeyedByContext;
+@end
+
+@implementation PKSyncContextPool
+
+- (instancetype)initWithPersistentStoreCoordinator:(NSPersistentStoreCoordinator *)persistentStoreCoordinator
+{
+    self = [super init];
+    if (self) {
+        _persistentStoreCoordinator = persistentStoreCoordinator;
+        _hotObjectLimit = 1000;
+        _managedObjectContexts = [[NSMutableArray alloc] init];
+        _idleManagedObjectContexts = [[NSMutableArray alloc] init];
+        _hotObjectsKeyedByContext = [NSMapTable strongToStrongObjectsMapTable];
+        _usedObjectsKeyedByContext = [NSMapTable strongToStrongObjectsMapTable];
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(managedObjectContextDidSave:) name:NSManagedObjectContextDidSaveNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)performBlockAndWait:(void (^)(NSManagedObjectContext *managedObjectContext))block
+{
+    NSManagedObjectContext *managedObjectContext = nil;
+    @synchronized(self) {
+        managedObjectContext = [self.idleManagedObjectContexts lastObject];
+        if (managedObjectContext) {
+            [self.idleManagedObjectContexts removeLastObject];
+        } else {
+            managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+            [managedObjectContext setPersistentStoreCoordinator:self.persistentStoreCoordinator];
+            [managedObjectContext setUndoManager:nil];
+            [self.managedObjectContexts addObject:managedObjectContext];
+        }
+    }
+    
+    [managedObjectContext performBlockAndWait:^{
+        // Every object of this use is kept until the hot objects are chosen from them
+        [managedObjectContext setRetainsRegisteredObjects:YES];
+        block(managedObjectContext);
+        [self keepHotObjectsOfManagedObjectContext:managedObjectContext];
+        [managedObjectContext setRetainsRegisteredObjects:NO];
+    }];
+    
+    @synchronized(self) {
+        [self.idleManagedObjectContexts addObject:managedObjectContext];
+    }
+}
+
+- (void)resetManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    [managedObjectContext reset];
+    @synchronized(self) {
+        [self.hotObjectsKeyedByContext removeObjectForKey:managedObjectContext];
+        [self.usedObjectsKeyedByContext removeObjectForKey:managedObjectContext];
+    }
+}
+
+- (void)addUsedManagedObjects:(NSArray *)managedObjects inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    if ([managedObjects count] == 0) return;
+    
+    @synchronized(self) {
+        if (![self.managedObjectContexts containsObject:managedObjectContext]) return;
+        
+        NSMutableOrderedSet *usedObjects = [self.usedObjectsKeyedByContext objectForKey:managedObjectContext];
+        if (!usedObjects) {
+            usedObjects = [[NSMutableOrderedSet alloc] init];
+            [self.usedObjectsKeyedByContext setObject:usedObjects forKey:managedObjectContext];
+        }
+        
+        // Objects used again move to the end, which is kept first
+        [usedObjects removeObjectsInArray:managedObjects];
+        [usedObjects addObjectsFromArray:managedObjects];
+    }
+}
+
+// Objects used by the last use come first, most recently used first, followed by the previous hot objects and then
+// any other registered objects. Only called on the queue of the context.
+- (void)keepHotObjectsOfManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    NSUInteger limit = self.hotObjectLimit;
+    NSOrderedSet *usedObjects = nil;
+    NSOrderedSet *previousHotObjects = nil;
+    @synchronized(self) {
+        usedObjects = [self.usedObjectsKeyedByContext objectForKey:managedObjectContext];
+        previousHotObjects = [self.hotObjectsKeyedByContext objectForKey:managedObjectContext];
+        [self.usedObjectsKeyedByContext removeObjectForKey:managedObjectContext];
+    }
+    
+    NSMutableOrderedSet *hotObjects = [[NSMutableOrderedSet alloc] init];
+    void (^keep)(id<NSFastEnumeration>) = ^(id<NSFastEnumeration> managedObjects) {
+        for (NSManagedObject *managedObject in managedObjects) {
+            if ([hotObjects count] >= limit) break;
+            if ([managedObject managedObjectContext] != managedObjectContext || [managedObject isDeleted]) continue;
+            [hotObjects addObject:managedObject];
+        }
+    };
+    keep([usedObjects reverseObjectEnumerator]);
+    keep(previousHotObjects);
+    keep([managedObjectContext registeredObjects]);
+    
+    @synchronized(self) {
+        [self.hotObjectsKeyedByContext setObject:hotObjects forKey:managedObjectContext];
+    }
+}
+
+- (void)managedObjectContextDidSave:(NSNotification *)notification
+{
+    NSManagedObjectContext *savedManagedObjectContext = notification.object;
+    if ([savedManagedObjectContext persistentStoreCoordinator] != self.persistentStoreCoordinator || [savedManagedObjectContext parentContext]) return;
+    
+    NSMutableSet *objectIDs = [[NSMutableSet alloc] init];
+    for (NSManagedObject *managedObject in [notification.userInfo objectForKey:NSUpdatedObjectsKey]) {
+        [objectIDs addObject:[managedObject objectID]];
+    }
+    NSMutableSet *deletedObjectIDs = [[NSMutableSet alloc] init];
+    for (NSManagedObject *managedObject in [notification.userInfo objectForKey:NSDeletedObjectsKey]) {
+        [objectIDs addObject:[managedObject objectID]];
+        [deletedObjectIDs addObject:[managedObject objectID]];
+    }
+    if ([objectIDs count] == 0) return;
+    
+    NSArray *managedObjectContexts = nil;
+    @synchronized(self) {
+        managedObjectContexts = [self.managedObjectContexts copy];
+    }
+    
+    // Changed objects are turned back into faults, which are filled from the row cache of the coordinator when used.
+    // Deleted objects are no longer kept.
+    __weak typeof(self) weakSelf = self;
+    for (NSManagedObjectContext *managedObjectContext in managedObjectContexts) {
+        if (managedObjectContext == savedManagedObjectContext) continue;
+        
+        [managedObjectContext performBlock:^{
+            for (NSManagedObjectID *objectID in objectIDs) {
+                NSManagedObject *managedObject = [managedObjectContext objectRegisteredForID:objectID];
+                if (managedObject) {
+                    [managedObjectContext refreshObject:managedObject mergeChanges:NO];
+                }
+            }
+            
+            typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+            @synchronized(strongSelf) {
+                NSMutableOrderedSet *hotObjects = [strongSelf.hotObjectsKeyedByContext objectForKey:managedObjectContext];
+                for (NSManagedObjectID *objectID in deletedObjectIDs) {
+                    NSManagedObject *managedObject = [managedObjectContext objectRegisteredForID:objectID];
+                    if (managedObject) {
+                        [hotObjects removeObject:managedObject];
+                    }
+                }
+            }
+        }];
+    }
+}
+
+@end
@@ -0,0 +1,141 @@
+//
+//  PKSyncIndex.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+/**
+ The sync index maps sync identifiers to Core Data managed object IDs for each entity so that managed objects
+ can be found without fetching on the sync attribute.
+ 
+ The index is filled lazily and kept current from the saves of every managed object context connected directly to
+ its persistent store coordinator. It can be snapshotted to disk so that it is warm on launch.
+ */
+@interface PKSyncIndex : NSObject
+
+/** The persistent store coordinator whose managed objects are indexed. */
+@property (nonatomic, strong, readonly) NSPersistentStoreCoordinator *persistentStoreCoordinator;
+
+/** The Core Data entity attribute name used for keeping managed objects in sync. */
+@property (nonatomic, copy, readonly) NSString *syncAttributeName;
+
+/**
+ The approximate number of bytes the index may use.
+ 
+ Identifiers are kept in two generations. When the current generation reaches half of the budget it replaces the
+ previous generation, so the least recently used identifiers are evicted first. Entities are only indexed in full
+ when all of their identifiers fit in half of the budget.
+ 
+ The default value is “8388608” (8 MiB, roughly 90,000 identifiers).
+ */
+@property (nonatomic) NSUInteger memoryBudget;
+
+/**
+ The file URL the index is snapshotted to.
+ 
+ Setting the URL reads any existing snapshot. Entries read from a snapshot are verified before they are used.
+ The default value is `nil`.
+ */
+@property (nonatomic, copy) NSURL *snapshotURL;
+
+/**
+ The designated initializer.
+ @param persistentStoreCoordinator The persistent store coordinator whose managed objects should be indexed.
+ @param syncAttributeName The Core Data entity attribute name used for keeping managed objects in sync.
+ @return A newly initialized `PKSyncIndex` object.
+ */
+- (instancetype)initWithPersistentStoreCoordinator:(NSPersistentStoreCoordinator *)persistentStoreCoordinator syncAttributeName:(NSString *)syncAttributeName;
+
+/** @name Accessing the Index */
+
+/**
+ Returns the managed objects of the given entity whose sync attribute matches one of the given sync identifiers.
+ 
+ Indexed identifiers are resolved without fetching on the sync attribute; only unknown identifiers are fetched.
+ @param syncIDs The sync identifiers to look up.
+ @param entityName The name of the entity the managed objects belong to.
+ @param managedObjectContext The managed object context the managed objects should be returned in.
+ @param returnsObjectsAsFaults `YES` if indexed managed objects may be returned as faults, `NO` if their property values should be fetched.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return A dictionary of managed objects keyed by their sync identifier, or nil if an error occurred.
+ */
+- (NSDictionary *)managedObjectsKeyedBySyncID:(NSArray *)syncIDs entityName:(NSString *)entityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext returnsObjectsAsFaults:(BOOL)returnsObjectsAsFaults error:(NSError **)error;
+
+/**
+ Returns the managed object ID indexed for the given sync identifier, or nil if the sync identifier is not indexed.
+ */
+- (NSManagedObjectID *)managedObjectIDForSyncID:(NSString *)syncID entityName:(NSString *)entityName;
+
+/**
+ Adds the given managed object ID to the index. Temporary managed object IDs are ignored.
+ */
+- (void)setManagedObjectID:(NSManagedObjectID *)managedObjectID forSyncID:(NSString *)syncID entityName:(NSString *)entityName;
+
+/**
+ Removes the given sync identifier from the index.
+ */
+- (void)removeManagedObjectIDForSyncID:(NSString *)syncID entityName:(NSString *)entityName;
+
+/**
+ Removes all sync identifiers from the index.
+ */
+- (void)removeAllManagedObjectIDs;
+
+/** @name Observing Changes */
+
+/**
+ Returns whether or not the index is currently observing managed object context saves.
+ 
+ Indexed identifiers are only trusted without verification while the index is observing.
+ */
+- (BOOL)isObserving;
+
+/**
+ Starts observing the saves of managed object contexts connected to the persistent store coordinator.
+ */
+- (void)startObserving;
+
+/**
+ Stops observing managed object context saves.
+ */
+- (void)stopObserving;
+
+/** @name Snapshots */
+
+/**
+ Writes the index to `snapshotURL`.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return `YES` if the snapshot was written, otherwise `NO`.
+ */
+- (BOOL)writeSnapshot:(NSError **)error;
+
+/**
+ Reads the index from `snapshotURL`. Snapshots taken from a different persistent store are ignored.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return `YES` if the snapshot was read, otherwise `NO`.
+ */
+- (BOOL)readSnapshot:(NSError **)error;
+
+@end
@@ -0,0 +1,540 @@
+//
+//  PKSyncIndex.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKSyncIndex.h"
+#import "PKConstants.h"
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKSyncMetrics.h"
+
+// Rough cost of one index entry: the dictionary slot, the key string and the managed object ID.
+static const NSUInteger PKSyncIndexEntryCost = 96;
+
+static NSString * const PKSyncIndexSnapshotStoreKey = @"store";
+static NSString * const PKSyncIndexSnapshotEntriesKey = @"entries";
+
+@interface PKSyncIndex ()
+@property (nonatomic, strong, readwrite) NSPersistentStoreCoordinator *persistentStoreCoordinator;
+@property (nonatomic, copy, readwrite) NSString *syncAttributeName;
+@property (nonatomic, strong) NSMutableDictionary *currentEntries;
+@property (nonatomic, strong) NSMutableDictionary *previousEntries;
+@property (nonatomic, strong) NSMutableSet *loadedEntityNames;
+@property (nonatomic, strong) NSMutableDictionary *pendingRemovals;
+@property (nonatomic) NSUInteger currentCost;
+@property (nonatomic) BOOL observing;
+@end
+
+@implementation PKSyncIndex
+
+- (instancetype)initWithPersistentStoreCoordinator:(NSPersistentStoreCoordinator *)persistentStoreCoordinator syncAttributeName:(NSString *)syncAttributeName
+{
+    self = [super init];
+    if (self) {
+        _persistentStoreCoordinator = persistentStoreCoordinator;
+        _syncAttributeName = [syncAttributeName copy];
+        _memoryBudget = 8 * 1024 * 1024;
+        _currentEntries = [[NSMutableDictionary alloc] init];
+        _previousEntries = [[NSMutableDictionary alloc] init];
+        _loadedEntityNames = [[NSMutableSet alloc] init];
+        _pendingRemovals = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)setSnapshotURL:(NSURL *)snapshotURL
+{
+    _snapshotURL = [snapshotURL copy];
+    
+    NSError *error = nil;
+    if (_snapshotURL && [[NSFileManager defaultManager] fileExistsAtPath:[_snapshotURL path]] && ![self readSnapshot:&error]) {
+        NSLog(@"Error reading sync index snapshot: %@", error);
+    }
+}
+
+#pragma mark - Entries
+// Entries are managed object IDs; entries read from a snapshot stay URI strings until they are looked up.
+- (NSManagedObjectID *)managedObjectIDForEntry:(id)entry
+{
+    if ([entry isKindOfClass:[NSManagedObjectID class]]) return entry;
+    
+    NSURL *URIRepresentation = [NSURL URLWithString:entry];
+    return URIRepresentation ? [self.persistentStoreCoordinator managedObjectIDForURIRepresentation:URIRepresentation] : nil;
+}
+
+- (NSMutableDictionary *)currentEntriesForEntityName:(NSString *)entityName
+{
+    NSMutableDictionary *entries = [self.currentEntries objectForKey:entityName];
+    if (!entries) {
+        entries = [[NSMutableDictionary alloc] init];
+        [self.currentEntries setObject:entries forKey:entityName];
+    }
+    return entries;
+}
+
+- (void)setEntry:(id)entry forSyncID:(NSString *)syncID entityName:(NSString *)entityName
+{
+    NSMutableDictionary *entries = [self currentEntriesForEntityName:entityName];
+    if (![entries objectForKey:syncID]) {
+        self.currentCost += [syncID length] + PKSyncIndexEntryCost;
+    }
+    [entries setObject:entry forKey:syncID];
+    [[self.previousEntries objectForKey:entityName] removeObjectForKey:syncID];
+    
+    if (self.currentCost > self.memoryBudget / 2) {
+        // The current generation becomes the previous one; anything not used since the last rotation is evicted
+        self.previousEntries = self.currentEntries;
+        self.currentEntries = [[NSMutableDictionary alloc] init];
+        self.currentCost = 0;
+    }
+}
+
+- (void)removeEntryForSyncID:(NSString *)syncID entityName:(NSString *)entityName
+{
+    NSMutableDictionary *entries = [self.currentEntries objectForKey:entityName];
+    if ([entries objectForKey:syncID]) {
+        [entries removeObjectForKey:syncID];
+        self.currentCost -= MIN(self.currentCost, [syncID length] + PKSyncIndexEntryCost);
+    }
+    [[self.previousEntries objectForKey:entityName] removeObjectForKey:syncID];
+}
+
+#pragma mark - Accessing the index
+- (NSManagedObjectID *)managedObjectIDForSyncID:(NSString *)syncID entityName:(NSString *)entityName
+{
+    @synchronized(self) {
+        id entry = [[self.currentEntries objectForKey:entityName] objectForKey:syncID] ?: [[self.previousEntries objectForKey:entityName] objectForKey:syncID];
+        return entry ? [self managedObjectIDForEntry:entry] : nil;
+    }
+}
+
+- (void)setManagedObjectID:(NSManagedObjectID *)managedObjectID forSyncID:(NSString *)syncID entityName:(NSString *)entityName
+{
+    if (!syncID || !entityName) return;
+    
+    if (!managedObjectID || [managedObjectID isTemporaryID]) return;
+    
+    @synchronized(self) {
+        [self setEntry:managedObjectID forSyncID:syncID entityName:entityName];
+    }
+}
+
+- (void)removeManagedObjectIDForSyncID:(NSString *)syncID entityName:(NSString *)entityName
+{
+    if (!syncID || !entityName) return;
+    
+    @synchronized(self) {
+        [self removeEntryForSyncID:syncID entityName:entityName];
+    }
+}
+
+- (void)removeAllManagedObjectIDs
+{
+    @synchronized(self) {
+        [self.currentEntries removeAllObjects];
+        [self.previousEntries removeAllObjects];
+        [self.loadedEntityNames removeAllObjects];
+        self.currentCost = 0;
+    }
+}
+
+- (NSDictionary *)managedObjectsKeyedBySyncID:(NSArray *)syncIDs entityName:(NSString *)entityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext returnsObjectsAsFaults:(BOOL)returnsObjectsAsFaults error:(NSError **)error
+{
+    NSMutableDictionary *managedObjects = [[NSMutableDictionary alloc] initWithCapacity:[syncIDs count]];
+    if ([syncIDs count] == 0) return managedObjects;
+    
+    if (![self loadEntityName:entityName inManagedObjectContext:managedObjectContext error:error]) return nil;
+    
+    NSMutableDictionary *trustedObjectIDs = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary *unverifiedObjectIDs = [[NSMutableDictionary alloc] init];
+    NSMutableArray *missingSyncIDs = [[NSMutableArray alloc] init];
+    
+    @synchronized(self) {
+        NSDictionary *currentEntries = [self.currentEntries objectForKey:entityName];
+        NSDictionary *previousEntries = [self.previousEntries objectForKey:entityName];
+        for (NSString *syncID in syncIDs) {
+            id entry = [currentEntries objectForKey:syncID];
+            NSMutableDictionary *objectIDs = trustedObjectIDs;
+            if (!entry) {
+                entry = [previousEntries objectForKey:syncID];
+                objectIDs = unverifiedObjectIDs;
+            }
+            
+            NSManagedObjectID *objectID = entry ? [self managedObjectIDForEntry:entry] : nil;
+            if (objectID) {
+                [objectIDs setObject:objectID forKey:syncID];
+            } else {
+                [missingSyncIDs addObject:syncID];
+            }
+        }
+    }
+    
+    // Identifiers in the current generation were recorded while observing, but rows deleted through another
+    // coordinator are not seen, so objects that are still faults are fetched before they are handed out
+    NSMutableDictionary *faultedSyncIDs = [[NSMutableDictionary alloc] init];
+    [trustedObjectIDs enumerateKeysAndObjectsUsingBlock:^(NSString *syncID, NSManagedObjectID *objectID, BOOL *stop) {
+        NSManagedObject *managedObject = [managedObjectContext objectWithID:objectID];
+        if ([managedObject isDeleted]) return;
+        
+        if ([managedObject isFault]) {
+            [faultedSyncIDs setObject:syncID forKey:objectID];
+        } else {
+            [managedObjects setObject:managedObject forKey:syncID];
+        }
+    }];
+    
+    if ([faultedSyncIDs count] > 0) {
+        NSArray *results = [self fetchManagedObjectsWithIDs:[faultedSyncIDs allKeys] entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:returnsObjectsAsFaults error:error];
+        if (!results) return nil;
+        
+        for (NSManagedObject *managedObject in results) {
+            NSString *syncID = [faultedSyncIDs objectForKey:[managedObject objectID]];
+            [managedObjects setObject:managedObject forKey:syncID];
+            [faultedSyncIDs removeObjectForKey:[managedObject objectID]];
+        }
+        
+        @synchronized(self) {
+            for (NSString *syncID in [faultedSyncIDs allValues]) {
+                [self removeEntryForSyncID:syncID entityName:entityName];
+                [missingSyncIDs addObject:syncID];
+            }
+        }
+    }
+    
+    // Identifiers from the previous generation or a snapshot are verified before they are used
+    if ([unverifiedObjectIDs count] > 0) {
+        NSArray *results = [self fetchManagedObjectsWithIDs:[unverifiedObjectIDs allValues] entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:NO error:error];
+        if (!results) return nil;
+        
+        NSMutableDictionary *verifiedObjects = [[NSMutableDictionary alloc] initWithCapacity:[results count]];
+        for (NSManagedObject *managedObject in results) {
+            [verifiedObjects setObject:managedObject forKey:[managedObject objectID]];
+        }
+        
+        @synchronized(self) {
+            [unverifiedObjectIDs enumerateKeysAndObjectsUsingBlock:^(NSString *syncID, NSManagedObjectID *objectID, BOOL *stop) {
+                NSManagedObject *managedObject = [verifiedObjects objectForKey:objectID];
+                if (managedObject && [[managedObject valueForKey:self.syncAttributeName] isEqualToString:syncID]) {
+                    [managedObjects setObject:managedObject forKey:syncID];
+                    [self setEntry:objectID forSyncID:syncID entityName:entityName];
+                } else {
+                    [self removeEntryForSyncID:syncID entityName:entityName];
+                    [missingSyncIDs addObject:syncID];
+                }
+            }];
+        }
+    }
+    
+    if ([missingSyncIDs count] == 0) return managedObjects;
+    
+    // Rows saved through another coordinator or an unobserved context are never indexed, so identifiers that are
+    // not indexed are always fetched
+    NSDictionary *fetchedObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:missingSyncIDs entityName:entityName syncAttributeName:self.syncAttributeName error:error];
+    if (!fetchedObjects) return nil;
+    
+    [managedObjects addEntriesFromDictionary:fetchedObjects];
+    @synchronized(self) {
+        [fetchedObjects enumerateKeysAndObjectsUsingBlock:^(NSString *syncID, NSManagedObject *managedObject, BOOL *stop) {
+            if (![[managedObject objectID] isTemporaryID]) {
+                [self setEntry:[managedObject objectID] forSyncID:syncID entityName:entityName];
+            }
+        }];
+    }
+    
+    return managedObjects;
+}
+
+- (NSArray *)fetchManagedObjectsWithIDs:(NSArray *)objectIDs entityName:(NSString *)entityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext returnsObjectsAsFaults:(BOOL)returnsObjectsAsFaults error:(NSError **)error
+{
+    NSUInteger count = [objectIDs count];
+    NSMutableArray *managedObjects = [[NSMutableArray alloc] initWithCapacity:count];
+    if (count == 0) return managedObjects;
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    [fetchRequest setReturnsObjectsAsFaults:returnsObjectsAsFaults];
+    
+    for (NSUInteger location = 0; location < count; location += PKSyncIDFetchBatchSize) {
+        NSRange range = NSMakeRange(location, MIN((NSUInteger)PKSyncIDFetchBatchSize, count - location));
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"SELF IN %@", [objectIDs subarrayWithRange:range]]];
+        
+        NSArray *results = [managedObjectContext executeFetchRequest:fetchRequest error:error];
+        [[managedObjectContext pk_syncMetrics] addFetches:1];
+        if (!results) return nil;
+        [managedObjects addObjectsFromArray:results];
+    }
+    
+    return managedObjects;
+}
+
+// The first lookup of an entity indexes all of its saved objects when they fit in the budget, so that later lookups
+// of existing objects are resolved without fetching on the sync attribute.
+- (BOOL)loadEntityName:(NSString *)entityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext error:(NSError **)error
+{
+    @synchronized(self) {
+        if (!self.observing || [self.loadedEntityNames containsObject:entityName]) return YES;
+        [self.loadedEntityNames addObject:entityName];
+    }
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
+    NSUInteger count = [managedObjectContext countForFetchRequest:fetchRequest error:error];
+    [[managedObjectContext pk_syncMetrics] addFetches:1];
+    if (count == NSNotFound) return NO;
+    @synchronized(self) {
+        if (self.currentCost + count * PKSyncIndexEntryCost > self.memoryBudget / 2) return YES;
+    }
+    
+    NSExpressionDescription *objectIDDescription = [[NSExpressionDescription alloc] init];
+    [objectIDDescription setName:@"objectID"];
+    [objectIDDescription setExpression:[NSExpression expressionForEvaluatedObject]];
+    [objectIDDescription setExpressionResultType:NSObjectIDAttributeType];
+    
+    [fetchRequest setResultType:NSDictionaryResultType];
+    [fetchRequest setPropertiesToFetch:@[self.syncAttributeName, objectIDDescription]];
+    
+    NSArray *results = [managedObjectContext executeFetchRequest:fetchRequest error:error];
+    [[managedObjectContext pk_syncMetrics] addFetches:1];
+    if (!results) return NO;
+    
+    @synchronized(self) {
+        // The identifiers are known now, so the load is only kept when all of it fits without a rotation
+        NSDictionary *currentEntries = [self.currentEntries objectForKey:entityName];
+        NSUInteger cost = self.currentCost;
+        for (NSDictionary *result in results) {
+            NSString *syncID = [result objectForKey:self.syncAttributeName];
+            if (syncID && ![currentEntries objectForKey:syncID]) {
+                cost += [syncID length] + PKSyncIndexEntryCost;
+            }
+        }
+        if (cost > self.memoryBudget / 2) return YES;
+        
+        for (NSDictionary *result in results) {
+            NSString *syncID = [result objectForKey:self.syncAttributeName];
+            if (syncID) {
+                [self setEntry:[result objectForKey:@"objectID"] forSyncID:syncID entityName:entityName];
+            }
+        }
+    }
+    
+    return YES;
+}
+
+#pragma mark - Observing methods
+- (BOOL)isObserving
+{
+    return self.observing;
+}
+
+- (void)startObserving
+{
+    if ([self isObserving]) return;
+    
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(managedObjectContextWillSave:) name:NSManagedObjectContextWillSaveNotification object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(managedObjectContextDidSave:) name:NSManagedObjectContextDidSaveNotification object:nil];
+    
+    @synchronized(self) {
+        self.observing = YES;
+    }
+}
+
+- (void)stopObserving
+{
+    if (![self isObserving]) return;
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextWillSaveNotification object:nil];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextDidSaveNotification object:nil];
+    
+    @synchronized(self) {
+        self.observing = NO;
+        
+        // Saves are no longer seen, so everything indexed so far has to be verified again
+        [self.currentEntries enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSDictionary *entries, BOOL *stop) {
+            NSMutableDictionary *previousEntries = [self.previousEntries objectForKey:entityName];
+            if (previousEntries) {
+                [previousEntries addEntriesFromDictionary:entries];
+            } else {
+                [self.previousEntries setObject:[entries mutableCopy] forKey:entityName];
+            }
+        }];
+        [self.currentEntries removeAllObjects];
+        [self.loadedEntityNames removeAllObjects];
+        [self.pendingRemovals removeAllObjects];
+        self.currentCost = 0;
+    }
+}
+
+- (BOOL)isObservingManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    return [managedObjectContext persistentStoreCoordinator] == self.persistentStoreCoordinator && ![managedObjectContext parentContext];
+}
+
+- (BOOL)managedObjectHasSyncAttribute:(NSManagedObject *)managedObject
+{
+    return [[[managedObject entity] attributesByName] objectForKey:self.syncAttributeName] != nil;
+}
+
+- (void)managedObjectContextWillSave:(NSNotification *)notification
+{
+    NSManagedObjectContext *managedObjectContext = notification.object;
+    if (![self isObservingManagedObjectContext:managedObjectContext]) return;
+    
+    // Identifiers that go away are collected now, while their committed values can still be read
+    NSMutableArray *removals = [[NSMutableArray alloc] init];
+    for (NSManagedObject *managedObject in [managedObjectContext deletedObjects]) {
+        if (![self managedObjectHasSyncAttribute:managedObject]) continue;
+        NSString *syncID = [[managedObject committedValuesForKeys:@[self.syncAttributeName]] objectForKey:self.syncAttributeName];
+        if ([syncID isKindOfClass:[NSString class]]) {
+            [removals addObject:@[[[managedObject entity] name], syncID]];
+        }
+    }
+    
+    for (NSManagedObject *managedObject in [managedObjectContext updatedObjects]) {
+        if (![self managedObjectHasSyncAttribute:managedObject] || ![[managedObject changedValues] objectForKey:self.syncAttributeName]) continue;
+        NSString *syncID = [[managedObject committedValuesForKeys:@[self.syncAttributeName]] objectForKey:self.syncAttributeName];
+        if ([syncID isKindOfClass:[NSString class]]) {
+            [removals addObject:@[[[managedObject entity] name], syncID]];
+        }
+    }
+    
+    @synchronized(self) {
+        [self.pendingRemovals setObject:removals forKey:[NSValue valueWithNonretainedObject:managedObjectContext]];
+    }
+}
+
+- (void)managedObjectContextDidSave:(NSNotification *)notification
+{
+    NSManagedObjectContext *managedObjectContext = notification.object;
+    if (![self isObservingManagedObjectContext:managedObjectContext]) return;
+    
+    NSMutableArray *additions = [[NSMutableArray alloc] init];
+    NSMutableSet *managedObjects = [[NSMutableSet alloc] init];
+    [managedObjects unionSet:[notification.userInfo objectForKey:NSInsertedObjectsKey]];
+    [managedObjects unionSet:[notification.userInfo objectForKey:NSUpdatedObjectsKey]];
+    for (NSManagedObject *managedObject in managedObjects) {
+        if (![self managedObjectHasSyncAttribute:managedObject]) continue;
+        NSString *syncID = [managedObject valueForKey:self.syncAttributeName];
+        if (syncID) {
+            [additions addObject:@[managedObject.objectID, syncID]];
+        }
+    }
+    
+    @synchronized(self) {
+        NSValue *key = [NSValue valueWithNonretainedObject:managedObjectContext];
+        for (NSArray *removal in [self.pendingRemovals objectForKey:key]) {
+            for (NSEntityDescription *entity = [[[self.persistentStoreCoordinator managedObjectModel] entitiesByName] objectForKey:removal[0]]; entity; entity = [entity superentity]) {
+                [self removeEntryForSyncID:removal[1] entityName:[entity name]];
+            }
+        }
+        [self.pendingRemovals removeObjectForKey:key];
+        
+        // Objects are indexed under their own entity and every parent entity so that lookups on either find them
+        for (NSArray *addition in additions) {
+            NSManagedObjectID *objectID = addition[0];
+            for (NSEntityDescription *entity = [objectID entity]; entity; entity = [entity superentity]) {
+                [self setEntry:objectID forSyncID:addition[1] entityName:[entity name]];
+            }
+        }
+    }
+}
+
+#pragma mark - Snapshots
+- (NSString *)storeIdentifier
+{
+    NSMutableArray *storeUUIDs = [[NSMutableArray alloc] init];
+    for (NSPersistentStore *persistentStore in [self.persistentStoreCoordinator persistentStores]) {
+        NSString *storeUUID = [[persistentStore metadata] objectForKey:NSStoreUUIDKey];
+        if (storeUUID) {
+            [storeUUIDs addObject:storeUUID];
+        }
+    }
+    return [[storeUUIDs sortedArrayUsingSelector:@selector(compare:)] componentsJoinedByString:@","];
+}
+
+- (BOOL)writeSnapshot:(NSError **)error
+{
+    NSMutableDictionary *entries = [[NSMutableDictionary alloc] init];
+    
+    @synchronized(self) {
+        // Managed object IDs are not property list objects, so their URI representations are written instead
+        for (NSDictionary *generation in @[self.previousEntries, self.currentEntries]) {
+            [generation enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSDictionary *generationEntries, BOOL *stop) {
+                NSMutableDictionary *entityEntries = [entries objectForKey:entityName];
+                if (!entityEntries) {
+                    entityEntries = [[NSMutableDictionary alloc] init];
+                    [entries setObject:entityEntries forKey:entityName];
+                }
+                [generationEntries enumerateKeysAndObjectsUsingBlock:^(NSString *syncID, id entry, BOOL *stop) {
+                    if ([entry isKindOfClass:[NSManagedObjectID class]]) {
+                        [entityEntries setObject:[[entry URIRepresentation] absoluteString] forKey:syncID];
+                    } else {
+                        [entityEntries setObject:entry forKey:syncID];
+                    }
+                }];
+            }];
+        }
+    }
+    
+    NSDictionary *snapshot = @{PKSyncIndexSnapshotStoreKey: [self storeIdentifier], PKSyncIndexSnapshotEntriesKey: entries};
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:snapshot format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (!data) return NO;
+    
+    return [data writeToURL:self.snapshotURL options:NSDataWritingAtomic error:error];
+}
+
+- (BOOL)readSnapshot:(NSError **)error
+{
+    NSData *data = [[NSData alloc] initWithContentsOfURL:self.snapshotURL options:NSDataReadingMappedIfSafe error:error];
+    if (!data) return NO;
+    
+    NSDictionary *snapshot = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:error];
+    if (![snapshot isKindOfClass:[NSDictionary class]]) return NO;
+    
+    if (![[snapshot objectForKey:PKSyncIndexSnapshotStoreKey] isEqualToString:[self storeIdentifier]]) {
+        NSLog(@"Ignoring sync index snapshot of a different persistent store");
+        return YES;
+    }
+    
+    @synchronized(self) {
+        [[snapshot objectForKey:PKSyncIndexSnapshotEntriesKey] enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSDictionary *entries, BOOL *stop) {
+            NSMutableDictionary *previousEntries = [self.previousEntries objectForKey:entityName];
+            if (!previousEntries) {
+                previousEntries = [[NSMutableDictionary alloc] initWithCapacity:[entries count]];
+                [self.previousEntries setObject:previousEntries forKey:entityName];
+            }
+            [entries enumerateKeysAndObjectsUsingBlock:^(NSString *syncID, id entry, BOOL *stop) {
+                // Snapshots written before entries were URI representations are skipped
+                if ([entry isKindOfClass:[NSString class]]) {
+                    [previousEntries setObject:entry forKey:syncID];
+                }
+            }];
+        }];
+    }
+    
+    return YES;
+}
+
+@end
@@ -27,6 +27,9 @@
 #import <CoreData/CoreData.h>
 #import <Dropbox/Dropbox.h>
 
+@class PKSyncIndex;
+@class PKSyncMetrics;
+
 @class PKSyncManager;
 
 @protocol PKSyncManagerDelegate <NSObject>
@@ -39,7 +42,8 @@ extern NSString * const PKDefaultSyncAttributeName;
 /**
  Notification that is posted when the DBDatastoreStatus changes.
  
- The userInfo of the notification will contain the DBDatastoreStatus in `PKSyncManagerDatastoreStatusKey`
+ The userInfo of the notification will contain the DBDatastoreStatus in `PKSyncManagerDatastoreStatusKey`.
+ Notifications are throttled to `maximumStatusNotificationsPerSecond`.
  */
 extern NSString * const PKSyncManagerDatastoreStatusDidChangeNotification;
 extern NSString * const PKSyncManagerDatastoreStatusKey;
@@ -60,6 +64,16 @@ extern NSString * const PKSyncManagerDatastoreIncomingChangesKey;
 extern NSString * const PKSyncManagerDatastoreLastSyncDateNotification;
 extern NSString * const PKSyncManagerDatastoreLastSyncDateKey;
 
+/**
+ Notification that is posted on the main queue when a sync session ends, once the changes it saved were merged.
+ 
+ A sync session is the work done for one sync of the DBDatastore or one save of the managed object context,
+ including every sync it takes. The userInfo of the notification will contain the `PKSyncMetrics` of the session
+ in `PKSyncManagerSyncMetricsKey`.
+ */
+extern NSString * const PKSyncManagerSyncMetricsNotification;
+extern NSString * const PKSyncManagerSyncMetricsKey;
+
 
 /** 
  The sync manager is responsible for listening to changes from a
@@ -69,6 +83,10 @@ extern NSString * const PKSyncManagerDatastoreLastSyncDateKey;
 
 /** 
  The Core Data managed object context to listen for changes from.
+ 
+ Incoming changes are merged into the context asynchronously on its queue, or on the main thread for contexts
+ with thread confinement, in batches spread over several run loop turns. Only objects the context has registered
+ are refreshed. Changes saved on the main thread are merged right away unless the context has a private queue.
  */
 @property (nonatomic, strong, readonly) NSManagedObjectContext *managedObjectContext;
 
@@ -89,10 +107,176 @@ extern NSString * const PKSyncManagerDatastoreLastSyncDateKey;
  The DBDatastore has a 2 MiB delta size limit so changes in the managed object context
  must be batched to remain below this limit.
  
+ Only used when `syncBatchByteLimit` is “0”.
+ 
  The default value is “20”. (2048 KiB max delta size / 100 KiB max record size)
 */
 @property (nonatomic) NSUInteger syncBatchSize;
 
+/**
+ The number of bytes of changes to sync with the DBDatastore at a time.
+ 
+ Before a managed object is written the size of its changes is estimated. When the estimate would take the
+ unsynced changes of the datastore past this limit, the datastore is synced first. Small records are then synced
+ in few round trips while large ones still stay below the 2 MiB delta size limit.
+ 
+ While it is “0” changes are batched by `syncBatchSize`. `PKSyncBatchByteLimit`, “1984 KiB”, leaves some headroom
+ below the delta size limit.
+ 
+ The default value is “0”.
+*/
+@property (nonatomic) NSUInteger syncBatchByteLimit;
+
+/**
+ The number of incoming records to apply to Core Data at a time.
+
+ Incoming changes are applied in a private managed object context. When a window size is set, the records are applied
+ in windows of this size and the context is saved and reset after each, so peak memory stays flat however many records
+ a sync brings in, as when a new device downloads a large datastore. Relationships to records of a later window are
+ set once every window has been saved.
+
+ The default value is “0”, applying all incoming changes of a sync at once.
+*/
+@property (nonatomic) NSUInteger incomingChangesWindowSize;
+
+/**
+ Whether incoming records of entities that have no managed objects yet are bootstrapped.
+ 
+ When a new device first syncs, its store has nothing to update, so looking up existing objects for every incoming
+ record is wasted work. Records of entities without objects are instead inserted straight away, in windows of
+ `incomingChangesWindowSize`, or `PKBootstrapBatchSize` without a window size, and their relationships are set in
+ one pass once every record has been inserted. Objects are validated, and the delegate told of failures, once their
+ relationships are set. Entities with a non-optional relationship are never bootstrapped, as their windows could not be
+ saved before the relationships are set. An entity is only checked until it has objects.
+ 
+ The default value is `NO`, looking up existing objects for every incoming record.
+*/
+@property (nonatomic) BOOL bootstrapsEmptyEntities;
+
+/**
+ Whether incoming changes of independent tables are applied concurrently.
+ 
+ Tables are independent when their entities are not related, directly or through a shared related entity. Each group
+ of related tables is applied in a private managed object context of its own on a concurrent queue and saved on its
+ own, so large syncs spanning several independent tables use more than one core. When enabled, the delegate may be
+ called from several of these queues at the same time and has to be thread safe.
+ 
+ The default value is `NO`, applying all tables in one context with delegate calls one at a time.
+*/
+@property (nonatomic) BOOL appliesIndependentTablesConcurrently;
+
+/**
+ Whether the sync manager collects `PKSyncMetrics` and posts `PKSyncManagerSyncMetricsNotification` after every sync
+ session.
+ 
+ The default value is `YES`.
+*/
+@property (nonatomic) BOOL collectsSyncMetrics;
+
+/**
+ The time to wait for further datastore status changes before syncing incoming changes.
+ 
+ Syncing happens on a serial queue owned by the sync manager. A burst of status changes with incoming changes is
+ collapsed into a single sync that runs once no status change came in for this long.
+ 
+ The default value is “0.1” seconds.
+*/
+@property (nonatomic) NSTimeInterval minimumSyncLatency;
+
+/**
+ The longest time a sync of incoming changes is put off by a burst of status changes, counted from the first one.
+ 
+ The default value is “1” second.
+*/
+@property (nonatomic) NSTimeInterval maximumSyncLatency;
+
+/**
+ The maximum number of `PKSyncManagerDatastoreStatusDidChangeNotification` notifications posted per second.
+ 
+ Status changes in between are collapsed, the notification that follows them carries the latest status.
+ Set to “0” to post a notification for every status change.
+ 
+ The default value is “10”.
+*/
+@property (nonatomic) NSUInteger maximumStatusNotificationsPerSecond;
+
+/**
+ The time saves of the managed object context are collected before their changes are written to the DBDatastore.
+ 
+ When set, saving the managed object context only records the sync identifiers of the changed objects in an outbox.
+ The outbox is written on the sync queue once per interval, reading back the latest saved state of each object, so
+ any number of saves of an object within the interval result in a single record write and a single sync. Records of
+ objects that no longer exist are deleted. Changes only reach the outbox through saves to the persistent store.
+ 
+ The default value is “0”, writing changes to the DBDatastore and syncing while the managed object context saves.
+*/
+@property (nonatomic) NSTimeInterval writeBehindInterval;
+
+/**
+ The file the outbox is kept in while the sync manager is not observing.
+ 
+ Changes left in the outbox when observing stops are written once it starts again. With a URL they are also written
+ to this file when observing stops and read back when the URL is set, so they survive the app quitting.
+ 
+ The default value is nil, keeping the outbox in memory only.
+*/
+@property (nonatomic, copy) NSURL *outboxURL;
+
+/**
+ The file the progress of `exportManagedObjectsWithProgressBlock:completionBlock:` is checkpointed to.
+ 
+ The checkpoint is written after every batch of exported objects and removed once the export finishes. An export
+ started with a checkpoint left by an earlier one that didn't finish, as when the app was killed, picks up after the
+ objects that were already exported.
+ 
+ The default value is nil, exporting every object from the start.
+*/
+@property (nonatomic, copy) NSURL *exportCheckpointURL;
+
+/**
+ The file the change sets of incoming syncs are recorded in.
+ 
+ When set, every non-empty change set returned by `-[DBDatastore sync:]` is appended to the file with
+ `PKChangeRecorder` before it is applied, along with the tables of the synced entities. The recording can be replayed
+ against a scratch store to reproduce and profile a device's exact sync workload without a Dropbox account.
+ 
+ The default value is nil, recording nothing.
+*/
+@property (nonatomic, copy) NSURL *changeRecordingURL;
+
+/**
+ The directory chunked binary data of incoming records is reassembled in.
+ 
+ Binary attributes too large for a single record are split into chunk records. When a directory is set, incoming chunks
+ are written straight into a file per attribute and the attribute is set to data memory mapped from that file, so large
+ attachments never have to be held in memory more than once. The file is unlinked as soon as it is mapped, so its space
+ is released with the data once the save has copied it into the store.
+ 
+ The default value is nil, reassembling binary data in memory.
+*/
+@property (nonatomic, copy) NSURL *binaryDataDirectoryURL;
+
+/**
+ The length from which binary and string values are compressed before they are stored in records.
+ 
+ Values are compressed with `PKCompressionCodecFast` and only kept compressed when that makes them smaller.
+ Attributes can choose their own codec in the Core Data model with a `PKCompressionUserInfoKey` user info entry,
+ which takes precedence. Compressed values are decoded transparently, but clients that don't know about
+ compression will see the encoded bytes, so only turn this on once every client does.
+ 
+ The default value is “0”, compressing only attributes that choose a codec.
+*/
+@property (nonatomic) NSUInteger compressionThresholdInBytes;
+
+/**
+ The index used to find managed objects by their sync identifier without fetching.
+ 
+ The index is created once the managed object context is connected to a persistent store coordinator and is kept
+ current while the sync manager is observing. Set its `snapshotURL` to keep it warm across launches; the snapshot
+ is written when the sync manager stops observing.
+*/
+@property (nonatomic, strong, readonly) PKSyncIndex *syncIndex;
+
 /**
  Delegate that can handle various edge cases in an app-specific manner.
 */
@@ -171,6 +355,41 @@ extern NSString * const PKSyncManagerDatastoreLastSyncDateKey;
  */
 - (NSString *)entityNameForTable:(NSString *)tableID;
 
+/** @name Syncing Changes */
+
+/**
+ Returns how many times the DBDatastore will be synced to write the pending changes of the managed object context
+ when it is next saved, including the sync that follows the last batch.
+ 
+ Must be called where the managed object context can be used.
+ @return The number of syncs the next save of the managed object context will take.
+ */
+- (NSUInteger)numberOfSyncBatchesForPendingChanges;
+
+/**
+ Writes the changes in the outbox to the DBDatastore right away instead of waiting for the `writeBehindInterval`.
+ 
+ Does nothing while the sync manager is not observing.
+ */
+- (void)flushOutbox;
+
+/**
+ Writes every existing managed object of the mapped entities to the DBDatastore.
+ 
+ Only changes saved while observing are synced otherwise, so objects that existed before their entity was mapped
+ don't reach the datastore until they change. Objects without a sync identifier are given one first. The objects are
+ then fetched in sync identifier order, `PKExportBatchSize` at a time as faults, written in syncs bounded like those of
+ saves and checkpointed to `exportCheckpointURL`. Each batch runs on its own turn of the sync queue, so incoming
+ changes keep being synced while an export runs.
+ 
+ Only one export runs at a time.
+ @param progressBlock Called on the main queue after every batch with the number of objects exported so far and the
+ number of objects to export, may be nil.
+ @param completionBlock Called on the main queue once the export is done, with `NO` when it failed and has to be
+ started again, may be nil.
+ */
+- (void)exportManagedObjectsWithProgressBlock:(void (^)(NSUInteger exportedCount, NSUInteger totalCount))progressBlock completionBlock:(void (^)(BOOL finished))completionBlock;
+
 /** @name Observing Changes */
 
 /**
@@ -193,6 +412,8 @@ extern NSString * const PKSyncManagerDatastoreLastSyncDateKey;
 
 /**
  Force a manual sync of the datastore
+ 
+ The sync runs on the sync queue like every other sync, so this waits for a sync in progress to finish first.
  */
 - (BOOL)syncDatastore;
 
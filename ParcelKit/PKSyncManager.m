@@ -26,6 +26,14 @@
 #import "PKSyncManager.h"
 #import "NSManagedObject+ParcelKit.h"
 #import "DBRecord+ParcelKit.h"
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKSyncIndex.h"
+#import "PKSyncContextPool.h"
+#import "PKSyncMetrics.h"
+#import "PKSyncTracer.h"
+#import "PKChangeRecorder.h"
+#import "PKEntitySyncPlan.h"
+#import "PKConstants.h"
 
 NSString * const PKDefaultSyncAttributeName = @"syncID";
 NSString * const PKSyncManagerDatastoreStatusDidChangeNotification = @"PKSyncManagerDatastoreStatusDidChange";
@@ -34,15 +42,160 @@ NSString * const PKSyncManagerDatastoreIncomingChangesNotification = @"PKSyncMan
 NSString * const PKSyncManagerDatastoreIncomingChangesKey = @"changes";
 NSString * const PKSyncManagerDatastoreLastSyncDateNotification = @"PKSyncManagerDatastoreLastSyncDateNotification";
 NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
+NSString * const PKSyncManagerSyncMetricsNotification = @"PKSyncManagerSyncMetricsNotification";
+NSString * const PKSyncManagerSyncMetricsKey = @"metrics";
+
+// Deleting a record adds a change without fields to the unsynced changes
+static const NSUInteger PKSyncManagerDeletedRecordSize = 200;
+
+// The number of saved objects merged into the managed object context at a time
+static const NSUInteger PKSyncManagerMergeBatchSize = 500;
+
+static char PKSyncManagerSyncQueueKey;
+
+// What writing a managed object to its record takes, read on the thread of its managed object context so that the
+// sync queue writes it without touching the managed object.
+@interface PKPendingWrite : NSObject
+@property (nonatomic, strong) PKEntitySyncPlan *syncPlan;
+@property (nonatomic, copy) NSString *syncID;
+@property (nonatomic, copy) NSDictionary *values;
+@property (nonatomic) BOOL changedValuesOnly;
+@end
+
+@implementation PKPendingWrite
+@end
 
 @interface PKSyncManager ()
 @property (nonatomic, strong) NSPersistentStoreCoordinator *persistentStoreCoordinator;
 @property (nonatomic, strong, readwrite) NSManagedObjectContext *managedObjectContext;
 @property (nonatomic, strong, readwrite) DBDatastore *datastore;
 @property (nonatomic, strong) NSMutableDictionary *tablesKeyedByEntityName;
+@property (nonatomic, strong) NSMutableDictionary *entityNamesKeyedByTable;
+@property (nonatomic, strong) NSMutableDictionary *syncPlansKeyedByEntityName;
+@property (nonatomic, strong) NSMutableDictionary *subentitySyncPlansKeyedByEntityName;
+@property (nonatomic, strong, readwrite) PKSyncIndex *syncIndex;
 @property (nonatomic) BOOL observing;
+
+// Sync work is serialized on the sync queue, the pending sync and status notification are only accessed on it
+@property (nonatomic, strong) dispatch_queue_t syncQueue;
+@property (nonatomic, strong) NSDate *pendingSyncDate;
+@property (nonatomic, strong) NSDate *pendingSyncDeadline;
+@property (nonatomic, strong) DBDatastoreStatus *pendingStatus;
+@property (nonatomic, strong) NSDate *lastStatusNotificationDate;
+@property (nonatomic, strong) NSMutableDictionary *outbox;
+@property (nonatomic) BOOL outboxWriteScheduled;
+@property (nonatomic) BOOL exporting;
+@property (nonatomic, strong) NSMutableSet *seededEntityNames;
+
+// The changes of a save of the managed object context, read before the save and handed to the sync queue once it went
+// through. Only accessed on the thread of the managed object context.
+@property (nonatomic, strong) NSArray *savePendingWrites;
+@property (nonatomic, strong) NSDictionary *saveDeletedSyncIDs;
+
+// The metrics of the running sync session, read from the concurrent queues incoming changes are applied on
+@property (strong) PKSyncMetrics *syncMetrics;
+@property (nonatomic, strong) PKSyncContextPool *contextPool;
+@property (nonatomic, strong) PKChangeRecorder *changeRecorder;
 @end
 
+// Returns the object IDs of a save keyed by NSInsertedObjectsKey, NSUpdatedObjectsKey and NSDeletedObjectsKey,
+// split into batches of at most the given number of object IDs.
+static NSArray *PKObjectIDBatchesWithSaveNotification(NSNotification *notification, NSUInteger batchSize)
+{
+    NSMutableArray *batches = [[NSMutableArray alloc] init];
+    NSMutableDictionary *batch = [[NSMutableDictionary alloc] init];
+    NSUInteger batchCount = 0;
+    for (NSString *key in @[NSDeletedObjectsKey, NSUpdatedObjectsKey, NSInsertedObjectsKey]) {
+        NSMutableArray *objectIDs = nil;
+        for (NSManagedObject *managedObject in [[notification userInfo] objectForKey:key]) {
+            if (batchCount == batchSize) {
+                [batches addObject:batch];
+                batch = [[NSMutableDictionary alloc] init];
+                batchCount = 0;
+                objectIDs = nil;
+            }
+            if (!objectIDs) {
+                objectIDs = [[NSMutableArray alloc] init];
+                [batch setObject:objectIDs forKey:key];
+            }
+            [objectIDs addObject:[managedObject objectID]];
+            batchCount++;
+        }
+    }
+    if (batchCount > 0) {
+        [batches addObject:batch];
+    }
+    
+    return batches;
+}
+
+// Calls the block with windows of at most the given number of records, keyed by table like the changes themselves.
+static void PKEnumerateWindowsOfChanges(NSDictionary *changes, NSUInteger windowSize, void (^block)(NSDictionary *window))
+{
+    __block NSMutableDictionary *window = [[NSMutableDictionary alloc] init];
+    __block NSUInteger windowCount = 0;
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
+        NSUInteger count = [records count];
+        NSUInteger location = 0;
+        while (location < count) {
+            NSUInteger length = MIN(windowSize - windowCount, count - location);
+            [window setObject:[records subarrayWithRange:NSMakeRange(location, length)] forKey:tableID];
+            location += length;
+            windowCount += length;
+            
+            if (windowCount == windowSize) {
+                @autoreleasepool {
+                    block(window);
+                }
+                window = [[NSMutableDictionary alloc] init];
+                windowCount = 0;
+            }
+        }
+    }];
+    
+    if (windowCount > 0) {
+        @autoreleasepool {
+            block(window);
+        }
+    }
+}
+
+static NSString *PKRootEntityName(NSDictionary *parents, NSString *entityName)
+{
+    NSString *parent = nil;
+    while ((parent = [parents objectForKey:entityName])) {
+        entityName = parent;
+    }
+    return entityName;
+}
+
+static void PKUnionEntityNames(NSMutableDictionary *parents, NSString *entityName, NSString *otherEntityName)
+{
+    NSString *root = PKRootEntityName(parents, entityName);
+    NSString *otherRoot = PKRootEntityName(parents, otherEntityName);
+    if (![root isEqualToString:otherRoot]) {
+        [parents setObject:otherRoot forKey:root];
+    }
+}
+
+static void PKAddUnresolvedRecord(NSMutableDictionary *unresolvedRecords, NSString *tableID, DBRecord *record)
+{
+    NSMutableArray *records = [unresolvedRecords objectForKey:tableID];
+    if (!records) {
+        records = [[NSMutableArray alloc] init];
+        [unresolvedRecords setObject:records forKey:tableID];
+    }
+    [records addObject:record];
+}
+
+static BOOL PKEntityHasRequiredRelationship(NSEntityDescription *entity)
+{
+    for (NSRelationshipDescription *relationship in [[entity relationshipsByName] allValues]) {
+        if (![relationship isOptional]) return YES;
+    }
+    return NO;
+}
+
 @implementation PKSyncManager
 
 + (NSString *)syncID
@@ -57,8 +210,23 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
     self = [super init];
     if (self) {
         _tablesKeyedByEntityName = [[NSMutableDictionary alloc] init];
+        _entityNamesKeyedByTable = [[NSMutableDictionary alloc] init];
+        _syncPlansKeyedByEntityName = [[NSMutableDictionary alloc] init];
+        _subentitySyncPlansKeyedByEntityName = [[NSMutableDictionary alloc] init];
         _syncAttributeName = PKDefaultSyncAttributeName;
         _syncBatchSize = 20;
+        _syncBatchByteLimit = 0;
+        _minimumSyncLatency = 0.1;
+        _maximumSyncLatency = 1.0;
+        _maximumStatusNotificationsPerSecond = 10;
+        _bootstrapsEmptyEntities = NO;
+        _appliesIndependentTablesConcurrently = NO;
+        _collectsSyncMetrics = YES;
+        _seededEntityNames = [[NSMutableSet alloc] init];
+        
+        _outbox = [[NSMutableDictionary alloc] init];
+        _syncQueue = dispatch_queue_create("ParcelKit.PKSyncManager.sync", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_syncQueue, &PKSyncManagerSyncQueueKey, (__bridge void *)_syncQueue, NULL);
     }
     return self;
 }
@@ -88,6 +256,86 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
     return _persistentStoreCoordinator;
 }
 
+- (void)setSyncAttributeName:(NSString *)syncAttributeName
+{
+    if ([_syncAttributeName isEqualToString:syncAttributeName]) return;
+    _syncAttributeName = [syncAttributeName copy];
+    
+    [_syncIndex stopObserving];
+    _syncIndex = nil;
+    if ([self isObserving]) {
+        [self.syncIndex startObserving];
+    }
+    
+    // Sync plans depend on the sync attribute
+    [self.tablesKeyedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSString *tableID, BOOL *stop) {
+        NSEntityDescription *entity = [NSEntityDescription entityForName:entityName inManagedObjectContext:self.managedObjectContext];
+        [self.syncPlansKeyedByEntityName setObject:[self newSyncPlanForEntity:entity tableID:tableID] forKey:entityName];
+    }];
+    [self removeSubentitySyncPlans];
+}
+
+- (void)setBinaryDataDirectoryURL:(NSURL *)binaryDataDirectoryURL
+{
+    _binaryDataDirectoryURL = [binaryDataDirectoryURL copy];
+    for (PKEntitySyncPlan *syncPlan in [self.syncPlansKeyedByEntityName allValues]) {
+        syncPlan.binaryDataDirectoryURL = _binaryDataDirectoryURL;
+    }
+    [self removeSubentitySyncPlans];
+}
+
+- (void)setCompressionThresholdInBytes:(NSUInteger)compressionThresholdInBytes
+{
+    _compressionThresholdInBytes = compressionThresholdInBytes;
+    for (PKEntitySyncPlan *syncPlan in [self.syncPlansKeyedByEntityName allValues]) {
+        syncPlan.compressionThresholdInBytes = compressionThresholdInBytes;
+    }
+    [self removeSubentitySyncPlans];
+}
+
+- (void)setOutboxURL:(NSURL *)outboxURL
+{
+    _outboxURL = [outboxURL copy];
+    if (!_outboxURL || ![[NSFileManager defaultManager] fileExistsAtPath:[_outboxURL path]]) return;
+    
+    [self performBlockOnSyncQueue:^{
+        NSError *error = nil;
+        if (![self readOutbox:&error]) {
+            NSLog(@"Error reading outbox: %@", error);
+        }
+    }];
+}
+
+// The pooled contexts incoming changes are applied in, created on first use on the sync queue. Tables applied
+// concurrently are handed the pool instead of calling this.
+- (PKSyncContextPool *)contextPool
+{
+    if (!_contextPool && self.persistentStoreCoordinator) {
+        _contextPool = [[PKSyncContextPool alloc] initWithPersistentStoreCoordinator:self.persistentStoreCoordinator];
+    }
+    return _contextPool;
+}
+
+- (PKSyncIndex *)syncIndex
+{
+    NSPersistentStoreCoordinator *persistentStoreCoordinator = self.persistentStoreCoordinator;
+    if (_syncIndex && _syncIndex.persistentStoreCoordinator == persistentStoreCoordinator) return _syncIndex;
+    
+    // The coordinator can change while not observing, an index of the previous one is replaced keeping its settings
+    PKSyncIndex *previousSyncIndex = _syncIndex;
+    [previousSyncIndex stopObserving];
+    _syncIndex = nil;
+    if (persistentStoreCoordinator) {
+        _syncIndex = [[PKSyncIndex alloc] initWithPersistentStoreCoordinator:persistentStoreCoordinator syncAttributeName:self.syncAttributeName];
+        if (previousSyncIndex) {
+            _syncIndex.memoryBudget = previousSyncIndex.memoryBudget;
+            _syncIndex.snapshotURL = previousSyncIndex.snapshotURL;
+        }
+    }
+    
+    return _syncIndex;
+}
+
 #pragma mark - Entity and Table map
 - (void)setTablesForEntityNamesWithDictionary:(NSDictionary *)keyedTables
 {
@@ -107,12 +355,22 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
     NSEntityDescription *entity = [NSEntityDescription entityForName:entityName inManagedObjectContext:self.managedObjectContext];
     NSAttributeDescription *attributeDescription = [[entity attributesByName] objectForKey:self.syncAttributeName];
     NSAssert([attributeDescription attributeType] == NSStringAttributeType, @"Entity “%@” must contain a string attribute named “%@”", entityName, self.syncAttributeName);
+    [self removeTableForEntityName:entityName];
     [self.tablesKeyedByEntityName setObject:tableID forKey:entityName];
+    [self.entityNamesKeyedByTable setObject:entityName forKey:tableID];
+    [self.syncPlansKeyedByEntityName setObject:[self newSyncPlanForEntity:entity tableID:tableID] forKey:entityName];
+    [self removeSubentitySyncPlans];
 }
 
 - (void)removeTableForEntityName:(NSString *)entityName
 {
+    NSString *tableID = [self.tablesKeyedByEntityName objectForKey:entityName];
+    if (tableID && [[self.entityNamesKeyedByTable objectForKey:tableID] isEqualToString:entityName]) {
+        [self.entityNamesKeyedByTable removeObjectForKey:tableID];
+    }
     [self.tablesKeyedByEntityName removeObjectForKey:entityName];
+    [self.syncPlansKeyedByEntityName removeObjectForKey:entityName];
+    [self removeSubentitySyncPlans];
 }
 
 - (NSDictionary *)tablesByEntityName
@@ -137,7 +395,38 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
 
 - (NSString *)entityNameForTable:(NSString *)tableID
 {
-    return [[self.tablesKeyedByEntityName allKeysForObject:tableID] lastObject];
+    return [self.entityNamesKeyedByTable objectForKey:tableID];
+}
+
+- (PKEntitySyncPlan *)newSyncPlanForEntity:(NSEntityDescription *)entity tableID:(NSString *)tableID
+{
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:entity tableID:tableID syncAttributeName:self.syncAttributeName];
+    syncPlan.binaryDataDirectoryURL = self.binaryDataDirectoryURL;
+    syncPlan.compressionThresholdInBytes = self.compressionThresholdInBytes;
+    return syncPlan;
+}
+
+- (PKEntitySyncPlan *)syncPlanForEntity:(NSEntityDescription *)entity
+{
+    PKEntitySyncPlan *syncPlan = [self.syncPlansKeyedByEntityName objectForKey:[entity name]];
+    if (syncPlan) return syncPlan;
+    
+    // Unmapped sub-entities of a mapped entity get a plan of their own, built on first use
+    @synchronized(self.subentitySyncPlansKeyedByEntityName) {
+        syncPlan = [self.subentitySyncPlansKeyedByEntityName objectForKey:[entity name]];
+        if (!syncPlan) {
+            syncPlan = [self newSyncPlanForEntity:entity tableID:nil];
+            [self.subentitySyncPlansKeyedByEntityName setObject:syncPlan forKey:[entity name]];
+        }
+    }
+    return syncPlan;
+}
+
+- (void)removeSubentitySyncPlans
+{
+    @synchronized(self.subentitySyncPlansKeyedByEntityName) {
+        [self.subentitySyncPlansKeyedByEntityName removeAllObjects];
+    }
 }
 
 
@@ -158,16 +447,22 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
         if (![strongSelf isObserving]) return;
         
         DBDatastoreStatus *status = strongSelf.datastore.status;
-        if (status.incoming) {
-            [strongSelf syncDatastore];
-        }
-        
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [[NSNotificationCenter defaultCenter] postNotificationName:PKSyncManagerDatastoreStatusDidChangeNotification object:strongSelf userInfo:@{PKSyncManagerDatastoreStatusKey:status}];
+        dispatch_async(strongSelf.syncQueue, ^{
+            if (status.incoming) {
+                [strongSelf scheduleSync];
+            }
+            [strongSelf scheduleStatusNotificationWithStatus:status];
         });
     }];
     
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(managedObjectContextWillSave:) name:NSManagedObjectContextWillSaveNotification object:self.managedObjectContext];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(managedObjectContextDidSave:) name:NSManagedObjectContextDidSaveNotification object:self.managedObjectContext];
+    [self.syncIndex startObserving];
+    
+    // Changes left in the outbox when observing stopped are written now
+    dispatch_async(self.syncQueue, ^{
+        [weakSelf scheduleOutboxWrite];
+    });
 }
 
 - (void)stopObserving
@@ -178,192 +473,1243 @@ NSString * const PKSyncManagerDatastoreLastSyncDateKey = @"lastSyncDate";
     
     [self.datastore removeObserver:self];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextWillSaveNotification object:self.managedObjectContext];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextDidSaveNotification object:self.managedObjectContext];
+    
+    [self.syncIndex stopObserving];
+    NSError *error = nil;
+    if (self.syncIndex.snapshotURL && ![self.syncIndex writeSnapshot:&error]) {
+        NSLog(@"Error writing sync index snapshot: %@", error);
+    }
+    
+    // The outbox is kept until observing starts again, and across launches when it has a URL.
+    // Pooled contexts are let go as the persistent store coordinator may change, the sync index is rebuilt when it does.
+    [self performBlockOnSyncQueue:^{
+        self.contextPool = nil;
+        
+        NSError *error = nil;
+        if (self.outboxURL && ![self writeOutboxToURL:&error]) {
+            NSLog(@"Error writing outbox: %@", error);
+        }
+    }];
 }
 
-#pragma mark - Updating Core Data
-- (BOOL)updateCoreDataWithDatastoreChanges:(NSDictionary *)changes
+#pragma mark - Sync queue
+- (void)performBlockOnSyncQueue:(void (^)(void))block
 {
-    static NSString * const PKUpdateManagedObjectKey = @"object";
-    static NSString * const PKUpdateRecordKey = @"record";
+    if (dispatch_get_specific(&PKSyncManagerSyncQueueKey) == (__bridge void *)self.syncQueue) {
+        block();
+    } else {
+        dispatch_sync(self.syncQueue, block);
+    }
+}
+
+// Collapses a burst of incoming statuses into one sync. The sync waits until no status came in for the minimum
+// latency, but no longer than the maximum latency after the first status of the burst. Only called on the sync queue.
+- (void)scheduleSync
+{
+    NSDate *now = [NSDate date];
+    BOOL pending = (self.pendingSyncDate != nil);
+    if (!pending) {
+        self.pendingSyncDeadline = [now dateByAddingTimeInterval:MAX(self.maximumSyncLatency, self.minimumSyncLatency)];
+    }
+    self.pendingSyncDate = [[now dateByAddingTimeInterval:self.minimumSyncLatency] earlierDate:self.pendingSyncDeadline];
     
-    if ([changes count] == 0) return NO;
+    if (!pending) {
+        [self performPendingSync];
+    }
+}
+
+- (void)performPendingSync
+{
+    if (!self.pendingSyncDate) return;
     
-    NSManagedObjectContext *managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
-    [managedObjectContext setPersistentStoreCoordinator:self.persistentStoreCoordinator];
-    [managedObjectContext setUndoManager:nil];
+    NSTimeInterval delay = [self.pendingSyncDate timeIntervalSinceNow];
+    if (delay > 0) {
+        __weak typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.syncQueue, ^{
+            [weakSelf performPendingSync];
+        });
+        return;
+    }
+    
+    self.pendingSyncDate = nil;
+    self.pendingSyncDeadline = nil;
+    if ([self isObserving]) {
+        [self syncDatastoreOnSyncQueue];
+    }
+}
 
-    __weak typeof(self) weakSelf = self;
-    [managedObjectContext performBlockAndWait:^{
-        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
-        
-        __block NSMutableArray *updates = [[NSMutableArray alloc] init];
-        
-        typeof(self) weakSelf = strongSelf;
-        [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
-            typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
-            NSString *entityName = [strongSelf entityNameForTable:tableID];
-            if (!entityName) return;
-            
-            NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:entityName];
-            [fetchRequest setFetchLimit:1];
-            
-            for (DBRecord *record in records) {
-                [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K == %@", strongSelf.syncAttributeName, record.recordId]];
-                
-                NSError *error = nil;
-                NSArray *managedObjects = [managedObjectContext executeFetchRequest:fetchRequest error:&error];
-                if (managedObjects)  {
-                    NSManagedObject *managedObject = [managedObjects lastObject];
-                    
-                    if ([record isDeleted]) {
-                        if (managedObject) {
-                            [managedObjectContext deleteObject:managedObject];
-                        }
-                    } else {
-                        if (!managedObject) {
-                            managedObject = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:managedObjectContext];
-                            [managedObject setValue:record.recordId forKey:strongSelf.syncAttributeName];
-                        }
-                        
-                        [updates addObject:@{PKUpdateManagedObjectKey: managedObject, PKUpdateRecordKey: record}];
-                    }
-                } else {
-                    NSLog(@"Error executing fetch request: %@", error);
-                }
-            }
-        }];
-        
-        
-        for (NSDictionary *update in updates) {
-            NSManagedObject *managedObject = update[PKUpdateManagedObjectKey];
-            DBRecord *record = update[PKUpdateRecordKey];
-            [managedObject pk_setPropertiesWithRecord:record syncAttributeName:strongSelf.syncAttributeName];
-            
-            if (managedObject.isInserted) {
-                // Validate this object quickly
-                NSError *error = nil;
-                if (![managedObject validateForInsert:&error]) {
-                    if ((self.delegate != nil) && ([self.delegate respondsToSelector:@selector(syncManager:managedObject:insertValidationFailed:inManagedObjectContext:)])) {
-                        
-                        // Call the delegate method to respond to this validation error
-                        [self.delegate syncManager:self managedObject:managedObject insertValidationFailed:error inManagedObjectContext:managedObjectContext];
-                    }
-                }
-            }
-        }
-        
-        if ([managedObjectContext hasChanges]) {
-            [[NSNotificationCenter defaultCenter] addObserver:strongSelf selector:@selector(syncManagedObjectContextDidSave:) name:NSManagedObjectContextDidSaveNotification object:managedObjectContext];
-            NSError *error = nil;
-            if (![managedObjectContext save:&error]) {
-                NSLog(@"Error saving managed object context: %@", error);
-            }
-            [[NSNotificationCenter defaultCenter] removeObserver:strongSelf name:NSManagedObjectContextDidSaveNotification object:managedObjectContext];
+// Posts at most `maximumStatusNotificationsPerSecond` status notifications, statuses in between are collapsed
+// into the latest one. Only called on the sync queue.
+- (void)scheduleStatusNotificationWithStatus:(DBDatastoreStatus *)status
+{
+    BOOL pending = (self.pendingStatus != nil);
+    self.pendingStatus = status;
+    
+    if (!pending) {
+        [self postPendingStatusNotification];
+    }
+}
+
+- (void)postPendingStatusNotification
+{
+    DBDatastoreStatus *status = self.pendingStatus;
+    if (!status) return;
+    
+    NSUInteger notificationsPerSecond = self.maximumStatusNotificationsPerSecond;
+    if (notificationsPerSecond > 0 && self.lastStatusNotificationDate) {
+        NSTimeInterval delay = (1.0 / notificationsPerSecond) + [self.lastStatusNotificationDate timeIntervalSinceNow];
+        if (delay > 0) {
+            __weak typeof(self) weakSelf = self;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.syncQueue, ^{
+                [weakSelf postPendingStatusNotification];
+            });
+            return;
         }
-    }];
+    }
     
-    return YES;
+    self.pendingStatus = nil;
+    self.lastStatusNotificationDate = [NSDate date];
+    [self postNotificationOnMainQueueWithName:PKSyncManagerDatastoreStatusDidChangeNotification userInfo:@{PKSyncManagerDatastoreStatusKey: status}];
 }
 
-- (void)syncManagedObjectContextDidSave:(NSNotification *)notification
+- (void)postNotificationOnMainQueueWithName:(NSString *)name userInfo:(NSDictionary *)userInfo
 {
     if ([NSThread isMainThread]) {
-        [self.managedObjectContext mergeChangesFromContextDidSaveNotification:notification];
+        [[NSNotificationCenter defaultCenter] postNotificationName:name object:self userInfo:userInfo];
     } else {
-        [self performSelectorOnMainThread:@selector(syncManagedObjectContextDidSave:) withObject:notification waitUntilDone:YES];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:name object:self userInfo:userInfo];
+        });
     }
 }
 
-#pragma mark - Updating Datastore
-- (void)managedObjectContextWillSave:(NSNotification *)notification
+#pragma mark - Sync metrics
+// Starts a sync session unless one is running already, in which case the work is counted in that session.
+// Returns whether a session was started, it must then be ended by the caller.
+- (BOOL)beginSyncMetricsSession
 {
-    if (![self isObserving]) return;
+    if (!self.collectsSyncMetrics) return NO;
     
-    NSManagedObjectContext *managedObjectContext = notification.object;
-    if (self.managedObjectContext != managedObjectContext) return;
+    @synchronized(self) {
+        if (self.syncMetrics) return NO;
+        self.syncMetrics = [[PKSyncMetrics alloc] init];
+        return YES;
+    }
+}
+
+- (void)endSyncMetricsSession
+{
+    PKSyncMetrics *metrics = nil;
+    @synchronized(self) {
+        metrics = self.syncMetrics;
+        self.syncMetrics = nil;
+    }
+    if (!metrics) return;
+    [metrics finish];
     
-    NSSet *deletedObjects = [managedObjectContext deletedObjects];
-    for (NSManagedObject *managedObject in [self syncableManagedObjectsFromManagedObjects:deletedObjects]) {
-        NSString *tableID = [self tableForEntityName:[[managedObject entity] name]];
-        DBTable *table = [self.datastore getTable:tableID];
-        DBError *error = nil;
-        DBRecord *record = [table getRecord:[managedObject primitiveValueForKey:self.syncAttributeName] error:&error];
-        if (record) {
-            [record deleteRecord];
-        }
+    // Posted after the merges of the session were performed, so their time is part of the metrics
+    NSDictionary *userInfo = @{PKSyncManagerSyncMetricsKey: metrics};
+    __weak typeof(self) weakSelf = self;
+    void (^post)(void) = ^{
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        [[NSNotificationCenter defaultCenter] postNotificationName:PKSyncManagerSyncMetricsNotification object:strongSelf userInfo:userInfo];
     };
     
-    NSMutableSet *managedObjects = [[NSMutableSet alloc] init];
-    [managedObjects unionSet:[managedObjectContext insertedObjects]];
-    [managedObjects unionSet:[managedObjectContext updatedObjects]];
-    
-    NSUInteger index = 0;
-    for (NSManagedObject *managedObject in [self syncableManagedObjectsFromManagedObjects:managedObjects]) {
-        [self updateDatastoreWithManagedObject:managedObject];
-        index++;
-
-        if (index % self.syncBatchSize == 0) {
-            [self syncDatastore];
-        }
+    NSManagedObjectContext *managedObjectContext = self.managedObjectContext;
+    if ([managedObjectContext concurrencyType] == NSPrivateQueueConcurrencyType) {
+        [managedObjectContext performBlock:^{
+            dispatch_async(dispatch_get_main_queue(), post);
+        }];
+    } else {
+        dispatch_async(dispatch_get_main_queue(), post);
     }
-
-    [self syncDatastore];
 }
 
-- (void)updateDatastoreWithManagedObject:(NSManagedObject *)managedObject
+#pragma mark - Updating Core Data
+- (BOOL)updateCoreDataWithDatastoreChanges:(NSDictionary *)changes
 {
-    NSString *tableID = [self tableForEntityName:[[managedObject entity] name]];
-    if (!tableID) return;
+    if ([changes count] == 0) return NO;
     
-    DBTable *table = [self.datastore getTable:tableID];
-    DBError *error = nil;
-    DBRecord *record = [table getOrInsertRecord:[managedObject valueForKey:self.syncAttributeName] fields:nil inserted:NULL error:&error];
-    if (record) {
-        [record pk_setFieldsWithManagedObject:managedObject syncAttributeName:self.syncAttributeName];
+    PKSyncMetrics *metrics = self.syncMetrics;
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
+        if ([self entityNameForTable:tableID]) {
+            [metrics addRecordsIn:[records count] tableID:tableID];
+        }
+    }];
+    
+    // The coordinator, pool and index are created lazily, so they are resolved here on the sync queue and not by
+    // the groups applied concurrently
+    PKSyncContextPool *contextPool = self.contextPool;
+    PKSyncIndex *syncIndex = self.syncIndex;
+    
+    NSArray *groups = (self.appliesIndependentTablesConcurrently ? [self changesOfIndependentTablesWithChanges:changes] : nil);
+    if ([groups count] > 1) {
+        // Each group is applied and saved in a context of its own, the saves are merged as they happen
+        dispatch_apply([groups count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+            @autoreleasepool {
+                [self updateCoreDataWithChangesOfTables:[groups objectAtIndex:index] contextPool:contextPool syncIndex:syncIndex metrics:metrics];
+            }
+        });
     } else {
-        NSLog(@"Error getting or inserting datatore record: %@", error);
+        [self updateCoreDataWithChangesOfTables:changes contextPool:contextPool syncIndex:syncIndex metrics:metrics];
     }
+    
+    return YES;
 }
 
-- (BOOL)syncDatastore
+// Groups the changes by table so that no object is changed by more than one group, as when tables are applied
+// concurrently. Tables whose entities are related, directly or through another entity whose inverse relationships
+// both would change, end up in the same group.
+- (NSArray *)changesOfIndependentTablesWithChanges:(NSDictionary *)changes
 {
-    DBError *error = nil;
-    NSDictionary *changes = [self.datastore sync:&error];
-    if (changes) {
-        if ([self updateCoreDataWithDatastoreChanges:changes]) {
-            [[NSNotificationCenter defaultCenter] postNotificationName:PKSyncManagerDatastoreIncomingChangesNotification object:self userInfo:@{PKSyncManagerDatastoreIncomingChangesKey: changes}];
+    NSDictionary *entitiesByName = [[self.persistentStoreCoordinator managedObjectModel] entitiesByName];
+    NSMutableDictionary *parents = [[NSMutableDictionary alloc] init];
+    for (NSString *entityName in [self entityNames]) {
+        NSEntityDescription *entity = [entitiesByName objectForKey:entityName];
+        if ([entity superentity]) {
+            PKUnionEntityNames(parents, entityName, [[entity superentity] name]);
+        }
+        for (NSRelationshipDescription *relationship in [[entity relationshipsByName] allValues]) {
+            PKUnionEntityNames(parents, entityName, [[relationship destinationEntity] name]);
         }
-        [[NSNotificationCenter defaultCenter] postNotificationName:PKSyncManagerDatastoreLastSyncDateNotification object:self userInfo:@{PKSyncManagerDatastoreLastSyncDateKey: [NSDate date]}];
+    }
+    
+    NSMutableDictionary *groups = [[NSMutableDictionary alloc] init];
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
+        NSString *entityName = [self entityNameForTable:tableID];
+        if (!entityName) return;
         
-        return YES;
-    } else {
-        NSLog(@"Error syncing with Dropbox: %@", error);
-        return NO;
+        NSString *rootEntityName = PKRootEntityName(parents, entityName);
+        NSMutableDictionary *group = [groups objectForKey:rootEntityName];
+        if (!group) {
+            group = [[NSMutableDictionary alloc] init];
+            [groups setObject:group forKey:rootEntityName];
+        }
+        [group setObject:records forKey:tableID];
+    }];
+    return [groups allValues];
+}
+
+- (void)updateCoreDataWithChangesOfTables:(NSDictionary *)changes contextPool:(PKSyncContextPool *)contextPool syncIndex:(PKSyncIndex *)syncIndex metrics:(PKSyncMetrics *)metrics
+{
+    PKTraceScope("applyTables", [[changes allKeys] componentsJoinedByString:@","]);
+    __weak typeof(self) weakSelf = self;
+    [contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        
+        [managedObjectContext pk_setSyncMetrics:metrics];
+        [strongSelf applyChangesOfTables:changes inManagedObjectContext:managedObjectContext contextPool:contextPool syncIndex:syncIndex];
+        [managedObjectContext pk_setSyncMetrics:nil];
+    }];
+}
+
+// Only called on the queue of the context
+- (void)applyChangesOfTables:(NSDictionary *)changes inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext contextPool:(PKSyncContextPool *)contextPool syncIndex:(PKSyncIndex *)syncIndex
+{
+    NSSet *bootstrappedTableIDs = [self bootstrappedTableIDsWithChanges:changes inManagedObjectContext:managedObjectContext];
+    NSUInteger windowSize = self.incomingChangesWindowSize;
+    if (windowSize == 0 && [bootstrappedTableIDs count] == 0) {
+        NSArray *managedObjects = [self applyDatastoreChanges:changes settingAttributes:YES bootstrappedTableIDs:nil unresolvedRecords:nil inManagedObjectContext:managedObjectContext syncIndex:syncIndex];
+        [contextPool addUsedManagedObjects:managedObjects inManagedObjectContext:managedObjectContext];
+        [self saveSyncManagedObjectContext:managedObjectContext];
+        return;
     }
+    if (windowSize == 0) {
+        windowSize = PKBootstrapBatchSize;
+    }
+    
+    // Saving and resetting after each window keeps only one window of objects in memory.
+    // A failed save is not reset so its changes are saved again with the next window.
+    NSMutableDictionary *unresolvedRecords = [[NSMutableDictionary alloc] init];
+    PKEnumerateWindowsOfChanges(changes, windowSize, ^(NSDictionary *window) {
+        NSArray *managedObjects = [self applyDatastoreChanges:window settingAttributes:YES bootstrappedTableIDs:bootstrappedTableIDs unresolvedRecords:unresolvedRecords inManagedObjectContext:managedObjectContext syncIndex:syncIndex];
+        [contextPool addUsedManagedObjects:managedObjects inManagedObjectContext:managedObjectContext];
+        if ([self saveSyncManagedObjectContext:managedObjectContext]) {
+            [contextPool resetManagedObjectContext:managedObjectContext];
+        }
+    });
+    
+    // Relationships to records of later windows can be resolved now that every window has been saved,
+    // bootstrapped records are validated once their relationships are set
+    PKEnumerateWindowsOfChanges(unresolvedRecords, windowSize, ^(NSDictionary *window) {
+        NSArray *managedObjects = [self applyDatastoreChanges:window settingAttributes:NO bootstrappedTableIDs:bootstrappedTableIDs unresolvedRecords:nil inManagedObjectContext:managedObjectContext syncIndex:syncIndex];
+        [contextPool addUsedManagedObjects:managedObjects inManagedObjectContext:managedObjectContext];
+        if ([self saveSyncManagedObjectContext:managedObjectContext]) {
+            [contextPool resetManagedObjectContext:managedObjectContext];
+        }
+    });
 }
 
-- (NSSet *)syncableManagedObjectsFromManagedObjects:(NSSet *)managedObjects
+// Returns the tables of the changes whose entity has no objects yet, so their records can be inserted without looking
+// for existing objects. An entity is only checked until it has objects. Only called on the queue of the context.
+- (NSSet *)bootstrappedTableIDsWithChanges:(NSDictionary *)changes inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
 {
-    NSMutableSet *syncableManagedObjects = [[NSMutableSet alloc] init];
-    for (NSManagedObject *managedObject in managedObjects) {
-        NSString *tableID = [self tableForEntityName:[[managedObject entity] name]];
-        if (!tableID) continue;
+    if (!self.bootstrapsEmptyEntities) return nil;
+    
+    NSMutableSet *bootstrappedTableIDs = [[NSMutableSet alloc] init];
+    for (NSString *tableID in changes) {
+        NSString *entityName = [self entityNameForTable:tableID];
+        if (!entityName) continue;
+        @synchronized(self.seededEntityNames) {
+            if ([self.seededEntityNames containsObject:entityName]) continue;
+        }
         
-        if ([managedObject respondsToSelector:@selector(isRecordSyncable)]) {
-            id<ParcelKitSyncedObject> pkObj = (id<ParcelKitSyncedObject>)managedObject;
-            if (![pkObj isRecordSyncable]) {
-                continue;
+        // Windows are saved before relationships are set, which required relationships would fail
+        NSEntityDescription *entity = [NSEntityDescription entityForName:entityName inManagedObjectContext:managedObjectContext];
+        if (PKEntityHasRequiredRelationship(entity)) {
+            @synchronized(self.seededEntityNames) {
+                [self.seededEntityNames addObject:entityName];
             }
+            continue;
         }
         
-        if (![managedObject valueForKey:self.syncAttributeName]) {
-            [managedObject setPrimitiveValue:[[self class] syncID] forKey:self.syncAttributeName];
+        PKTraceScope("checkEmptyEntity", entityName);
+        NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+        [fetchRequest setResultType:NSManagedObjectIDResultType];
+        [fetchRequest setFetchLimit:1];
+        NSError *error = nil;
+        NSArray *objectIDs = [managedObjectContext executeFetchRequest:fetchRequest error:&error];
+        [[managedObjectContext pk_syncMetrics] addFetches:1];
+        if (!objectIDs) {
+            NSLog(@"Error executing fetch request: %@", error);
+            continue;
         }
         
-        [syncableManagedObjects addObject:managedObject];
+        // Once bootstrapped the entity has objects as well
+        @synchronized(self.seededEntityNames) {
+            [self.seededEntityNames addObject:entityName];
+        }
+        if ([objectIDs count] == 0) {
+            [bootstrappedTableIDs addObject:tableID];
+        }
     }
+    return bootstrappedTableIDs;
+}
+
+// Applies records keyed by table ID to the managed object context. Without setting attributes only the relationships
+// of existing objects are set. Records with relationships to objects that could not be found are added to the
+// unresolved records, keyed by table ID, if given. Records of bootstrapped tables are inserted without looking for
+// existing objects and their relationships are always left to the unresolved records. Without setting attributes,
+// objects of bootstrapped tables are validated as inserted objects once their relationships are set.
+// Returns the managed objects the records were applied to.
+- (NSArray *)applyDatastoreChanges:(NSDictionary *)changes settingAttributes:(BOOL)setAttributes bootstrappedTableIDs:(NSSet *)bootstrappedTableIDs unresolvedRecords:(NSMutableDictionary *)unresolvedRecords inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncIndex:(PKSyncIndex *)syncIndex
+{
+    static NSString * const PKUpdateManagedObjectKey = @"object";
+    static NSString * const PKUpdateRecordKey = @"record";
+    static NSString * const PKUpdateTableKey = @"table";
+    static NSString * const PKUpdateRelatedSyncIDsKey = @"related";
+    static NSString * const PKUpdateDeferredKey = @"deferred";
     
-    return [[NSSet alloc] initWithSet:syncableManagedObjects];
+    NSMutableArray *updates = [[NSMutableArray alloc] init];
+    NSMutableDictionary *managedObjectsKeyedByEntityName = [[NSMutableDictionary alloc] init];
+    PKSyncMetrics *metrics = [managedObjectContext pk_syncMetrics];
+    NSSet *insertedTableIDs = (setAttributes ? bootstrappedTableIDs : nil);
+    NSSet *deferredTableIDs = (setAttributes ? nil : bootstrappedTableIDs);
+    
+    __weak typeof(self) weakSelf = self;
+    [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        NSString *entityName = [strongSelf entityNameForTable:tableID];
+        if (!entityName) return;
+        
+        // Resolve every record of the table up front instead of fetching once per record
+        PKTraceScope("lookup", tableID);
+        NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+        NSError *error = nil;
+        NSArray *syncIDs = [records valueForKey:@"recordId"];
+        NSDictionary *existingObjects = nil;
+        if ([insertedTableIDs containsObject:tableID]) {
+            existingObjects = @{};
+        } else if (syncIndex) {
+            existingObjects = [syncIndex managedObjectsKeyedBySyncID:syncIDs entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:NO error:&error];
+        } else {
+            existingObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:syncIDs entityName:entityName syncAttributeName:strongSelf.syncAttributeName error:&error];
+        }
+        [metrics addTimeSince:timestamp toPhase:PKSyncPhaseLookup];
+        if (!existingObjects) {
+            NSLog(@"Error executing fetch request: %@", error);
+            return;
+        }
+        
+        NSMutableDictionary *managedObjects = [[NSMutableDictionary alloc] initWithDictionary:existingObjects];
+        for (DBRecord *record in records) {
+            NSManagedObject *managedObject = [managedObjects objectForKey:record.recordId];
+            
+            if ([record isDeleted]) {
+                if (managedObject) {
+                    [managedObjectContext deleteObject:managedObject];
+                    [managedObjects removeObjectForKey:record.recordId];
+                }
+            } else {
+                if (!managedObject) {
+                    if (!setAttributes) continue;
+                    
+                    managedObject = [NSEntityDescription insertNewObjectForEntityForName:entityName inManagedObjectContext:managedObjectContext];
+                    [managedObject setValue:record.recordId forKey:strongSelf.syncAttributeName];
+                    [managedObjects setObject:managedObject forKey:record.recordId];
+                }
+                
+                [updates addObject:[[NSMutableDictionary alloc] initWithObjectsAndKeys:managedObject, PKUpdateManagedObjectKey, record, PKUpdateRecordKey, tableID, PKUpdateTableKey, nil]];
+            }
+        }
+        [managedObjectsKeyedByEntityName setObject:managedObjects forKey:entityName];
+    }];
+    
+    // Attributes are set first so that the relationships of the whole change set can be resolved together
+    NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+    NSMutableDictionary *relatedSyncIDs = [[NSMutableDictionary alloc] init];
+    for (NSMutableDictionary *update in updates) {
+        NSManagedObject *managedObject = update[PKUpdateManagedObjectKey];
+        DBRecord *record = update[PKUpdateRecordKey];
+        PKTraceScope("mapRecord", record.recordId);
+        PKEntitySyncPlan *syncPlan = [self syncPlanForEntity:[managedObject entity]];
+        if (setAttributes) {
+            [managedObject pk_setAttributesWithRecord:record syncPlan:syncPlan];
+        }
+        
+        NSDictionary *recordRelatedSyncIDs = [managedObject pk_relatedSyncIDsWithRecord:record syncPlan:syncPlan];
+        if ([recordRelatedSyncIDs count] > 0 && [insertedTableIDs containsObject:update[PKUpdateTableKey]]) {
+            // Relationships of bootstrapped records are all set in one pass once every window has been inserted,
+            // and the records are validated then
+            [update setObject:@YES forKey:PKUpdateDeferredKey];
+            PKAddUnresolvedRecord(unresolvedRecords, update[PKUpdateTableKey], record);
+            continue;
+        }
+        
+        [recordRelatedSyncIDs enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+            NSMutableSet *entitySyncIDs = [relatedSyncIDs objectForKey:entityName];
+            if (entitySyncIDs) {
+                [entitySyncIDs unionSet:syncIDs];
+            } else {
+                [relatedSyncIDs setObject:[syncIDs mutableCopy] forKey:entityName];
+            }
+        }];
+        
+        if (unresolvedRecords && [recordRelatedSyncIDs count] > 0) {
+            [update setObject:recordRelatedSyncIDs forKey:PKUpdateRelatedSyncIDsKey];
+        }
+    }
+    
+    [metrics addTimeSince:timestamp toPhase:PKSyncPhaseMapping];
+    
+    timestamp = [PKSyncMetrics timestamp];
+    NSDictionary *relatedObjects = nil;
+    {
+        PKTraceScope("lookupRelated", nil);
+        relatedObjects = [self managedObjectsKeyedByEntityNameWithSyncIDs:relatedSyncIDs knownObjects:managedObjectsKeyedByEntityName inManagedObjectContext:managedObjectContext syncIndex:syncIndex];
+    }
+    [metrics addTimeSince:timestamp toPhase:PKSyncPhaseLookup];
+    
+    // Validation is timed separately from mapping the relationships
+    NSMutableArray *insertedObjects = [[NSMutableArray alloc] init];
+    timestamp = [PKSyncMetrics timestamp];
+    for (NSDictionary *update in updates) {
+        if (update[PKUpdateDeferredKey]) continue;
+        
+        NSManagedObject *managedObject = update[PKUpdateManagedObjectKey];
+        DBRecord *record = update[PKUpdateRecordKey];
+        PKTraceScope("mapRelationships", record.recordId);
+        [managedObject pk_setRelationshipsWithRecord:record syncPlan:[self syncPlanForEntity:[managedObject entity]] relatedObjects:relatedObjects];
+        
+        __block BOOL resolved = YES;
+        NSDictionary *recordRelatedSyncIDs = update[PKUpdateRelatedSyncIDsKey];
+        [recordRelatedSyncIDs enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+            NSDictionary *managedObjects = [relatedObjects objectForKey:entityName];
+            for (NSString *syncID in syncIDs) {
+                if (![managedObjects objectForKey:syncID]) {
+                    resolved = NO;
+                    *stop = YES;
+                    break;
+                }
+            }
+        }];
+        if (!resolved) {
+            PKAddUnresolvedRecord(unresolvedRecords, update[PKUpdateTableKey], record);
+        }
+        
+        if (managedObject.isInserted || [deferredTableIDs containsObject:update[PKUpdateTableKey]]) {
+            [insertedObjects addObject:managedObject];
+        }
+    }
+    [metrics addTimeSince:timestamp toPhase:PKSyncPhaseMapping];
+    
+    NSArray *managedObjects = [updates valueForKey:PKUpdateManagedObjectKey];
+    if ([insertedObjects count] == 0) return managedObjects;
+    timestamp = [PKSyncMetrics timestamp];
+    for (NSManagedObject *managedObject in insertedObjects) {
+        PKTraceScope("validate", [managedObject valueForKey:self.syncAttributeName]);
+        
+        // Validate this object quickly
+        NSError *error = nil;
+        if (![managedObject validateForInsert:&error]) {
+            if ((self.delegate != nil) && ([self.delegate respondsToSelector:@selector(syncManager:managedObject:insertValidationFailed:inManagedObjectContext:)])) {
+                
+                // Call the delegate method to respond to this validation error
+                [self.delegate syncManager:self managedObject:managedObject insertValidationFailed:error inManagedObjectContext:managedObjectContext];
+            }
+        }
+    }
+    [metrics addTimeSince:timestamp toPhase:PKSyncPhaseValidation];
+    return managedObjects;
+}
+
+- (BOOL)saveSyncManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    if (![managedObjectContext hasChanges]) return YES;
+    
+    PKTraceScope("save", nil);
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(syncManagedObjectContextDidSave:) name:NSManagedObjectContextDidSaveNotification object:managedObjectContext];
+    NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+    NSError *error = nil;
+    BOOL saved = [managedObjectContext save:&error];
+    [[managedObjectContext pk_syncMetrics] addTimeSince:timestamp toPhase:PKSyncPhaseSave];
+    if (!saved) {
+        NSLog(@"Error saving managed object context: %@", error);
+    }
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:NSManagedObjectContextDidSaveNotification object:managedObjectContext];
+    
+    return saved;
+}
+
+// Resolves the related objects of a change set with one lookup per destination entity.
+// Objects of the change set itself are already known and are not looked up again.
+- (NSDictionary *)managedObjectsKeyedByEntityNameWithSyncIDs:(NSDictionary *)syncIDsKeyedByEntityName knownObjects:(NSDictionary *)knownObjectsKeyedByEntityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncIndex:(PKSyncIndex *)syncIndex
+{
+    NSMutableDictionary *managedObjectsKeyedByEntityName = [[NSMutableDictionary alloc] initWithCapacity:[syncIDsKeyedByEntityName count]];
+    
+    __weak typeof(self) weakSelf = self;
+    [syncIDsKeyedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        
+        NSDictionary *knownObjects = [knownObjectsKeyedByEntityName objectForKey:entityName];
+        NSMutableDictionary *managedObjects = [[NSMutableDictionary alloc] initWithCapacity:[syncIDs count]];
+        NSMutableArray *unknownSyncIDs = [[NSMutableArray alloc] init];
+        for (NSString *syncID in syncIDs) {
+            NSManagedObject *managedObject = [knownObjects objectForKey:syncID];
+            if (managedObject) {
+                [managedObjects setObject:managedObject forKey:syncID];
+            } else {
+                [unknownSyncIDs addObject:syncID];
+            }
+        }
+        
+        if ([unknownSyncIDs count] > 0) {
+            NSError *error = nil;
+            NSDictionary *existingObjects = nil;
+            if (syncIndex) {
+                existingObjects = [syncIndex managedObjectsKeyedBySyncID:unknownSyncIDs entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:YES error:&error];
+            } else {
+                existingObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:unknownSyncIDs entityName:entityName syncAttributeName:strongSelf.syncAttributeName error:&error];
+            }
+            
+            if (existingObjects) {
+                [managedObjects addEntriesFromDictionary:existingObjects];
+            } else {
+                NSLog(@"Error executing fetch request: %@", error);
+            }
+        }
+        
+        [managedObjectsKeyedByEntityName setObject:managedObjects forKey:entityName];
+    }];
+    
+    return managedObjectsKeyedByEntityName;
+}
+
+- (void)syncManagedObjectContextDidSave:(NSNotification *)notification
+{
+    NSManagedObjectContext *managedObjectContext = self.managedObjectContext;
+    if (!managedObjectContext) return;
+    
+    // Only object IDs are handed over so the objects of the saving context are not kept alive until the merge
+    NSArray *batches = PKObjectIDBatchesWithSaveNotification(notification, PKSyncManagerMergeBatchSize);
+    PKSyncMetrics *metrics = [[notification object] pk_syncMetrics];
+    NSManagedObjectContextConcurrencyType concurrencyType = [managedObjectContext concurrencyType];
+    if (concurrencyType != NSPrivateQueueConcurrencyType && [NSThread isMainThread]) {
+        for (NSDictionary *objectIDs in batches) {
+            NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+            [self mergeObjectIDs:objectIDs intoManagedObjectContext:managedObjectContext];
+            [metrics addTimeSince:timestamp toPhase:PKSyncPhaseMerge];
+        }
+        return;
+    }
+    
+    // Each batch is merged in a separate block so the queue of the context can handle other work in between
+    __weak typeof(self) weakSelf = self;
+    for (NSDictionary *objectIDs in batches) {
+        void (^merge)(void) = ^{
+            typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+            NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+            [strongSelf mergeObjectIDs:objectIDs intoManagedObjectContext:managedObjectContext];
+            [metrics addTimeSince:timestamp toPhase:PKSyncPhaseMerge];
+        };
+        
+        if (concurrencyType == NSConfinementConcurrencyType) {
+            dispatch_async(dispatch_get_main_queue(), merge);
+        } else {
+            [managedObjectContext performBlock:merge];
+        }
+    }
+}
+
+// Merges object IDs keyed by NSInsertedObjectsKey, NSUpdatedObjectsKey and NSDeletedObjectsKey into the context.
+// Updated and deleted objects the context has not registered have nothing to refresh and are skipped.
+- (void)mergeObjectIDs:(NSDictionary *)objectIDsKeyedByChangeKey intoManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    PKTraceScope("merge", nil);
+    NSMutableDictionary *userInfo = [[NSMutableDictionary alloc] initWithCapacity:[objectIDsKeyedByChangeKey count]];
+    [objectIDsKeyedByChangeKey enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSArray *objectIDs, BOOL *stop) {
+        BOOL inserted = [key isEqualToString:NSInsertedObjectsKey];
+        NSMutableSet *managedObjects = [[NSMutableSet alloc] initWithCapacity:[objectIDs count]];
+        for (NSManagedObjectID *objectID in objectIDs) {
+            NSManagedObject *managedObject = (inserted ? [managedObjectContext objectWithID:objectID] : [managedObjectContext objectRegisteredForID:objectID]);
+            if (managedObject) {
+                [managedObjects addObject:managedObject];
+            }
+        }
+        
+        if ([managedObjects count] > 0) {
+            [userInfo setObject:managedObjects forKey:key];
+        }
+    }];
+    if ([userInfo count] == 0) return;
+    
+    [managedObjectContext mergeChangesFromContextDidSaveNotification:[NSNotification notificationWithName:NSManagedObjectContextDidSaveNotification object:nil userInfo:userInfo]];
+}
+
+#pragma mark - Updating Datastore
+- (void)managedObjectContextWillSave:(NSNotification *)notification
+{
+    if (![self isObserving]) return;
+    
+    NSManagedObjectContext *managedObjectContext = notification.object;
+    if (self.managedObjectContext != managedObjectContext) return;
+    
+    if (self.writeBehindInterval > 0) {
+        [self addPendingChangesOfManagedObjectContextToOutbox:managedObjectContext];
+        return;
+    }
+    
+    // The changes are read here, on the thread of the managed object context, and only written once the save went
+    // through, so the save neither waits for a sync in progress nor has its objects read on the sync queue
+    NSDictionary *deletedSyncIDs = nil;
+    self.savePendingWrites = [self pendingWritesOfManagedObjectContext:managedObjectContext deletedSyncIDs:&deletedSyncIDs assigningSyncIDs:YES];
+    self.saveDeletedSyncIDs = deletedSyncIDs;
+}
+
+- (void)managedObjectContextDidSave:(NSNotification *)notification
+{
+    NSArray *pendingWrites = self.savePendingWrites;
+    NSDictionary *deletedSyncIDs = self.saveDeletedSyncIDs;
+    self.savePendingWrites = nil;
+    self.saveDeletedSyncIDs = nil;
+    if (!pendingWrites || ![self isObserving]) return;
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.syncQueue, ^{
+        [weakSelf writePendingWrites:pendingWrites deletedSyncIDs:deletedSyncIDs toDatastore:YES];
+    });
+}
+
+- (NSUInteger)numberOfSyncBatchesForPendingChanges
+{
+    NSDictionary *deletedSyncIDs = nil;
+    NSArray *pendingWrites = [self pendingWritesOfManagedObjectContext:self.managedObjectContext deletedSyncIDs:&deletedSyncIDs assigningSyncIDs:NO];
+    return [self writePendingWrites:pendingWrites deletedSyncIDs:deletedSyncIDs toDatastore:NO];
+}
+
+- (NSArray *)pendingWritesOfManagedObjectContext:(NSManagedObjectContext *)managedObjectContext deletedSyncIDs:(NSDictionary **)deletedSyncIDs assigningSyncIDs:(BOOL)assignSyncIDs
+{
+    NSSet *deletedObjects = [self syncableManagedObjectsFromManagedObjects:[managedObjectContext deletedObjects] assigningSyncIDs:assignSyncIDs];
+    *deletedSyncIDs = [self syncIDsKeyedByEntityNameWithManagedObjects:deletedObjects];
+    
+    NSMutableSet *managedObjects = [[NSMutableSet alloc] init];
+    [managedObjects unionSet:[managedObjectContext insertedObjects]];
+    [managedObjects unionSet:[managedObjectContext updatedObjects]];
+    
+    return [self pendingWritesWithManagedObjects:[self syncableManagedObjectsFromManagedObjects:managedObjects assigningSyncIDs:assignSyncIDs]];
+}
+
+// Only called on the thread of the managed objects' context
+- (NSArray *)pendingWritesWithManagedObjects:(NSSet *)managedObjects
+{
+    NSMutableArray *pendingWrites = [[NSMutableArray alloc] initWithCapacity:[managedObjects count]];
+    for (NSManagedObject *managedObject in managedObjects) {
+        PKEntitySyncPlan *syncPlan = [self.syncPlansKeyedByEntityName objectForKey:[[managedObject entity] name]];
+        if (!syncPlan) continue;
+        
+        PKPendingWrite *pendingWrite = [[PKPendingWrite alloc] init];
+        pendingWrite.syncPlan = syncPlan;
+        pendingWrite.syncID = [managedObject valueForKey:self.syncAttributeName];
+        pendingWrite.values = [DBRecord pk_fieldValuesWithValues:[syncPlan valuesToWriteForManagedObject:managedObject] syncPlan:syncPlan];
+        pendingWrite.changedValuesOnly = [managedObject isUpdated];
+        [pendingWrites addObject:pendingWrite];
+    }
+    return pendingWrites;
+}
+
+// Writes the pending writes and deletes the records of the sync identifiers in batches and syncs after each,
+// or only counts the batches without writing. Returns the number of syncs.
+- (NSUInteger)writePendingWrites:(NSArray *)pendingWrites deletedSyncIDs:(NSDictionary *)deletedSyncIDsKeyedByEntityName toDatastore:(BOOL)write
+{
+    PKTraceScope("writePendingWrites", nil);
+    BOOL session = (write && [self beginSyncMetricsSession]);
+    PKSyncMetrics *metrics = (write ? self.syncMetrics : nil);
+    NSUInteger byteLimit = self.syncBatchByteLimit;
+    NSUInteger countLimit = MAX(self.syncBatchSize, (NSUInteger)1);
+    __block NSUInteger numberOfSyncs = 0;
+    
+    // Changes made to the datastore outside of the sync manager count towards the first batch
+    __block NSUInteger batchBytes = (byteLimit > 0 ? [self.datastore unsyncedChangesSize] : 0);
+    void (^addChangeSize)(NSUInteger) = ^(NSUInteger size) {
+        if (batchBytes > 0 && batchBytes + size > byteLimit) {
+            if (write) [self syncDatastoreOnSyncQueue];
+            numberOfSyncs++;
+            batchBytes = 0;
+        }
+        batchBytes += size;
+    };
+    
+    [deletedSyncIDsKeyedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+        DBTable *table = [[self.syncPlansKeyedByEntityName objectForKey:entityName] tableInDatastore:self.datastore];
+        for (NSString *syncID in syncIDs) {
+            if (byteLimit > 0) addChangeSize(PKSyncManagerDeletedRecordSize);
+            
+            if (write) {
+                DBError *error = nil;
+                DBRecord *record = [table getRecord:syncID error:&error];
+                if (record) {
+                    [record deleteRecord];
+                    [metrics addRecordsOut:1 tableID:[self tableForEntityName:entityName]];
+                }
+            }
+        }
+    }];
+    
+    NSUInteger batchCount = 0;
+    NSMutableDictionary *unwrittenSyncIDs = [[NSMutableDictionary alloc] init];
+    for (PKPendingWrite *pendingWrite in pendingWrites) {
+        if (byteLimit > 0) addChangeSize([pendingWrite.syncPlan estimatedChangeSizeOfValues:pendingWrite.values]);
+        
+        if (write && ![self updateDatastoreWithPendingWrite:pendingWrite]) {
+            NSMutableSet *syncIDs = [unwrittenSyncIDs objectForKey:pendingWrite.syncPlan.entityName];
+            if (!syncIDs) {
+                syncIDs = [[NSMutableSet alloc] init];
+                [unwrittenSyncIDs setObject:syncIDs forKey:pendingWrite.syncPlan.entityName];
+            }
+            [syncIDs addObject:pendingWrite.syncID];
+        }
+        batchCount++;
+        
+        if (byteLimit == 0 && batchCount % countLimit == 0) {
+            if (write) [self syncDatastoreOnSyncQueue];
+            numberOfSyncs++;
+        }
+    }
+    
+    if (write) [self syncDatastoreOnSyncQueue];
+    numberOfSyncs++;
+    
+    // Updated objects without a record get one with their saved state, read back from the store
+    if ([unwrittenSyncIDs count] > 0) {
+        [self addSyncIDsToOutbox:unwrittenSyncIDs];
+        [self writeOutbox];
+    }
+    
+    if (session) [self endSyncMetricsSession];
+    return numberOfSyncs;
+}
+
+- (NSDictionary *)syncIDsKeyedByEntityNameWithManagedObjects:(NSSet *)managedObjects
+{
+    NSMutableDictionary *syncIDsKeyedByEntityName = [[NSMutableDictionary alloc] init];
+    for (NSManagedObject *managedObject in managedObjects) {
+        NSString *syncID = [managedObject primitiveValueForKey:self.syncAttributeName];
+        if (!syncID) continue;
+        
+        NSString *entityName = [[managedObject entity] name];
+        NSMutableSet *syncIDs = [syncIDsKeyedByEntityName objectForKey:entityName];
+        if (!syncIDs) {
+            syncIDs = [[NSMutableSet alloc] init];
+            [syncIDsKeyedByEntityName setObject:syncIDs forKey:entityName];
+        }
+        [syncIDs addObject:syncID];
+    }
+    return syncIDsKeyedByEntityName;
+}
+
+#pragma mark - Outbox
+- (void)addPendingChangesOfManagedObjectContextToOutbox:(NSManagedObjectContext *)managedObjectContext
+{
+    NSMutableSet *managedObjects = [[NSMutableSet alloc] init];
+    [managedObjects unionSet:[managedObjectContext insertedObjects]];
+    [managedObjects unionSet:[managedObjectContext updatedObjects]];
+    
+    NSMutableSet *syncableManagedObjects = [[NSMutableSet alloc] init];
+    [syncableManagedObjects unionSet:[self syncableManagedObjectsFromManagedObjects:managedObjects assigningSyncIDs:YES]];
+    [syncableManagedObjects unionSet:[self syncableManagedObjectsFromManagedObjects:[managedObjectContext deletedObjects] assigningSyncIDs:NO]];
+    
+    // Only sync identifiers are recorded, the latest state of the objects is read back when the outbox is written
+    NSDictionary *syncIDsKeyedByEntityName = [self syncIDsKeyedByEntityNameWithManagedObjects:syncableManagedObjects];
+    if ([syncIDsKeyedByEntityName count] == 0) return;
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.syncQueue, ^{
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        [strongSelf addSyncIDsToOutbox:syncIDsKeyedByEntityName];
+        [strongSelf scheduleOutboxWrite];
+    });
+}
+
+// Only called on the sync queue
+- (void)addSyncIDsToOutbox:(NSDictionary *)syncIDsKeyedByEntityName
+{
+    [syncIDsKeyedByEntityName enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, id syncIDs, BOOL *stop) {
+        NSMutableSet *outboxSyncIDs = [self.outbox objectForKey:entityName];
+        if (!outboxSyncIDs) {
+            outboxSyncIDs = [[NSMutableSet alloc] init];
+            [self.outbox setObject:outboxSyncIDs forKey:entityName];
+        }
+        for (NSString *syncID in syncIDs) {
+            [outboxSyncIDs addObject:syncID];
+        }
+    }];
+}
+
+// Saves within the write behind interval are written together. Only called on the sync queue.
+- (void)scheduleOutboxWrite
+{
+    if (self.outboxWriteScheduled || [self.outbox count] == 0) return;
+    self.outboxWriteScheduled = YES;
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.writeBehindInterval * NSEC_PER_SEC)), self.syncQueue, ^{
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        strongSelf.outboxWriteScheduled = NO;
+        [strongSelf writeOutbox];
+    });
+}
+
+- (void)flushOutbox
+{
+    [self performBlockOnSyncQueue:^{
+        [self writeOutbox];
+    }];
+}
+
+// Writes the latest state of the objects in the outbox to the datastore, records of objects that no longer exist
+// are deleted. Only called on the sync queue.
+- (void)writeOutbox
+{
+    if (![self isObserving] || [self.outbox count] == 0) return;
+    PKTraceScope("writeOutbox", nil);
+    
+    NSDictionary *outbox = self.outbox;
+    self.outbox = [[NSMutableDictionary alloc] init];
+    
+    NSManagedObjectContext *managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    [managedObjectContext setPersistentStoreCoordinator:self.persistentStoreCoordinator];
+    [managedObjectContext setUndoManager:nil];
+    
+    BOOL session = [self beginSyncMetricsSession];
+    PKSyncMetrics *metrics = self.syncMetrics;
+    
+    __weak typeof(self) weakSelf = self;
+    [managedObjectContext performBlockAndWait:^{
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        
+        [managedObjectContext pk_setSyncMetrics:metrics];
+        NSMutableSet *managedObjects = [[NSMutableSet alloc] init];
+        NSMutableDictionary *deletedSyncIDs = [[NSMutableDictionary alloc] init];
+        [outbox enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+            NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+            NSError *error = nil;
+            NSDictionary *existingObjects = nil;
+            if (strongSelf.syncIndex) {
+                existingObjects = [strongSelf.syncIndex managedObjectsKeyedBySyncID:[syncIDs allObjects] entityName:entityName inManagedObjectContext:managedObjectContext returnsObjectsAsFaults:NO error:&error];
+            } else {
+                existingObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:[syncIDs allObjects] entityName:entityName syncAttributeName:strongSelf.syncAttributeName error:&error];
+            }
+            [metrics addTimeSince:timestamp toPhase:PKSyncPhaseLookup];
+            if (!existingObjects) {
+                NSLog(@"Error executing fetch request: %@", error);
+                
+                // Kept for the next write
+                [strongSelf addSyncIDsToOutbox:@{entityName: syncIDs}];
+                return;
+            }
+            
+            [managedObjects addObjectsFromArray:[existingObjects allValues]];
+            NSMutableSet *entityDeletedSyncIDs = [syncIDs mutableCopy];
+            [entityDeletedSyncIDs minusSet:[[NSSet alloc] initWithArray:[existingObjects allKeys]]];
+            if ([entityDeletedSyncIDs count] > 0) {
+                [deletedSyncIDs setObject:entityDeletedSyncIDs forKey:entityName];
+            }
+        }];
+        
+        NSArray *pendingWrites = [strongSelf pendingWritesWithManagedObjects:[strongSelf syncableManagedObjectsFromManagedObjects:managedObjects assigningSyncIDs:NO]];
+        [strongSelf writePendingWrites:pendingWrites deletedSyncIDs:deletedSyncIDs toDatastore:YES];
+    }];
+    
+    if (session) [self endSyncMetricsSession];
+    
+    if (self.outboxURL && [self.outbox count] == 0) {
+        [[[NSFileManager alloc] init] removeItemAtURL:self.outboxURL error:nil];
+    }
+}
+
+// Only called on the sync queue
+- (BOOL)writeOutboxToURL:(NSError **)error
+{
+    if ([self.outbox count] == 0) {
+        [[[NSFileManager alloc] init] removeItemAtURL:self.outboxURL error:nil];
+        return YES;
+    }
+    
+    NSMutableDictionary *outbox = [[NSMutableDictionary alloc] initWithCapacity:[self.outbox count]];
+    [self.outbox enumerateKeysAndObjectsUsingBlock:^(NSString *entityName, NSSet *syncIDs, BOOL *stop) {
+        [outbox setObject:[syncIDs allObjects] forKey:entityName];
+    }];
+    
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:outbox format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (!data) return NO;
+    
+    return [data writeToURL:self.outboxURL options:NSDataWritingAtomic error:error];
+}
+
+// Only called on the sync queue
+- (BOOL)readOutbox:(NSError **)error
+{
+    NSData *data = [[NSData alloc] initWithContentsOfURL:self.outboxURL options:0 error:error];
+    if (!data) return NO;
+    
+    NSDictionary *outbox = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:error];
+    if (![outbox isKindOfClass:[NSDictionary class]]) return NO;
+    
+    [self addSyncIDsToOutbox:outbox];
+    return YES;
+}
+
+// Returns NO when the changed values of an updated object could not be written for lack of a record to apply them to
+- (BOOL)updateDatastoreWithPendingWrite:(PKPendingWrite *)pendingWrite
+{
+    PKEntitySyncPlan *syncPlan = pendingWrite.syncPlan;
+    PKTraceScope("writeRecord", pendingWrite.syncID);
+    PKSyncMetrics *metrics = self.syncMetrics;
+    NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+    DBTable *table = [syncPlan tableInDatastore:self.datastore];
+    DBError *error = nil;
+    DBRecord *record = nil;
+    if (pendingWrite.changedValuesOnly) {
+        // Only an existing record holds the last saved state the changed values apply to
+        record = [table getRecord:pendingWrite.syncID error:&error];
+        if (!record && !error) return NO;
+    } else {
+        BOOL inserted = NO;
+        record = [table getOrInsertRecord:pendingWrite.syncID fields:nil inserted:&inserted error:&error];
+    }
+    
+    if (record) {
+        [record pk_setFieldsWithValues:pendingWrite.values syncPlan:syncPlan];
+        [metrics addTimeSince:timestamp toPhase:PKSyncPhaseMapping];
+        [metrics addRecordsOut:1 tableID:syncPlan.tableID];
+    } else {
+        NSLog(@"Error getting or inserting datatore record: %@", error);
+    }
+    return YES;
+}
+
+- (BOOL)syncDatastore
+{
+    // Waits for a sync in progress rather than running alongside it
+    __block BOOL synced = NO;
+    [self performBlockOnSyncQueue:^{
+        synced = [self syncDatastoreOnSyncQueue];
+    }];
+    return synced;
+}
+
+// Only called on the sync queue
+- (BOOL)syncDatastoreOnSyncQueue
+{
+    PKTraceScope("syncDatastore", nil);
+    BOOL session = [self beginSyncMetricsSession];
+    PKSyncMetrics *metrics = self.syncMetrics;
+    unsigned long long unsyncedChangesSize = (metrics ? [self.datastore unsyncedChangesSize] : 0);
+    
+    NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+    DBError *error = nil;
+    NSDictionary *changes = nil;
+    {
+        PKTraceScope("DBDatastore sync", nil);
+        changes = [self.datastore sync:&error];
+    }
+    [metrics addTimeSince:timestamp toPhase:PKSyncPhaseDatastoreSync];
+    
+    BOOL synced = (changes != nil);
+    if (synced) {
+        [metrics addBytesWritten:unsyncedChangesSize];
+        [self recordIncomingChanges:changes];
+        if ([self updateCoreDataWithDatastoreChanges:changes]) {
+            [self postNotificationOnMainQueueWithName:PKSyncManagerDatastoreIncomingChangesNotification userInfo:@{PKSyncManagerDatastoreIncomingChangesKey: changes}];
+        }
+        [self postNotificationOnMainQueueWithName:PKSyncManagerDatastoreLastSyncDateNotification userInfo:@{PKSyncManagerDatastoreLastSyncDateKey: [NSDate date]}];
+    } else {
+        NSLog(@"Error syncing with Dropbox: %@", error);
+    }
+    
+    if (session) [self endSyncMetricsSession];
+    return synced;
+}
+
+// Only called on the sync queue
+- (void)recordIncomingChanges:(NSDictionary *)changes
+{
+    NSURL *URL = self.changeRecordingURL;
+    if (!URL || [changes count] == 0) return;
+    
+    if (![self.changeRecorder.URL isEqual:URL]) {
+        self.changeRecorder = [[PKChangeRecorder alloc] initWithURL:URL tablesByEntityName:[self tablesByEntityName] syncAttributeName:self.syncAttributeName];
+    }
+    
+    NSError *error = nil;
+    if (![self.changeRecorder recordChanges:changes error:&error]) {
+        NSLog(@"Error recording incoming changes: %@", error);
+    }
+}
+
+- (NSSet *)syncableManagedObjectsFromManagedObjects:(NSSet *)managedObjects assigningSyncIDs:(BOOL)assignSyncIDs
+{
+    NSMutableSet *syncableManagedObjects = [[NSMutableSet alloc] init];
+    for (NSManagedObject *managedObject in managedObjects) {
+        NSString *tableID = [self tableForEntityName:[[managedObject entity] name]];
+        if (!tableID) continue;
+        
+        if ([managedObject respondsToSelector:@selector(isRecordSyncable)]) {
+            id<ParcelKitSyncedObject> pkObj = (id<ParcelKitSyncedObject>)managedObject;
+            if (![pkObj isRecordSyncable]) {
+                continue;
+            }
+        }
+        
+        if (assignSyncIDs && ![managedObject valueForKey:self.syncAttributeName]) {
+            [managedObject setPrimitiveValue:[[self class] syncID] forKey:self.syncAttributeName];
+        }
+        
+        [syncableManagedObjects addObject:managedObject];
+    }
+    
+    return [[NSSet alloc] initWithSet:syncableManagedObjects];
+}
+
+#pragma mark - Exporting
+- (void)exportManagedObjectsWithProgressBlock:(void (^)(NSUInteger exportedCount, NSUInteger totalCount))progressBlock completionBlock:(void (^)(BOOL finished))completionBlock
+{
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.syncQueue, ^{
+        typeof(self) strongSelf = weakSelf; if (!strongSelf) return;
+        if (strongSelf.exporting) {
+            NSLog(@"Managed objects are already being exported");
+            [strongSelf finishExportWithCompletionBlock:completionBlock finished:NO];
+            return;
+        }
+        strongSelf.exporting = YES;
+        
+        NSPersistentStoreCoordinator *persistentStoreCoordinator = strongSelf.persistentStoreCoordinator;
+        if (!persistentStoreCoordinator) {
+            NSLog(@"Managed objects cannot be exported without a persistent store coordinator");
+            [strongSelf finishExportWithCompletionBlock:completionBlock finished:NO];
+            return;
+        }
+        
+        NSManagedObjectContext *managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+        [managedObjectContext setPersistentStoreCoordinator:persistentStoreCoordinator];
+        [managedObjectContext setUndoManager:nil];
+        
+        NSMutableDictionary *checkpoint = [[NSMutableDictionary alloc] init];
+        NSError *error = nil;
+        if (strongSelf.exportCheckpointURL && [[NSFileManager defaultManager] fileExistsAtPath:[strongSelf.exportCheckpointURL path]] && ![strongSelf readExportCheckpoint:checkpoint error:&error]) {
+            NSLog(@"Error reading export checkpoint: %@", error);
+        }
+        
+        NSArray *entityNames = [[strongSelf entityNames] sortedArrayUsingSelector:@selector(compare:)];
+        __block NSUInteger exportedCount = 0;
+        __block NSUInteger totalCount = 0;
+        __block BOOL prepared = YES;
+        [managedObjectContext performBlockAndWait:^{
+            for (NSString *entityName in entityNames) {
+                if (![strongSelf assignSyncIDsToManagedObjectsOfEntityName:entityName inManagedObjectContext:managedObjectContext]) {
+                    prepared = NO;
+                    return;
+                }
+                
+                NSError *error = nil;
+                NSUInteger count = [managedObjectContext countForFetchRequest:[strongSelf exportFetchRequestForEntityName:entityName afterSyncID:nil] error:&error];
+                NSString *lastSyncID = [checkpoint objectForKey:entityName];
+                NSUInteger exportedEntityCount = (lastSyncID ? count - [managedObjectContext countForFetchRequest:[strongSelf exportFetchRequestForEntityName:entityName afterSyncID:lastSyncID] error:&error] : 0);
+                if (count == NSNotFound || exportedEntityCount > count) {
+                    NSLog(@"Error executing fetch request: %@", error);
+                    prepared = NO;
+                    return;
+                }
+                totalCount += count;
+                exportedCount += exportedEntityCount;
+            }
+        }];
+        
+        if (!prepared) {
+            [strongSelf finishExportWithCompletionBlock:completionBlock finished:NO];
+            return;
+        }
+        
+        [strongSelf exportNextBatchOfEntityNames:entityNames checkpoint:checkpoint managedObjectContext:managedObjectContext exportedCount:exportedCount totalCount:totalCount progressBlock:progressBlock completionBlock:completionBlock];
+    });
+}
+
+// Exports one batch of the first entity, the next batch is exported on the next turn of the sync queue so syncs of
+// incoming changes can run in between. Only called on the sync queue.
+- (void)exportNextBatchOfEntityNames:(NSArray *)entityNames checkpoint:(NSMutableDictionary *)checkpoint managedObjectContext:(NSManagedObjectContext *)managedObjectContext exportedCount:(NSUInteger)exportedCount totalCount:(NSUInteger)totalCount progressBlock:(void (^)(NSUInteger exportedCount, NSUInteger totalCount))progressBlock completionBlock:(void (^)(BOOL finished))completionBlock
+{
+    if ([entityNames count] == 0) {
+        if (self.exportCheckpointURL) {
+            [[[NSFileManager alloc] init] removeItemAtURL:self.exportCheckpointURL error:nil];
+        }
+        [self finishExportWithCompletionBlock:completionBlock finished:YES];
+        return;
+    }
+    
+    NSString *entityName = [entityNames objectAtIndex:0];
+    __block NSUInteger count = NSNotFound;
+    [managedObjectContext performBlockAndWait:^{
+        @autoreleasepool {
+            NSError *error = nil;
+            NSArray *managedObjects = [managedObjectContext executeFetchRequest:[self exportFetchRequestForEntityName:entityName afterSyncID:[checkpoint objectForKey:entityName]] error:&error];
+            if (!managedObjects) {
+                NSLog(@"Error executing fetch request: %@", error);
+                return;
+            }
+            
+            count = [managedObjects count];
+            if (count > 0) {
+                NSArray *pendingWrites = [self pendingWritesWithManagedObjects:[self syncableManagedObjectsFromManagedObjects:[[NSSet alloc] initWithArray:managedObjects] assigningSyncIDs:NO]];
+                [self writePendingWrites:pendingWrites deletedSyncIDs:nil toDatastore:YES];
+                [checkpoint setObject:[[managedObjects lastObject] valueForKey:self.syncAttributeName] forKey:entityName];
+            }
+            [managedObjectContext reset];
+        }
+    }];
+    
+    if (count == NSNotFound) {
+        [self finishExportWithCompletionBlock:completionBlock finished:NO];
+        return;
+    }
+    
+    NSError *error = nil;
+    if (self.exportCheckpointURL && count > 0 && ![self writeExportCheckpoint:checkpoint error:&error]) {
+        NSLog(@"Error writing export checkpoint: %@", error);
+    }
+    
+    exportedCount += count;
+    if (progressBlock) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            progressBlock(exportedCount, totalCount);
+        });
+    }
+    
+    // A short batch is the last one of its entity
+    if (count < PKExportBatchSize) {
+        entityNames = [entityNames subarrayWithRange:NSMakeRange(1, [entityNames count] - 1)];
+    }
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.syncQueue, ^{
+        [weakSelf exportNextBatchOfEntityNames:entityNames checkpoint:checkpoint managedObjectContext:managedObjectContext exportedCount:exportedCount totalCount:totalCount progressBlock:progressBlock completionBlock:completionBlock];
+    });
+}
+
+- (void)finishExportWithCompletionBlock:(void (^)(BOOL finished))completionBlock finished:(BOOL)finished
+{
+    self.exporting = NO;
+    if (completionBlock) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionBlock(finished);
+        });
+    }
+}
+
+// Objects are exported in sync identifier order so a checkpoint only has to remember the last one exported
+- (NSFetchRequest *)exportFetchRequestForEntityName:(NSString *)entityName afterSyncID:(NSString *)syncID
+{
+    // Objects of sub-entities are only synced when the sub-entity is mapped itself, and are then exported with it
+    NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+    [fetchRequest setIncludesSubentities:NO];
+    if (syncID) {
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K > %@", self.syncAttributeName, syncID]];
+    } else {
+        [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K != nil", self.syncAttributeName]];
+    }
+    [fetchRequest setSortDescriptors:@[[[NSSortDescriptor alloc] initWithKey:self.syncAttributeName ascending:YES]]];
+    [fetchRequest setFetchLimit:PKExportBatchSize];
+    [fetchRequest setFetchBatchSize:PKExportBatchSize];
+    return fetchRequest;
+}
+
+// Objects created before their entity was mapped have no sync identifier yet. The identifiers are saved so the objects
+// keep their records, which also merges them into the managed object context. Only called on the queue of the context.
+- (BOOL)assignSyncIDsToManagedObjectsOfEntityName:(NSString *)entityName inManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    NSFetchRequest *fetchRequest = [[NSFetchRequest alloc] initWithEntityName:entityName];
+    [fetchRequest setIncludesSubentities:NO];
+    [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K == nil", self.syncAttributeName]];
+    [fetchRequest setResultType:NSManagedObjectIDResultType];
+    
+    NSError *error = nil;
+    NSArray *objectIDs = [managedObjectContext executeFetchRequest:fetchRequest error:&error];
+    if (!objectIDs) {
+        NSLog(@"Error executing fetch request: %@", error);
+        return NO;
+    }
+    
+    for (NSUInteger location = 0; location < [objectIDs count]; location += PKExportBatchSize) {
+        @autoreleasepool {
+            NSArray *batch = [objectIDs subarrayWithRange:NSMakeRange(location, MIN((NSUInteger)PKExportBatchSize, [objectIDs count] - location))];
+            NSMutableSet *managedObjects = [[NSMutableSet alloc] initWithCapacity:[batch count]];
+            for (NSManagedObjectID *objectID in batch) {
+                [managedObjects addObject:[managedObjectContext objectWithID:objectID]];
+            }
+            
+            for (NSManagedObject *managedObject in [self syncableManagedObjectsFromManagedObjects:managedObjects assigningSyncIDs:NO]) {
+                [managedObject setValue:[[self class] syncID] forKey:self.syncAttributeName];
+            }
+            
+            BOOL saved = [self saveSyncManagedObjectContext:managedObjectContext];
+            [managedObjectContext reset];
+            if (!saved) return NO;
+        }
+    }
+    return YES;
+}
+
+// Only called on the sync queue
+- (BOOL)writeExportCheckpoint:(NSDictionary *)checkpoint error:(NSError **)error
+{
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:checkpoint format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (!data) return NO;
+    
+    return [data writeToURL:self.exportCheckpointURL options:NSDataWritingAtomic error:error];
+}
+
+// Only called on the sync queue
+- (BOOL)readExportCheckpoint:(NSMutableDictionary *)checkpoint error:(NSError **)error
+{
+    NSData *data = [[NSData alloc] initWithContentsOfURL:self.exportCheckpointURL options:0 error:error];
+    if (!data) return NO;
+    
+    NSDictionary *syncIDsKeyedByEntityName = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:error];
+    if (![syncIDsKeyedByEntityName isKindOfClass:[NSDictionary class]]) return NO;
+    
+    [checkpoint addEntriesFromDictionary:syncIDsKeyedByEntityName];
+    return YES;
 }
 
 @end
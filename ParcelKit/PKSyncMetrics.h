@@ -0,0 +1,127 @@
+//
+//  PKSyncMetrics.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, PKSyncPhase) {
+    // Looking up the managed objects of records by their sync identifier
+    PKSyncPhaseLookup = 0,
+    // Copying records into managed objects and managed objects into records
+    PKSyncPhaseMapping,
+    // Validating inserted managed objects
+    PKSyncPhaseValidation,
+    // Saving the contexts incoming changes are applied in
+    PKSyncPhaseSave,
+    // Merging saved changes into the managed object context of the sync manager
+    PKSyncPhaseMerge,
+    // Syncing the DBDatastore
+    PKSyncPhaseDatastoreSync,
+    // The number of phases
+    PKSyncPhaseCount
+};
+
+// The number of buckets of a phase histogram
+#define PKSyncMetricsHistogramBucketCount 24
+
+/**
+ Metrics of a sync session, the work the sync manager does for one sync of the DBDatastore or one save of the
+ managed object context, including the syncs it takes.
+ 
+ Recording is thread safe and takes a few counters per phase, not per record, so metrics can be collected in
+ production builds.
+ */
+@interface PKSyncMetrics : NSObject
+
+/** The date the session started. */
+@property (nonatomic, strong, readonly) NSDate *startDate;
+
+/** The wall clock time the session took, “0” until it finished. */
+@property (nonatomic, readonly) NSTimeInterval duration;
+
+/** The number of incoming records applied to Core Data, keyed by table ID. */
+@property (nonatomic, copy, readonly) NSDictionary *numberOfRecordsInByTableID;
+
+/** The number of records written or deleted in the DBDatastore, keyed by table ID. */
+@property (nonatomic, copy, readonly) NSDictionary *numberOfRecordsOutByTableID;
+
+/** The number of incoming records applied to Core Data. */
+@property (nonatomic, readonly) NSUInteger numberOfRecordsIn;
+
+/** The number of records written or deleted in the DBDatastore. */
+@property (nonatomic, readonly) NSUInteger numberOfRecordsOut;
+
+/** The number of fetch and count requests executed. */
+@property (nonatomic, readonly) NSUInteger numberOfFetches;
+
+/** The size of the changes synced to the DBDatastore in bytes, including chunk records of binary data. */
+@property (nonatomic, readonly) unsigned long long bytesWritten;
+
+/**
+ Returns the time spent in a phase. Phases of concurrently applied tables overlap, so their sum can exceed the duration.
+ @param phase The phase.
+ @return The time spent in the phase in seconds.
+ */
+- (NSTimeInterval)timeInPhase:(PKSyncPhase)phase;
+
+/**
+ Returns how long the timed steps of a phase took, as the number of steps per bucket.
+ 
+ Bucket “n” counts steps of at least 2^n and less than 2^(n+1) microseconds, the first bucket also counts shorter steps
+ and the last one longer steps.
+ @param phase The phase.
+ @return An array of `PKSyncMetricsHistogramBucketCount` NSNumbers.
+ */
+- (NSArray *)histogramForPhase:(PKSyncPhase)phase;
+
+/** @name Recording Metrics */
+
+/**
+ Returns a monotonic timestamp in seconds to pass to `addTimeSince:toPhase:`.
+ */
++ (NSTimeInterval)timestamp;
+
+/**
+ Adds the time since the given timestamp to a phase as one step.
+ */
+- (void)addTimeSince:(NSTimeInterval)timestamp toPhase:(PKSyncPhase)phase;
+
+/** Adds incoming records of a table. */
+- (void)addRecordsIn:(NSUInteger)count tableID:(NSString *)tableID;
+
+/** Adds written or deleted records of a table. */
+- (void)addRecordsOut:(NSUInteger)count tableID:(NSString *)tableID;
+
+/** Adds executed fetch or count requests. */
+- (void)addFetches:(NSUInteger)count;
+
+/** Adds the size of synced changes in bytes. */
+- (void)addBytesWritten:(unsigned long long)bytes;
+
+/**
+ Ends the session and sets its duration.
+ */
+- (void)finish;
+
+@end
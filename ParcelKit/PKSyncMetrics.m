@@ -0,0 +1,200 @@
+//
+//  PKSyncMetrics.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKSyncMetrics.h"
+#include <mach/mach_time.h>
+
+@interface PKSyncMetrics ()
+@property (nonatomic, strong, readwrite) NSDate *startDate;
+@property (nonatomic, readwrite) NSTimeInterval duration;
+@property (nonatomic, strong) NSMutableDictionary *recordsIn;
+@property (nonatomic, strong) NSMutableDictionary *recordsOut;
+@property (nonatomic) NSTimeInterval startTimestamp;
+@end
+
+@implementation PKSyncMetrics
+{
+    NSUInteger _numberOfRecordsIn;
+    NSUInteger _numberOfRecordsOut;
+    NSUInteger _numberOfFetches;
+    unsigned long long _bytesWritten;
+    NSTimeInterval _phaseTimes[PKSyncPhaseCount];
+    NSUInteger _histograms[PKSyncPhaseCount][PKSyncMetricsHistogramBucketCount];
+}
+
++ (NSTimeInterval)timestamp
+{
+    static double secondsPerTick = 0.0;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = ((double)timebase.numer / (double)timebase.denom) / NSEC_PER_SEC;
+    });
+    return mach_absolute_time() * secondsPerTick;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _startDate = [NSDate date];
+        _startTimestamp = [[self class] timestamp];
+        _recordsIn = [[NSMutableDictionary alloc] init];
+        _recordsOut = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSDictionary *)numberOfRecordsInByTableID
+{
+    @synchronized(self) {
+        return [self.recordsIn copy];
+    }
+}
+
+- (NSDictionary *)numberOfRecordsOutByTableID
+{
+    @synchronized(self) {
+        return [self.recordsOut copy];
+    }
+}
+
+- (NSUInteger)numberOfRecordsIn
+{
+    @synchronized(self) {
+        return _numberOfRecordsIn;
+    }
+}
+
+- (NSUInteger)numberOfRecordsOut
+{
+    @synchronized(self) {
+        return _numberOfRecordsOut;
+    }
+}
+
+- (NSUInteger)numberOfFetches
+{
+    @synchronized(self) {
+        return _numberOfFetches;
+    }
+}
+
+- (unsigned long long)bytesWritten
+{
+    @synchronized(self) {
+        return _bytesWritten;
+    }
+}
+
+- (NSTimeInterval)timeInPhase:(PKSyncPhase)phase
+{
+    if (phase >= PKSyncPhaseCount) return 0.0;
+    @synchronized(self) {
+        return _phaseTimes[phase];
+    }
+}
+
+- (NSArray *)histogramForPhase:(PKSyncPhase)phase
+{
+    NSMutableArray *histogram = [[NSMutableArray alloc] initWithCapacity:PKSyncMetricsHistogramBucketCount];
+    @synchronized(self) {
+        for (NSUInteger bucket = 0; bucket < PKSyncMetricsHistogramBucketCount; bucket++) {
+            [histogram addObject:@(phase < PKSyncPhaseCount ? _histograms[phase][bucket] : 0)];
+        }
+    }
+    return histogram;
+}
+
+#pragma mark - Recording
+- (void)addTimeSince:(NSTimeInterval)timestamp toPhase:(PKSyncPhase)phase
+{
+    if (phase >= PKSyncPhaseCount) return;
+    NSTimeInterval time = MAX([[self class] timestamp] - timestamp, 0.0);
+    
+    // Bucket n holds steps of 2^n up to 2^(n+1) microseconds
+    NSUInteger bucket = 0;
+    unsigned long long microseconds = (unsigned long long)(time * USEC_PER_SEC);
+    while (microseconds > 1 && bucket < PKSyncMetricsHistogramBucketCount - 1) {
+        microseconds >>= 1;
+        bucket++;
+    }
+    
+    @synchronized(self) {
+        _phaseTimes[phase] += time;
+        _histograms[phase][bucket]++;
+    }
+}
+
+- (void)addRecordsIn:(NSUInteger)count tableID:(NSString *)tableID
+{
+    if (count == 0) return;
+    @synchronized(self) {
+        _numberOfRecordsIn += count;
+        [self.recordsIn setObject:@([[self.recordsIn objectForKey:tableID] unsignedIntegerValue] + count) forKey:tableID];
+    }
+}
+
+- (void)addRecordsOut:(NSUInteger)count tableID:(NSString *)tableID
+{
+    if (count == 0) return;
+    @synchronized(self) {
+        _numberOfRecordsOut += count;
+        [self.recordsOut setObject:@([[self.recordsOut objectForKey:tableID] unsignedIntegerValue] + count) forKey:tableID];
+    }
+}
+
+- (void)addFetches:(NSUInteger)count
+{
+    @synchronized(self) {
+        _numberOfFetches += count;
+    }
+}
+
+- (void)addBytesWritten:(unsigned long long)bytes
+{
+    @synchronized(self) {
+        _bytesWritten += bytes;
+    }
+}
+
+- (void)finish
+{
+    self.duration = [[self class] timestamp] - self.startTimestamp;
+}
+
+- (NSString *)description
+{
+    static NSString * const PKSyncPhaseNames[PKSyncPhaseCount] = {@"lookup", @"mapping", @"validation", @"save", @"merge", @"sync"};
+    
+    NSMutableString *description = [[NSMutableString alloc] initWithFormat:@"<%@: %p> %.3fs, %lu records in, %lu records out, %lu fetches, %llu bytes written", NSStringFromClass([self class]), self, self.duration, (unsigned long)self.numberOfRecordsIn, (unsigned long)self.numberOfRecordsOut, (unsigned long)self.numberOfFetches, self.bytesWritten];
+    for (NSUInteger phase = 0; phase < PKSyncPhaseCount; phase++) {
+        [description appendFormat:@", %@ %.3fs", PKSyncPhaseNames[phase], [self timeInPhase:phase]];
+    }
+    return description;
+}
+
+@end
@@ -0,0 +1,89 @@
+//
+//  PKSyncTracer.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+// Whether spans are recorded, only read through the macros below
+extern volatile int32_t PKSyncTracerEnabled;
+
+// Records the beginning of a span and returns its name, or NULL if the span was not recorded.
+// The name must be a string constant. Use PKTraceScope instead of calling this directly.
+extern const char *PKTraceBegin(const char *name, NSString *detail);
+
+// Records the end of the span begun with name.
+extern void PKTraceEnd(const char *name);
+
+// Ends the span of a PKTraceScope when it goes out of scope
+extern void PKTraceEndScope(const char **name);
+
+#define PKTraceConcat_(a, b) a##b
+#define PKTraceConcat(a, b) PKTraceConcat_(a, b)
+
+// Records a span from this point to the end of the enclosing scope, however the scope is left.
+// The detail, such as a record identifier, is only evaluated while tracing.
+#define PKTraceScope(name, detail) \
+    __attribute__((cleanup(PKTraceEndScope), unused)) const char *PKTraceConcat(PKTraceScopeName, __LINE__) = \
+    (PKSyncTracerEnabled ? PKTraceBegin(name, (detail)) : NULL)
+
+/**
+ Records spans of the work done by the sync manager and the record mapping categories, down to single records,
+ relationships and binary chunks, and writes them in the Chrome Trace Event format for `chrome://tracing` or other
+ trace viewers. Every span is tagged with the thread and dispatch queue it ran on.
+ 
+ Tracing is off by default. Each thread records into a buffer of its own without taking locks, so tracing changes the
+ timings it records as little as possible. Buffers grow in fixed size blocks until the trace is written. The events of
+ threads that exit are kept for the trace they belong to, and their buffers are reused by new threads afterwards.
+ */
+@interface PKSyncTracer : NSObject
+
+/**
+ Starts recording spans, discarding those of an earlier trace.
+ 
+ Must not be called while a trace is being written.
+ */
++ (void)startTracing;
+
+/**
+ Stops recording spans. Spans still open are left without an end.
+ */
++ (void)stopTracing;
+
+/**
+ Returns whether spans are being recorded.
+ @return `YES` between `startTracing` and `stopTracing`, otherwise `NO`.
+ */
++ (BOOL)isTracing;
+
+/**
+ Writes the recorded spans as a Chrome Trace Event JSON file.
+ 
+ Call after `stopTracing`, spans recorded while writing may be left out.
+ @param URL The file URL to write to.
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return `YES` if the trace was written, otherwise `NO`.
+ */
++ (BOOL)writeTraceToURL:(NSURL *)URL error:(NSError **)error;
+
+@end
@@ -0,0 +1,322 @@
+//
+//  PKSyncTracer.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "PKSyncTracer.h"
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// The number of events of a buffer block, blocks are never moved so they can be read while they are appended to
+#define PKTraceBlockCapacity 4096
+
+typedef struct {
+    const char *name;
+    const char *queueLabel;
+    CFTypeRef detail;
+    uint64_t time;
+    char phase;
+} PKTraceEvent;
+
+typedef struct PKTraceBlock {
+    PKTraceEvent events[PKTraceBlockCapacity];
+    volatile int32_t count;
+    struct PKTraceBlock * volatile next;
+} PKTraceBlock;
+
+typedef struct PKTraceLabel {
+    char *label;
+    struct PKTraceLabel *next;
+} PKTraceLabel;
+
+// Only the thread a buffer belongs to appends to it. Buffers outlive their threads so their events can still be written,
+// and are taken over by new threads once their events belong to an earlier trace.
+typedef struct PKTraceBuffer {
+    uint64_t threadID;
+    volatile int32_t generation;
+    volatile int32_t owned;
+    PKTraceBlock * volatile firstBlock;
+    PKTraceBlock *lastBlock;
+    PKTraceLabel *labels;
+    struct PKTraceBuffer *next;
+} PKTraceBuffer;
+
+volatile int32_t PKSyncTracerEnabled = 0;
+
+// Each trace is a generation, events of earlier generations are freed by their thread the next time it records
+static volatile int32_t PKTraceGeneration = 0;
+static uint64_t PKTraceStartTime = 0;
+static PKTraceBuffer * volatile PKTraceBuffers = NULL;
+static pthread_key_t PKTraceBufferKey;
+
+static void PKTraceFreeBlocks(PKTraceBuffer *buffer)
+{
+    PKTraceBlock *block = buffer->firstBlock;
+    buffer->firstBlock = NULL;
+    buffer->lastBlock = NULL;
+    while (block) {
+        for (int32_t i = 0; i < block->count; i++) {
+            if (block->events[i].detail) CFRelease(block->events[i].detail);
+        }
+        PKTraceBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    PKTraceLabel *label = buffer->labels;
+    buffer->labels = NULL;
+    while (label) {
+        PKTraceLabel *next = label->next;
+        free(label->label);
+        free(label);
+        label = next;
+    }
+}
+
+// Called when the thread of a buffer exits. Events of the current trace are kept until it is written.
+static void PKTraceReleaseBuffer(void *value)
+{
+    PKTraceBuffer *buffer = value;
+    if (buffer->generation != PKTraceGeneration) {
+        PKTraceFreeBlocks(buffer);
+    }
+    OSAtomicCompareAndSwap32Barrier(1, 0, &buffer->owned);
+}
+
+// Takes over the buffer of an exited thread whose events belong to an earlier trace
+static PKTraceBuffer *PKTraceReusableBuffer(int32_t generation)
+{
+    for (PKTraceBuffer *buffer = PKTraceBuffers; buffer; buffer = buffer->next) {
+        if (buffer->generation == generation) continue;
+        if (OSAtomicCompareAndSwap32Barrier(0, 1, &buffer->owned)) return buffer;
+    }
+    return NULL;
+}
+
+static PKTraceBuffer *PKTraceCurrentBuffer(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&PKTraceBufferKey, PKTraceReleaseBuffer);
+    });
+    
+    PKTraceBuffer *buffer = pthread_getspecific(PKTraceBufferKey);
+    if (!buffer) {
+        buffer = PKTraceReusableBuffer(PKTraceGeneration);
+        if (!buffer) {
+            buffer = calloc(1, sizeof(PKTraceBuffer));
+            if (!buffer) return NULL;
+            buffer->generation = PKTraceGeneration;
+            buffer->owned = 1;
+            
+            PKTraceBuffer *next = NULL;
+            do {
+                next = PKTraceBuffers;
+                buffer->next = next;
+            } while (!OSAtomicCompareAndSwapPtrBarrier(next, buffer, (void * volatile *)&PKTraceBuffers));
+        }
+        buffer->threadID = pthread_mach_thread_np(pthread_self());
+        pthread_setspecific(PKTraceBufferKey, buffer);
+    }
+    
+    int32_t generation = PKTraceGeneration;
+    if (buffer->generation != generation) {
+        PKTraceFreeBlocks(buffer);
+        OSMemoryBarrier();
+        buffer->generation = generation;
+    }
+    return buffer;
+}
+
+// Labels are copied once per buffer since queues may go away before the trace is written
+static const char *PKTraceQueueLabel(PKTraceBuffer *buffer)
+{
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    const char *queueLabel = dispatch_queue_get_label(dispatch_get_current_queue());
+#pragma clang diagnostic pop
+    if (!queueLabel) queueLabel = "";
+    
+    for (PKTraceLabel *label = buffer->labels; label; label = label->next) {
+        if (strcmp(label->label, queueLabel) == 0) return label->label;
+    }
+    
+    PKTraceLabel *label = calloc(1, sizeof(PKTraceLabel));
+    if (!label) return "";
+    label->label = strdup(queueLabel);
+    label->next = buffer->labels;
+    buffer->labels = label;
+    return label->label;
+}
+
+static void PKTraceRecord(const char *name, char phase, NSString *detail)
+{
+    uint64_t time = mach_absolute_time();
+    PKTraceBuffer *buffer = PKTraceCurrentBuffer();
+    if (!buffer) return;
+    
+    PKTraceBlock *block = buffer->lastBlock;
+    if (!block || block->count == PKTraceBlockCapacity) {
+        PKTraceBlock *newBlock = calloc(1, sizeof(PKTraceBlock));
+        if (!newBlock) return;
+        
+        // Readers only see the block once it is initialized
+        OSMemoryBarrier();
+        if (block) {
+            block->next = newBlock;
+        } else {
+            buffer->firstBlock = newBlock;
+        }
+        buffer->lastBlock = block = newBlock;
+    }
+    
+    PKTraceEvent *event = &block->events[block->count];
+    event->name = name;
+    event->queueLabel = PKTraceQueueLabel(buffer);
+    event->detail = (detail ? CFBridgingRetain([detail copy]) : NULL);
+    event->time = time;
+    event->phase = phase;
+    
+    // Readers only see the event once it is written
+    OSMemoryBarrier();
+    block->count++;
+}
+
+const char *PKTraceBegin(const char *name, NSString *detail)
+{
+    if (!PKSyncTracerEnabled) return NULL;
+    PKTraceRecord(name, 'B', detail);
+    return name;
+}
+
+void PKTraceEnd(const char *name)
+{
+    if (!PKSyncTracerEnabled) return;
+    PKTraceRecord(name, 'E', nil);
+}
+
+void PKTraceEndScope(const char **name)
+{
+    if (*name) PKTraceEnd(*name);
+}
+
+static void PKTraceAppendString(NSMutableData *data, const char *string)
+{
+    [data appendBytes:string length:strlen(string)];
+}
+
+static void PKTraceAppendJSONString(NSMutableData *data, const char *string)
+{
+    [data appendBytes:"\"" length:1];
+    for (const unsigned char *character = (const unsigned char *)string; *character; character++) {
+        if (*character == '"' || *character == '\\') {
+            char escaped[2] = {'\\', (char)*character};
+            [data appendBytes:escaped length:2];
+        } else if (*character < 0x20) {
+            char escaped[7];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *character);
+            [data appendBytes:escaped length:6];
+        } else {
+            [data appendBytes:character length:1];
+        }
+    }
+    [data appendBytes:"\"" length:1];
+}
+
+@implementation PKSyncTracer
+
++ (void)startTracing
+{
+    PKTraceStartTime = mach_absolute_time();
+    int32_t generation = OSAtomicIncrement32Barrier(&PKTraceGeneration);
+    
+    // Events of exited threads are freed now rather than when their buffer is taken over, which may never happen
+    for (PKTraceBuffer *buffer = PKTraceBuffers; buffer; buffer = buffer->next) {
+        if (buffer->generation == generation || !OSAtomicCompareAndSwap32Barrier(0, 1, &buffer->owned)) continue;
+        PKTraceFreeBlocks(buffer);
+        OSAtomicCompareAndSwap32Barrier(1, 0, &buffer->owned);
+    }
+    
+    OSAtomicCompareAndSwap32Barrier(0, 1, &PKSyncTracerEnabled);
+}
+
++ (void)stopTracing
+{
+    OSAtomicCompareAndSwap32Barrier(1, 0, &PKSyncTracerEnabled);
+}
+
++ (BOOL)isTracing
+{
+    return (PKSyncTracerEnabled != 0);
+}
+
++ (BOOL)writeTraceToURL:(NSURL *)URL error:(NSError **)error
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    int32_t generation = PKTraceGeneration;
+    int processID = getpid();
+    
+    NSMutableData *data = [[NSMutableData alloc] init];
+    PKTraceAppendString(data, "{\"traceEvents\":[");
+    BOOL first = YES;
+    char buffer[128];
+    
+    OSMemoryBarrier();
+    for (PKTraceBuffer *traceBuffer = PKTraceBuffers; traceBuffer; traceBuffer = traceBuffer->next) {
+        if (traceBuffer->generation != generation) continue;
+        
+        for (PKTraceBlock *block = traceBuffer->firstBlock; block; block = block->next) {
+            int32_t count = block->count;
+            OSMemoryBarrier();
+            for (int32_t i = 0; i < count; i++) {
+                PKTraceEvent *event = &block->events[i];
+                double timestamp = (double)(int64_t)(event->time - PKTraceStartTime) * timebase.numer / timebase.denom / NSEC_PER_USEC;
+                
+                PKTraceAppendString(data, (first ? "{\"name\":" : ",\n{\"name\":"));
+                first = NO;
+                PKTraceAppendJSONString(data, event->name);
+                snprintf(buffer, sizeof(buffer), ",\"cat\":\"ParcelKit\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%llu", event->phase, timestamp, processID, (unsigned long long)traceBuffer->threadID);
+                PKTraceAppendString(data, buffer);
+                
+                if (event->phase == 'B') {
+                    PKTraceAppendString(data, ",\"args\":{\"queue\":");
+                    PKTraceAppendJSONString(data, event->queueLabel);
+                    if (event->detail) {
+                        PKTraceAppendString(data, ",\"detail\":");
+                        PKTraceAppendJSONString(data, [(__bridge NSString *)event->detail UTF8String] ?: "");
+                    }
+                    PKTraceAppendString(data, "}");
+                }
+                PKTraceAppendString(data, "}");
+            }
+        }
+    }
+    PKTraceAppendString(data, "],\"displayTimeUnit\":\"ms\"}\n");
+    
+    return [data writeToURL:URL options:NSDataWritingAtomic error:error];
+}
+
+@end
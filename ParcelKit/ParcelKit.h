@@ -27,3 +27,10 @@
 #import <ParcelKit/PKSyncManager.h>
 #import <ParcelKit/NSManagedObject+ParcelKit.h>
 #import <ParcelKit/DBRecord+ParcelKit.h>
+#import <ParcelKit/NSManagedObjectContext+ParcelKit.h>
+#import <ParcelKit/PKSyncIndex.h>
+#import <ParcelKit/PKSyncMetrics.h>
+#import <ParcelKit/PKSyncTracer.h>
+#import <ParcelKit/PKChangeRecorder.h>
+#import <ParcelKit/PKEntitySyncPlan.h>
+#import <ParcelKit/PKCompression.h>
@@ -0,0 +1,105 @@
+//
+//  PKBenchmarkDataset.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+/** Synthetic books, authors and publishers of the Tests model.
+ 
+ Books are spread over authors by the fan-out, so every author has an ordered list of that many books. Binary covers
+ are filled with pseudo-random bytes that do not compress. The same dataset always generates the same records.
+ */
+@interface PKBenchmarkDataset : NSObject
+
+/** The number of books. */
+@property (nonatomic, readonly) NSUInteger numberOfBooks;
+
+/** The number of books of each author. */
+@property (nonatomic, readonly) NSUInteger fanOut;
+
+/** The length of each binary cover, in bytes. */
+@property (nonatomic, readonly) NSUInteger blobLength;
+
+/** The number of books with a binary cover. */
+@property (nonatomic, readonly) NSUInteger numberOfBlobs;
+
+/** The number of authors. */
+@property (nonatomic, readonly) NSUInteger numberOfAuthors;
+
+/** The number of publishers. */
+@property (nonatomic, readonly) NSUInteger numberOfPublishers;
+
+/** The number of books, authors and publishers. */
+@property (nonatomic, readonly) NSUInteger numberOfRecords;
+
+/**
+ Returns a dataset sized by the `PK_BENCHMARK_BOOKS`, `PK_BENCHMARK_FAN_OUT`, `PK_BENCHMARK_BLOB_LENGTH` and
+ `PK_BENCHMARK_BLOBS` environment variables, using defaults for the variables that are not set.
+ */
++ (instancetype)datasetWithEnvironment;
+
+/**
+ Designated initializer.
+ 
+ @param numberOfBooks The number of books
+ @param fanOut The number of books of each author
+ @param blobLength The length of each binary cover, in bytes
+ @param numberOfBlobs The number of books with a binary cover
+ */
+- (instancetype)initWithNumberOfBooks:(NSUInteger)numberOfBooks fanOut:(NSUInteger)fanOut blobLength:(NSUInteger)blobLength numberOfBlobs:(NSUInteger)numberOfBlobs;
+
+/** Returns the dataset's sizes keyed by name, for reporting. */
+- (NSDictionary *)configuration;
+
+/** Returns mock records of every book, author and publisher, keyed by the table IDs `books`, `authors` and `publishers`. */
+- (NSDictionary *)incomingChanges;
+
+/** Returns mock records of every author with the order of its books reversed, keyed by the table ID `authors`. */
+- (NSDictionary *)incomingReorderChanges;
+
+/**
+ Inserts every book, author and publisher into the managed object context without saving it.
+ 
+ @param managedObjectContext The managed object context to insert into
+ @param syncAttributeName The sync attribute set to each object's identifier
+ */
+- (void)insertManagedObjectsIntoManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncAttributeName:(NSString *)syncAttributeName;
+
+/**
+ Inserts the books with a binary cover into the managed object context without saving it, and returns them.
+ 
+ @param managedObjectContext The managed object context to insert into
+ @param syncAttributeName The sync attribute set to each object's identifier
+ */
+- (NSArray *)insertBooksWithCoversIntoManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncAttributeName:(NSString *)syncAttributeName;
+
+/**
+ Returns a cover of the dataset's blob length.
+ 
+ @param seed The seed of the cover's bytes; covers of the same seed are equal
+ */
+- (NSData *)coverWithSeed:(NSUInteger)seed;
+@end
@@ -0,0 +1,211 @@
+//
+//  PKBenchmarkDataset.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import "PKBenchmarkDataset.h"
+#import "PKRecordMock.h"
+#import "PKListMock.h"
+
+static const NSUInteger PKBenchmarkDefaultNumberOfBooks = 5000;
+static const NSUInteger PKBenchmarkDefaultFanOut = 10;
+static const NSUInteger PKBenchmarkDefaultBlobLength = 256 * 1024;
+static const NSUInteger PKBenchmarkDefaultNumberOfBlobs = 20;
+static const NSUInteger PKBenchmarkBooksPerPublisher = 100;
+
+static NSUInteger PKBenchmarkEnvironmentValue(NSString *name, NSUInteger defaultValue)
+{
+    NSInteger value = [[[[NSProcessInfo processInfo] environment] objectForKey:name] integerValue];
+    return value > 0 ? (NSUInteger)value : defaultValue;
+}
+
+@implementation PKBenchmarkDataset
+
++ (instancetype)datasetWithEnvironment
+{
+    return [[self alloc] initWithNumberOfBooks:PKBenchmarkEnvironmentValue(@"PK_BENCHMARK_BOOKS", PKBenchmarkDefaultNumberOfBooks)
+                                        fanOut:PKBenchmarkEnvironmentValue(@"PK_BENCHMARK_FAN_OUT", PKBenchmarkDefaultFanOut)
+                                    blobLength:PKBenchmarkEnvironmentValue(@"PK_BENCHMARK_BLOB_LENGTH", PKBenchmarkDefaultBlobLength)
+                                 numberOfBlobs:PKBenchmarkEnvironmentValue(@"PK_BENCHMARK_BLOBS", PKBenchmarkDefaultNumberOfBlobs)];
+}
+
+- (instancetype)initWithNumberOfBooks:(NSUInteger)numberOfBooks fanOut:(NSUInteger)fanOut blobLength:(NSUInteger)blobLength numberOfBlobs:(NSUInteger)numberOfBlobs
+{
+    self = [super init];
+    if (self) {
+        _numberOfBooks = MAX(numberOfBooks, (NSUInteger)1);
+        _fanOut = MAX(fanOut, (NSUInteger)1);
+        _blobLength = blobLength;
+        _numberOfBlobs = MIN(numberOfBlobs, _numberOfBooks);
+        _numberOfAuthors = (_numberOfBooks + _fanOut - 1) / _fanOut;
+        _numberOfPublishers = (_numberOfBooks + PKBenchmarkBooksPerPublisher - 1) / PKBenchmarkBooksPerPublisher;
+    }
+    return self;
+}
+
+- (NSUInteger)numberOfRecords
+{
+    return self.numberOfBooks + self.numberOfAuthors + self.numberOfPublishers;
+}
+
+- (NSDictionary *)configuration
+{
+    return @{@"books": @(self.numberOfBooks), @"authors": @(self.numberOfAuthors), @"publishers": @(self.numberOfPublishers), @"fanOut": @(self.fanOut), @"blobLength": @(self.blobLength), @"blobs": @(self.numberOfBlobs)};
+}
+
+#pragma mark - Identifiers
+
+- (NSString *)bookIDAtIndex:(NSUInteger)index
+{
+    return [NSString stringWithFormat:@"book-%lu", (unsigned long)index];
+}
+
+- (NSString *)authorIDAtIndex:(NSUInteger)index
+{
+    return [NSString stringWithFormat:@"author-%lu", (unsigned long)index];
+}
+
+- (NSString *)publisherIDAtIndex:(NSUInteger)index
+{
+    return [NSString stringWithFormat:@"publisher-%lu", (unsigned long)index];
+}
+
+- (NSRange)bookRangeOfAuthorAtIndex:(NSUInteger)index
+{
+    NSUInteger location = index * self.fanOut;
+    return NSMakeRange(location, MIN(self.fanOut, self.numberOfBooks - location));
+}
+
+- (NSDictionary *)bookFieldsAtIndex:(NSUInteger)index
+{
+    return @{@"title": [NSString stringWithFormat:@"Book %lu", (unsigned long)index],
+             @"pageCount": @(100 + index % 400),
+             @"averageRating": @((index % 50) / 10.0),
+             @"publishedDate": [NSDate dateWithTimeIntervalSince1970:1000000000.0 + index * 86400.0]};
+}
+
+#pragma mark - Records
+
+- (NSArray *)authorRecordsReversingBooks:(BOOL)reversingBooks
+{
+    NSMutableArray *authors = [[NSMutableArray alloc] initWithCapacity:self.numberOfAuthors];
+    for (NSUInteger i = 0; i < self.numberOfAuthors; i++) {
+        NSRange range = [self bookRangeOfAuthorAtIndex:i];
+        NSMutableArray *bookIDs = [[NSMutableArray alloc] initWithCapacity:range.length];
+        for (NSUInteger j = range.location; j < NSMaxRange(range); j++) {
+            [bookIDs addObject:[self bookIDAtIndex:j]];
+        }
+        if (reversingBooks) {
+            bookIDs = [[[bookIDs reverseObjectEnumerator] allObjects] mutableCopy];
+        }
+        
+        NSDictionary *fields = @{@"name": [NSString stringWithFormat:@"Author %lu", (unsigned long)i], @"royalties": @(i * 10.0), @"books": [[PKListMock alloc] initWithValues:bookIDs]};
+        [authors addObject:[PKRecordMock record:[self authorIDAtIndex:i] withFields:fields]];
+    }
+    return authors;
+}
+
+- (NSDictionary *)incomingChanges
+{
+    NSMutableArray *books = [[NSMutableArray alloc] initWithCapacity:self.numberOfBooks];
+    for (NSUInteger i = 0; i < self.numberOfBooks; i++) {
+        NSMutableDictionary *fields = [[self bookFieldsAtIndex:i] mutableCopy];
+        [fields setObject:[[PKListMock alloc] initWithValues:@[[self authorIDAtIndex:i / self.fanOut]]] forKey:@"authors"];
+        [fields setObject:[self publisherIDAtIndex:i / PKBenchmarkBooksPerPublisher] forKey:@"publisher"];
+        [books addObject:[PKRecordMock record:[self bookIDAtIndex:i] withFields:fields]];
+    }
+    
+    NSMutableArray *publishers = [[NSMutableArray alloc] initWithCapacity:self.numberOfPublishers];
+    for (NSUInteger i = 0; i < self.numberOfPublishers; i++) {
+        [publishers addObject:[PKRecordMock record:[self publisherIDAtIndex:i] withFields:@{@"name": [NSString stringWithFormat:@"Publisher %lu", (unsigned long)i]}]];
+    }
+    
+    return @{@"books": books, @"authors": [self authorRecordsReversingBooks:NO], @"publishers": publishers};
+}
+
+- (NSDictionary *)incomingReorderChanges
+{
+    return @{@"authors": [self authorRecordsReversingBooks:YES]};
+}
+
+#pragma mark - Managed Objects
+
+- (void)insertManagedObjectsIntoManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncAttributeName:(NSString *)syncAttributeName
+{
+    NSMutableArray *publishers = [[NSMutableArray alloc] initWithCapacity:self.numberOfPublishers];
+    for (NSUInteger i = 0; i < self.numberOfPublishers; i++) {
+        NSManagedObject *publisher = [NSEntityDescription insertNewObjectForEntityForName:@"Publisher" inManagedObjectContext:managedObjectContext];
+        [publisher setValue:[self publisherIDAtIndex:i] forKey:syncAttributeName];
+        [publisher setValue:[NSString stringWithFormat:@"Publisher %lu", (unsigned long)i] forKey:@"name"];
+        [publishers addObject:publisher];
+    }
+    
+    NSMutableOrderedSet *authorBooks = nil;
+    for (NSUInteger i = 0; i < self.numberOfBooks; i++) {
+        if (i % self.fanOut == 0) {
+            NSUInteger authorIndex = i / self.fanOut;
+            NSManagedObject *author = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:managedObjectContext];
+            [author setValue:[self authorIDAtIndex:authorIndex] forKey:syncAttributeName];
+            [author setValue:[NSString stringWithFormat:@"Author %lu", (unsigned long)authorIndex] forKey:@"name"];
+            [author setValue:@(authorIndex * 10.0) forKey:@"royalties"];
+            authorBooks = [author mutableOrderedSetValueForKey:@"books"];
+        }
+        
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:managedObjectContext];
+        [book setValue:[self bookIDAtIndex:i] forKey:syncAttributeName];
+        [book setValuesForKeysWithDictionary:[self bookFieldsAtIndex:i]];
+        [book setValue:[publishers objectAtIndex:i / PKBenchmarkBooksPerPublisher] forKey:@"publisher"];
+        [authorBooks addObject:book];
+    }
+}
+
+- (NSArray *)insertBooksWithCoversIntoManagedObjectContext:(NSManagedObjectContext *)managedObjectContext syncAttributeName:(NSString *)syncAttributeName
+{
+    NSMutableArray *books = [[NSMutableArray alloc] initWithCapacity:self.numberOfBlobs];
+    for (NSUInteger i = 0; i < self.numberOfBlobs; i++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:managedObjectContext];
+        [book setValue:[self bookIDAtIndex:i] forKey:syncAttributeName];
+        [book setValuesForKeysWithDictionary:[self bookFieldsAtIndex:i]];
+        [book setValue:[self coverWithSeed:i] forKey:@"cover"];
+        [books addObject:book];
+    }
+    return books;
+}
+
+- (NSData *)coverWithSeed:(NSUInteger)seed
+{
+    // Xorshift bytes, so covers are neither compressible nor made of repeated chunks
+    NSMutableData *cover = [[NSMutableData alloc] initWithLength:self.blobLength];
+    uint8_t *bytes = [cover mutableBytes];
+    uint32_t state = ((uint32_t)seed * 2654435761u) | 1;
+    for (NSUInteger i = 0; i < self.blobLength; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        bytes[i] = (uint8_t)state;
+    }
+    return cover;
+}
+
+@end
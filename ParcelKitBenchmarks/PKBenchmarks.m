@@ -0,0 +1,424 @@
+//
+//  PKBenchmarks.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <XCTest/XCTest.h>
+#import <mach/mach.h>
+#import "NSManagedObjectContext+ParcelKitTests.h"
+#import "PKSyncManager.h"
+#import "PKSyncMetrics.h"
+#import "PKChangeRecorder.h"
+#import "PKDatastoreMock.h"
+#import "PKBenchmarkDataset.h"
+#import "PKChangeReplayer.h"
+
+static const NSUInteger PKBenchmarkDefaultIterations = 5;
+static const uint64_t PKBenchmarkMemorySamplingInterval = 5 * NSEC_PER_MSEC;
+static NSString * const PKBenchmarkResultsFileName = @"ParcelKitBenchmarks.json";
+
+// Results of every benchmark run by this process, written when the suite finishes
+static NSMutableArray *PKBenchmarkResults = nil;
+
+typedef void (^PKBenchmarkBlock)(void);
+
+@interface PKSyncManager (ParcelKitBenchmarks)
+- (BOOL)updateCoreDataWithDatastoreChanges:(NSDictionary *)changes;
+- (dispatch_queue_t)syncQueue;
+@end
+
+static uint64_t PKBenchmarkResidentSize(void)
+{
+    struct task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+}
+
+#pragma mark - Memory Sampler
+
+// Samples the resident size of the process on its own queue while a benchmark runs
+@interface PKBenchmarkMemorySampler : NSObject
+@property (nonatomic, readonly) uint64_t initialResidentSize;
+@property (nonatomic, readonly) uint64_t peakResidentSize;
+- (void)start;
+- (void)stop;
+@end
+
+@interface PKBenchmarkMemorySampler ()
+@property (nonatomic, readwrite) uint64_t initialResidentSize;
+@property (nonatomic, readwrite) uint64_t peakResidentSize;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_source_t timer;
+@end
+
+@implementation PKBenchmarkMemorySampler
+
+- (void)sample
+{
+    self.peakResidentSize = MAX(self.peakResidentSize, PKBenchmarkResidentSize());
+}
+
+- (void)start
+{
+    self.queue = dispatch_queue_create("com.overcommittedapps.parcelkit.benchmarks.memory", DISPATCH_QUEUE_SERIAL);
+    self.initialResidentSize = PKBenchmarkResidentSize();
+    self.peakResidentSize = self.initialResidentSize;
+    
+    __weak typeof(self) weakSelf = self;
+    self.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+    dispatch_source_set_timer(self.timer, dispatch_time(DISPATCH_TIME_NOW, 0), PKBenchmarkMemorySamplingInterval, PKBenchmarkMemorySamplingInterval / 10);
+    dispatch_source_set_event_handler(self.timer, ^{
+        [weakSelf sample];
+    });
+    dispatch_resume(self.timer);
+}
+
+- (void)stop
+{
+    dispatch_source_cancel(self.timer);
+    self.timer = nil;
+    dispatch_sync(self.queue, ^{
+        [self sample];
+    });
+}
+
+@end
+
+#pragma mark - Benchmarks
+
+@interface PKBenchmarks : XCTestCase
+@property (strong, nonatomic) PKBenchmarkDataset *dataset;
+@property (strong, nonatomic) NSManagedObjectContext *managedObjectContext;
+@property (strong, nonatomic) PKSyncManager *syncManager;
+@property (strong, nonatomic) NSURL *scratchStoreURL;
+@end
+
+@implementation PKBenchmarks
+
++ (NSUInteger)numberOfIterations
+{
+    NSInteger iterations = [[[[NSProcessInfo processInfo] environment] objectForKey:@"PK_BENCHMARK_ITERATIONS"] integerValue];
+    return iterations > 0 ? (NSUInteger)iterations : PKBenchmarkDefaultIterations;
+}
+
++ (NSURL *)resultsURL
+{
+    NSString *path = [[[NSProcessInfo processInfo] environment] objectForKey:@"PK_BENCHMARK_OUTPUT"];
+    if (!path) path = [NSTemporaryDirectory() stringByAppendingPathComponent:PKBenchmarkResultsFileName];
+    return [NSURL fileURLWithPath:path];
+}
+
++ (void)setUp
+{
+    [super setUp];
+    PKBenchmarkResults = [[NSMutableArray alloc] init];
+}
+
++ (void)tearDown
+{
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    [dateFormatter setLocale:[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"]];
+    [dateFormatter setTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+    [dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss'Z'"];
+    
+    NSMutableDictionary *configuration = [[[PKBenchmarkDataset datasetWithEnvironment] configuration] mutableCopy];
+    [configuration setObject:@([self numberOfIterations]) forKey:@"iterations"];
+    
+    NSDictionary *report = @{@"date": [dateFormatter stringFromDate:[NSDate date]],
+                             @"device": [[UIDevice currentDevice] model],
+                             @"systemVersion": [[UIDevice currentDevice] systemVersion],
+                             @"configuration": configuration,
+                             @"benchmarks": PKBenchmarkResults};
+    
+    NSError *error = nil;
+    NSData *data = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+    if (!data) {
+        NSLog(@"Error serializing benchmark results: %@", error);
+    } else {
+        // The results are logged as well, as the file of a test run on a device or simulator can be hard to get at
+        NSLog(@"Benchmark results:\n%@", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]);
+        if (![data writeToURL:[self resultsURL] options:NSDataWritingAtomic error:&error]) {
+            NSLog(@"Error writing benchmark results: %@", error);
+        }
+    }
+    
+    PKBenchmarkResults = nil;
+    [super tearDown];
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.dataset = [PKBenchmarkDataset datasetWithEnvironment];
+}
+
+- (void)tearDown
+{
+    [self tearDownSyncManager];
+    [super tearDown];
+}
+
+- (void)setUpSyncManager
+{
+    self.managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+    self.syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:self.managedObjectContext datastore:(DBDatastore *)[[PKDatastoreMock alloc] init]];
+    [self.syncManager setTablesForEntityNamesWithDictionary:@{@"Book": @"books", @"Author": @"authors", @"Publisher": @"publishers"}];
+}
+
+- (void)tearDownSyncManager
+{
+    [self.syncManager stopObserving];
+    self.syncManager = nil;
+    self.managedObjectContext = nil;
+    
+    if (self.scratchStoreURL) {
+        NSFileManager *fileManager = [[NSFileManager alloc] init];
+        for (NSString *suffix in @[@"", @"-wal", @"-shm"]) {
+            [fileManager removeItemAtPath:[[self.scratchStoreURL path] stringByAppendingString:suffix] error:nil];
+        }
+        self.scratchStoreURL = nil;
+    }
+}
+
+// Saves are written to the datastore on the sync queue once they went through, so the save waits for it to be timed
+- (void)saveManagedObjectContextAndWaitForSyncQueue
+{
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    dispatch_sync([self.syncManager syncQueue], ^{});
+}
+
+// A managed object context of a new SQLite store, as replayed workloads depend on the cost of fetching from disk
+- (NSManagedObjectContext *)scratchManagedObjectContextWithModel:(NSManagedObjectModel *)managedObjectModel
+{
+    self.scratchStoreURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension:@"sqlite"]]];
+    
+    NSError *error = nil;
+    NSPersistentStoreCoordinator *persistentStoreCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:managedObjectModel];
+    XCTAssertNotNil([persistentStoreCoordinator addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:self.scratchStoreURL options:nil error:&error], @"%@", error);
+    
+    NSManagedObjectContext *managedObjectContext = [[NSManagedObjectContext alloc] init];
+    [managedObjectContext setPersistentStoreCoordinator:persistentStoreCoordinator];
+    return managedObjectContext;
+}
+
+// Runs the block returned by the setup block once per iteration, timing it and sampling the resident size while it runs.
+// Each iteration gets a new sync manager, which the setup block prepares outside of the measurement.
+- (void)measureBenchmark:(NSString *)name numberOfRecords:(NSUInteger)numberOfRecords numberOfBytes:(unsigned long long)numberOfBytes setUpBlock:(PKBenchmarkBlock (^)(void))setUpBlock
+{
+    NSUInteger iterations = [[self class] numberOfIterations];
+    NSMutableArray *durations = [[NSMutableArray alloc] initWithCapacity:iterations];
+    uint64_t peakResidentSize = 0;
+    uint64_t peakResidentSizeGrowth = 0;
+    
+    for (NSUInteger i = 0; i < iterations; i++) {
+        @autoreleasepool {
+            [self setUpSyncManager];
+            PKBenchmarkBlock block = setUpBlock();
+            
+            PKBenchmarkMemorySampler *sampler = [[PKBenchmarkMemorySampler alloc] init];
+            [sampler start];
+            NSTimeInterval timestamp = [PKSyncMetrics timestamp];
+            block();
+            [durations addObject:@([PKSyncMetrics timestamp] - timestamp)];
+            [sampler stop];
+            
+            peakResidentSize = MAX(peakResidentSize, sampler.peakResidentSize);
+            peakResidentSizeGrowth = MAX(peakResidentSizeGrowth, sampler.peakResidentSize - sampler.initialResidentSize);
+            [self tearDownSyncManager];
+        }
+    }
+    
+    [durations sortUsingSelector:@selector(compare:)];
+    NSTimeInterval medianDuration = [[durations objectAtIndex:[durations count] / 2] doubleValue];
+    NSTimeInterval bestDuration = [[durations objectAtIndex:0] doubleValue];
+    
+    NSMutableDictionary *result = [@{@"name": name,
+                                     @"records": @(numberOfRecords),
+                                     @"iterations": @(iterations),
+                                     @"medianSeconds": @(medianDuration),
+                                     @"bestSeconds": @(bestDuration),
+                                     @"recordsPerSecond": @(medianDuration > 0 ? numberOfRecords / medianDuration : 0),
+                                     @"peakResidentBytes": @(peakResidentSize),
+                                     @"peakResidentGrowthBytes": @(peakResidentSizeGrowth)} mutableCopy];
+    if (numberOfBytes > 0) {
+        [result setObject:@(numberOfBytes) forKey:@"bytes"];
+        [result setObject:@(medianDuration > 0 ? numberOfBytes / medianDuration : 0) forKey:@"bytesPerSecond"];
+    }
+    [PKBenchmarkResults addObject:result];
+    
+    NSLog(@"%@: %.0f records/s, peak resident size %llu KB (+%llu KB)", name, [[result objectForKey:@"recordsPerSecond"] doubleValue], peakResidentSize / 1024, peakResidentSizeGrowth / 1024);
+}
+
+#pragma mark - Incoming Apply
+
+- (void)testIncomingInsert
+{
+    NSDictionary *changes = [self.dataset incomingChanges];
+    [self measureBenchmark:@"incomingInsert" numberOfRecords:self.dataset.numberOfRecords numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        return ^{
+            XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:changes], @"");
+        };
+    }];
+}
+
+- (void)testIncomingUpdate
+{
+    NSDictionary *changes = [self.dataset incomingChanges];
+    [self measureBenchmark:@"incomingUpdate" numberOfRecords:self.dataset.numberOfRecords numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:changes], @"");
+        return ^{
+            XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:changes], @"");
+        };
+    }];
+}
+
+#pragma mark - Outgoing Save
+
+- (void)testOutgoingSave
+{
+    [self measureBenchmark:@"outgoingSave" numberOfRecords:self.dataset.numberOfRecords numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        [self.syncManager startObserving];
+        [self.dataset insertManagedObjectsIntoManagedObjectContext:self.managedObjectContext syncAttributeName:self.syncManager.syncAttributeName];
+        return ^{
+            [self saveManagedObjectContextAndWaitForSyncQueue];
+        };
+    }];
+}
+
+#pragma mark - Binary Chunking
+
+- (void)testBinaryChunkingInsert
+{
+    unsigned long long numberOfBytes = (unsigned long long)self.dataset.numberOfBlobs * self.dataset.blobLength;
+    [self measureBenchmark:@"binaryChunkingInsert" numberOfRecords:self.dataset.numberOfBlobs numberOfBytes:numberOfBytes setUpBlock:^PKBenchmarkBlock{
+        [self.syncManager startObserving];
+        [self.dataset insertBooksWithCoversIntoManagedObjectContext:self.managedObjectContext syncAttributeName:self.syncManager.syncAttributeName];
+        return ^{
+            [self saveManagedObjectContextAndWaitForSyncQueue];
+        };
+    }];
+}
+
+- (void)testBinaryChunkingEdit
+{
+    // A few bytes are inserted into the middle of every cover, so most of its chunks are unchanged
+    unsigned long long numberOfBytes = (unsigned long long)self.dataset.numberOfBlobs * self.dataset.blobLength;
+    [self measureBenchmark:@"binaryChunkingEdit" numberOfRecords:self.dataset.numberOfBlobs numberOfBytes:numberOfBytes setUpBlock:^PKBenchmarkBlock{
+        [self.syncManager startObserving];
+        NSArray *books = [self.dataset insertBooksWithCoversIntoManagedObjectContext:self.managedObjectContext syncAttributeName:self.syncManager.syncAttributeName];
+        [self saveManagedObjectContextAndWaitForSyncQueue];
+        
+        static const char insertedBytes[] = "ParcelKit";
+        for (NSManagedObject *book in books) {
+            NSMutableData *cover = [[book valueForKey:@"cover"] mutableCopy];
+            [cover replaceBytesInRange:NSMakeRange([cover length] / 2, 0) withBytes:insertedBytes length:sizeof(insertedBytes)];
+            [book setValue:cover forKey:@"cover"];
+        }
+        return ^{
+            [self saveManagedObjectContextAndWaitForSyncQueue];
+        };
+    }];
+}
+
+#pragma mark - Ordered List Reorders
+
+- (void)testOutgoingReorder
+{
+    // Every author's last book is moved to the front
+    [self measureBenchmark:@"outgoingReorder" numberOfRecords:self.dataset.numberOfAuthors numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        [self.syncManager startObserving];
+        [self.dataset insertManagedObjectsIntoManagedObjectContext:self.managedObjectContext syncAttributeName:self.syncManager.syncAttributeName];
+        [self saveManagedObjectContextAndWaitForSyncQueue];
+        
+        NSArray *authors = [self.managedObjectContext executeFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Author"] error:nil];
+        for (NSManagedObject *author in authors) {
+            NSMutableOrderedSet *books = [author mutableOrderedSetValueForKey:@"books"];
+            [books moveObjectsAtIndexes:[NSIndexSet indexSetWithIndex:[books count] - 1] toIndex:0];
+        }
+        return ^{
+            [self saveManagedObjectContextAndWaitForSyncQueue];
+        };
+    }];
+}
+
+- (void)testIncomingReorder
+{
+    NSDictionary *changes = [self.dataset incomingChanges];
+    NSDictionary *reorderChanges = [self.dataset incomingReorderChanges];
+    [self measureBenchmark:@"incomingReorder" numberOfRecords:self.dataset.numberOfAuthors numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:changes], @"");
+        return ^{
+            XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:reorderChanges], @"");
+        };
+    }];
+}
+
+#pragma mark - Replay
+
+- (NSURL *)recordingURLOfSyntheticDataset
+{
+    NSURL *URL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]]];
+    PKChangeRecorder *recorder = [[PKChangeRecorder alloc] initWithURL:URL tablesByEntityName:@{@"Book": @"books", @"Author": @"authors", @"Publisher": @"publishers"} syncAttributeName:PKDefaultSyncAttributeName];
+    
+    NSError *error = nil;
+    XCTAssertTrue([recorder recordChanges:[self.dataset incomingChanges] error:&error], @"%@", error);
+    XCTAssertTrue([recorder recordChanges:[self.dataset incomingReorderChanges] error:&error], @"%@", error);
+    return URL;
+}
+
+- (void)testReplay
+{
+    // Replays the recording at PK_BENCHMARK_REPLAY with the compiled model at PK_BENCHMARK_REPLAY_MODEL when set,
+    // otherwise a recording of the synthetic dataset followed by its reorders with the Tests model
+    NSDictionary *environment = [[NSProcessInfo processInfo] environment];
+    NSString *recordingPath = [environment objectForKey:@"PK_BENCHMARK_REPLAY"];
+    NSURL *recordingURL = (recordingPath ? [NSURL fileURLWithPath:recordingPath] : [self recordingURLOfSyntheticDataset]);
+    
+    NSString *modelPath = [environment objectForKey:@"PK_BENCHMARK_REPLAY_MODEL"];
+    NSManagedObjectModel *managedObjectModel = nil;
+    if (modelPath) {
+        managedObjectModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:[NSURL fileURLWithPath:modelPath]];
+    } else {
+        managedObjectModel = [[[NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"] persistentStoreCoordinator] managedObjectModel];
+    }
+    XCTAssertNotNil(managedObjectModel, @"");
+    
+    NSError *error = nil;
+    PKChangeReplayer *replayer = [[PKChangeReplayer alloc] initWithContentsOfURL:recordingURL error:&error];
+    if (!recordingPath) [[NSFileManager defaultManager] removeItemAtURL:recordingURL error:nil];
+    XCTAssertNotNil(replayer, @"%@", error);
+    if (!replayer || !managedObjectModel) return;
+    
+    [self measureBenchmark:@"replay" numberOfRecords:replayer.numberOfRecords numberOfBytes:0 setUpBlock:^PKBenchmarkBlock{
+        [self tearDownSyncManager];
+        self.managedObjectContext = [self scratchManagedObjectContextWithModel:managedObjectModel];
+        self.syncManager = [replayer syncManagerWithManagedObjectContext:self.managedObjectContext];
+        return ^{
+            [replayer replayWithSyncManager:self.syncManager];
+        };
+    }];
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  PKChangeReplayer.h
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+@class PKSyncManager;
+
+/**
+ Replays a `PKChangeRecorder` recording through a `PKDatastoreMock`, applying each change set with the sync manager
+ as fast as it can, as if the datastore had reported incoming changes.
+ 
+ The recording is read and turned into mock records up front so replaying measures the sync manager only.
+ */
+@interface PKChangeReplayer : NSObject
+
+/** The DBDatastore table IDs of the recorded entities, keyed by entity name. */
+@property (nonatomic, copy, readonly) NSDictionary *tablesByEntityName;
+
+/** The sync attribute name of the recorded entities. */
+@property (nonatomic, copy, readonly) NSString *syncAttributeName;
+
+/** The number of recorded change sets. */
+@property (nonatomic, readonly) NSUInteger numberOfChangeSets;
+
+/** The number of records of every recorded change set. */
+@property (nonatomic, readonly) NSUInteger numberOfRecords;
+
+/**
+ Reads a recording.
+ 
+ @param URL The file URL of the recording
+ @param error If an error occurs, upon return contains an NSError object that describes the problem.
+ @return The replayer, or nil if the recording couldn't be read.
+ */
+- (instancetype)initWithContentsOfURL:(NSURL *)URL error:(NSError **)error;
+
+/**
+ Returns a sync manager of a new `PKDatastoreMock` with the recorded tables and sync attribute name.
+ 
+ @param managedObjectContext The managed object context of a scratch store with the recorded entities
+ */
+- (PKSyncManager *)syncManagerWithManagedObjectContext:(NSManagedObjectContext *)managedObjectContext;
+
+/**
+ Feeds every recorded change set to the sync manager's `PKDatastoreMock` in order, waiting for each to be applied and
+ merged before the next. Must be called on the main thread.
+ 
+ @param syncManager A sync manager returned by `syncManagerWithManagedObjectContext:`
+ */
+- (void)replayWithSyncManager:(PKSyncManager *)syncManager;
+
+@end
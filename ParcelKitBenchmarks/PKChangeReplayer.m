@@ -0,0 +1,171 @@
+//
+//  PKChangeReplayer.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import "PKChangeReplayer.h"
+#import "PKChangeRecorder.h"
+#import "PKSyncManager.h"
+#import "PKDatastoreMock.h"
+#import "PKDatastoreStatusMock.h"
+#import "PKTableMock.h"
+#import "PKRecordMock.h"
+#import "PKListMock.h"
+
+@interface PKSyncManager (ParcelKitReplay)
+- (dispatch_queue_t)syncQueue;
+@end
+
+@interface PKChangeReplayer ()
+@property (nonatomic, copy, readwrite) NSDictionary *tablesByEntityName;
+@property (nonatomic, copy, readwrite) NSString *syncAttributeName;
+@property (nonatomic, readwrite) NSUInteger numberOfRecords;
+@property (nonatomic, strong) NSArray *changeSets;
+@property (nonatomic, strong) NSSet *tableIDs;
+@end
+
+// Turns recorded record dictionaries back into mock records, with the values of lists as mock lists
+static NSArray *PKChangeReplayerRecordsWithRecordDictionaries(NSArray *recordDictionaries)
+{
+    NSMutableArray *records = [[NSMutableArray alloc] initWithCapacity:[recordDictionaries count]];
+    for (NSDictionary *recordDictionary in recordDictionaries) {
+        NSString *recordID = [recordDictionary objectForKey:PKChangeRecorderRecordIDKey];
+        if ([[recordDictionary objectForKey:PKChangeRecorderDeletedKey] boolValue]) {
+            [records addObject:[PKRecordMock record:recordID withFields:nil deleted:YES]];
+            continue;
+        }
+        
+        NSMutableDictionary *fields = [[recordDictionary objectForKey:PKChangeRecorderFieldsKey] mutableCopy];
+        for (NSString *name in [fields allKeys]) {
+            id value = [fields objectForKey:name];
+            if ([value isKindOfClass:[NSArray class]]) {
+                [fields setObject:[[PKListMock alloc] initWithValues:value] forKey:name];
+            }
+        }
+        [records addObject:[PKRecordMock record:recordID withFields:fields]];
+    }
+    return records;
+}
+
+@implementation PKChangeReplayer
+
+- (instancetype)initWithContentsOfURL:(NSURL *)URL error:(NSError **)error
+{
+    PKChangeRecorder *recorder = [PKChangeRecorder recorderWithContentsOfURL:URL error:error];
+    if (!recorder) return nil;
+    
+    NSMutableArray *changeSets = [[NSMutableArray alloc] init];
+    NSMutableSet *tableIDs = [[NSMutableSet alloc] init];
+    __block NSUInteger numberOfRecords = 0;
+    BOOL read = [recorder enumerateChangeSetsUsingBlock:^(NSDictionary *recordedChanges, NSDate *date, BOOL *stop) {
+        NSMutableDictionary *changes = [[NSMutableDictionary alloc] initWithCapacity:[recordedChanges count]];
+        [recordedChanges enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *recordDictionaries, BOOL *stopTables) {
+            NSArray *records = PKChangeReplayerRecordsWithRecordDictionaries(recordDictionaries);
+            [changes setObject:records forKey:tableID];
+            numberOfRecords += [records count];
+        }];
+        [tableIDs addObjectsFromArray:[changes allKeys]];
+        [changeSets addObject:changes];
+    } error:error];
+    if (!read) return nil;
+    
+    self = [super init];
+    if (self) {
+        _tablesByEntityName = [recorder.tablesByEntityName copy];
+        _syncAttributeName = [recorder.syncAttributeName copy];
+        _numberOfRecords = numberOfRecords;
+        _changeSets = changeSets;
+        _tableIDs = tableIDs;
+    }
+    return self;
+}
+
+- (NSUInteger)numberOfChangeSets
+{
+    return [self.changeSets count];
+}
+
+- (PKSyncManager *)syncManagerWithManagedObjectContext:(NSManagedObjectContext *)managedObjectContext
+{
+    PKSyncManager *syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:managedObjectContext datastore:(DBDatastore *)[[PKDatastoreMock alloc] init]];
+    if ([self.syncAttributeName length] > 0) {
+        syncManager.syncAttributeName = self.syncAttributeName;
+    }
+    [syncManager setTablesForEntityNamesWithDictionary:self.tablesByEntityName];
+    
+    // Apply every change set as soon as it comes in
+    syncManager.minimumSyncLatency = 0;
+    syncManager.maximumSyncLatency = 0;
+    syncManager.maximumStatusNotificationsPerSecond = 0;
+    return syncManager;
+}
+
+- (void)replayWithSyncManager:(PKSyncManager *)syncManager
+{
+    PKDatastoreMock *datastore = (PKDatastoreMock *)syncManager.datastore;
+    for (NSString *tableID in self.tableIDs) {
+        // Tables know their datastore, so chunked binary data can be read back from the binary tables
+        (void)[[PKTableMock alloc] initWithTableID:tableID datastore:datastore];
+    }
+    
+    BOOL observing = [syncManager isObserving];
+    if (!observing) [syncManager startObserving];
+    
+    for (NSDictionary *changes in self.changeSets) {
+        @autoreleasepool {
+            // Like a DBDatastore, the mock holds the records of a change set once it was synced
+            [changes enumerateKeysAndObjectsUsingBlock:^(NSString *tableID, NSArray *records, BOOL *stop) {
+                PKTableMock *table = [datastore getTable:tableID];
+                for (PKRecordMock *record in records) {
+                    if ([record isDeleted]) {
+                        [table deleteRecord:record];
+                    } else {
+                        [table setRecord:record];
+                    }
+                }
+            }];
+            
+            [datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:changes];
+            [self waitForSyncManager:syncManager];
+        }
+    }
+    
+    if (!observing) [syncManager stopObserving];
+}
+
+// Waits for the sync started by a status update, then for the merges it handed to the main queue
+- (void)waitForSyncManager:(PKSyncManager *)syncManager
+{
+    dispatch_sync([syncManager syncQueue], ^{});
+    
+    __block BOOL merged = NO;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        merged = YES;
+    });
+    while (!merged) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+    }
+}
+
+@end
@@ -32,6 +32,8 @@
 #import "PKTableMock.h"
 #import "PKRecordMock.h"
 #import "PKListMock.h"
+#import "PKEntitySyncPlan.h"
+#import "NSManagedObject+ParcelKit.h"
 #import "NSManagedObjectContext+ParcelKitTests.h"
 #import "Author.h"
 
@@ -156,6 +158,106 @@
     XCTAssertEqual(0, (int)[binaryTable.records count], @"");
 }
 
+- (void)testSetFieldsWithManagedObjectShouldStoreDigestOfChunkedBinaryData
+{
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:self.datastore];
+    
+    [self.book setValue:[@"OneTwoThree" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertEqualObjects(@"b9a0bc490bed30f4311bdf0150b26504:11", [self.record objectForKey:@"cover_digest"], @"");
+    XCTAssertEqual(4, (int)[binaryTable.records count], @"");
+    
+    [self.book setValue:[@"One" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertNil([self.record objectForKey:@"cover_digest"], @"");
+    XCTAssertEqual(0, (int)[binaryTable.records count], @"");
+}
+
+- (void)testSetFieldsWithManagedObjectShouldNotRewriteChunkedBinaryDataWithMatchingDigest
+{
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:self.datastore];
+    
+    [self.book setValue:[@"OneTwoThree" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    NSArray *recordIDs = [[self.record objectForKey:@"cover"] values];
+    
+    // Remove the chunks to prove they aren't read back
+    for (NSString *recordID in recordIDs) {
+        [[binaryTable getRecord:recordID error:nil] setObject:[NSNull null] forKey:@"data"];
+    }
+    
+    [self.book setValue:@"Go Set a Watchman" forKey:@"title"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertEqualObjects(recordIDs, [[self.record objectForKey:@"cover"] values], @"");
+    XCTAssertEqual(4, (int)[binaryTable.records count], @"");
+}
+
+- (void)testSetFieldsWithManagedObjectShouldAddDigestToUnchangedChunkedBinaryDataWithoutOne
+{
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:self.datastore];
+    [binaryTable setRecord:[PKRecordMock record:@"1" withFields:@{@"data": [@"One" dataUsingEncoding:NSUTF8StringEncoding]}]];
+    [binaryTable setRecord:[PKRecordMock record:@"2" withFields:@{@"data": [@"Two" dataUsingEncoding:NSUTF8StringEncoding]}]];
+    
+    DBList *list = [self.record getOrCreateList:@"cover"];
+    [list addObject:@"1"];
+    [list addObject:@"2"];
+    
+    [self.book setValue:[@"OneTwo" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertEqualObjects((@[@"1", @"2"]), [[self.record objectForKey:@"cover"] values], @"");
+    XCTAssertNotNil([self.record objectForKey:@"cover_digest"], @"");
+    XCTAssertEqual(2, (int)[binaryTable.records count], @"");
+}
+
+- (void)testSetFieldsWithManagedObjectChangingChunkedBinaryDataShouldOnlyReplaceChangedChunks
+{
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:self.datastore];
+    
+    [self.book setValue:[@"OneTwoThree" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    NSArray *previousRecordIDs = [[self.record objectForKey:@"cover"] values];
+    
+    [self.book setValue:[@"OneTwoThrEE" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    NSArray *recordIDs = [[self.record objectForKey:@"cover"] values];
+    
+    XCTAssertEqual(4, (int)[recordIDs count], @"");
+    XCTAssertEqualObjects([previousRecordIDs subarrayWithRange:NSMakeRange(0, 3)], [recordIDs subarrayWithRange:NSMakeRange(0, 3)], @"");
+    XCTAssertFalse([previousRecordIDs containsObject:recordIDs[3]], @"");
+    XCTAssertEqual(4, (int)[binaryTable.records count], @"");
+    XCTAssertEqualObjects(@"EE", [[NSString alloc] initWithData:[binaryTable getRecord:recordIDs[3] error:nil][@"data"] encoding:NSUTF8StringEncoding]);
+}
+
+- (void)testSetFieldsWithManagedObjectShouldStoreRepeatedChunksInSeparateRecords
+{
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:self.datastore];
+    
+    [self.book setValue:[@"abcabcabc" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"cover"];
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    NSArray *recordIDs = [[self.record objectForKey:@"cover"] values];
+    
+    XCTAssertEqual(3, (int)[[NSSet setWithArray:recordIDs] count], @"");
+    XCTAssertEqual(3, (int)[binaryTable.records count], @"");
+}
+
+- (void)testSetFieldsWithManagedObjectShouldCompressStringsAboveCompressionThreshold
+{
+    NSString *title = [@"" stringByPaddingToLength:1000 withString:@"To Kill a Mockingbird " startingAtIndex:0];
+    [self.book setValue:title forKey:@"title"];
+    
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[self.book entity] tableID:@"books" syncAttributeName:PKDefaultSyncAttributeName];
+    syncPlan.compressionThresholdInBytes = 100;
+    [self.record pk_setFieldsWithManagedObject:self.book syncPlan:syncPlan];
+    
+    id value = [self.record objectForKey:@"title"];
+    XCTAssertTrue([value isKindOfClass:[NSData class]], @"");
+    XCTAssertTrue([value length] < [title length], @"");
+    
+    [self.book setValue:@"Go Set a Watchman" forKey:@"title"];
+    [self.book pk_setAttributesWithRecord:self.record syncPlan:syncPlan];
+    XCTAssertEqualObjects(title, [self.book valueForKey:@"title"], @"");
+}
+
 - (void)testSetFieldsWithManagedObjectShouldSetMultipleAttributes
 {
     [self.book setValue:@(296) forKey:@"pageCount"];
@@ -193,6 +295,30 @@
     XCTAssertTrue([authors containsObject:[self.author valueForKey:PKDefaultSyncAttributeName]], @"");
 }
 
+- (void)testSetFieldsWithManagedObjectShouldNotFireFaultsOfRelatedObjects
+{
+    NSMutableSet *authors = [[NSMutableSet alloc] init];
+    for (NSUInteger i = 2; i < 5; i++) {
+        Author *author = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:self.managedObjectContext];
+        [author setValue:[NSString stringWithFormat:@"%lu", (unsigned long)i] forKey:PKDefaultSyncAttributeName];
+        [author setValue:[NSString stringWithFormat:@"Author %lu", (unsigned long)i] forKey:@"name"];
+        [authors addObject:author];
+    }
+    [self.book setValue:authors forKey:@"authors"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    for (Author *author in authors) {
+        [self.managedObjectContext refreshObject:author mergeChanges:NO];
+    }
+    
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    
+    NSArray *identifiers = [[self.record getOrCreateList:@"authors"] values];
+    XCTAssertEqualObjects(([NSSet setWithObjects:@"2", @"3", @"4", nil]), [NSSet setWithArray:identifiers], @"");
+    for (Author *author in authors) {
+        XCTAssertTrue([author isFault], @"");
+    }
+}
+
 - (void)testSetFieldsWithManagedObjectShouldNotSetRelationshipToUnsycnedRows
 {
     [self.book setValue:[NSSet setWithObject:self.author] forKey:@"authors"];
@@ -298,6 +424,19 @@
     XCTAssertEqualObjects([self.publisher valueForKey:PKDefaultSyncAttributeName], [self.record objectForKey:@"publisher"], @"");
 }
 
+- (void)testSetFieldsWithManagedObjectShouldNotSetUnchangedToOneRelationship
+{
+    [self.record setObject:@"1" forKey:@"publisher"];
+    [self.book setValue:self.publisher forKey:@"publisher"];
+    
+    id recordMock = [OCMockObject partialMockForObject:self.record];
+    [[recordMock reject] setObject:[OCMArg any] forKey:@"publisher"];
+    
+    [self.record pk_setFieldsWithManagedObject:self.book syncAttributeName:PKDefaultSyncAttributeName];
+    
+    [recordMock verify];
+}
+
 - (void)testSetFieldsWithManagedObjectShouldNotSetOneToManyRelationshipOnBothSides
 {
     [self.book setValue:self.publisher forKey:@"publisher"];
@@ -335,4 +474,33 @@
     XCTAssertNil([self.record objectForKey:@"royalties"], @"");
 }
 
+- (void)testSetChangedFieldsWithManagedObjectShouldOnlySetChangedProperties
+{
+    [self.managedObjectContext save:nil];
+    [self.book setValue:@(296) forKey:@"pageCount"];
+    
+    id recordMock = [OCMockObject partialMockForObject:self.record];
+    [[recordMock expect] setObject:@(296) forKey:@"pageCount"];
+    [[recordMock reject] setObject:[OCMArg any] forKey:@"title"];
+    
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[self.book entity] tableID:@"books" syncAttributeName:PKDefaultSyncAttributeName];
+    [self.record pk_setChangedFieldsWithManagedObject:self.book syncPlan:syncPlan];
+    
+    [recordMock verify];
+}
+
+- (void)testSetChangedFieldsWithManagedObjectShouldNotFaultUnchangedToManyRelationships
+{
+    [self.book setValue:[NSSet setWithObject:self.author] forKey:@"authors"];
+    [self.managedObjectContext save:nil];
+    [self.managedObjectContext refreshObject:self.book mergeChanges:NO];
+    [self.book setValue:@"Go Set a Watchman" forKey:@"title"];
+    
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[self.book entity] tableID:@"books" syncAttributeName:PKDefaultSyncAttributeName];
+    [self.record pk_setChangedFieldsWithManagedObject:self.book syncPlan:syncPlan];
+    
+    XCTAssertEqualObjects(@"Go Set a Watchman", [self.record objectForKey:@"title"], @"");
+    XCTAssertTrue([self.book hasFaultForRelationshipNamed:@"authors"], @"");
+}
+
 @end
@@ -33,6 +33,8 @@
 #import "PKTableMock.h"
 #import "PKRecordMock.h"
 #import "PKListMock.h"
+#import "PKEntitySyncPlan.h"
+#import "PKBinaryChunker.h"
 #import "Author.h"
 
 @interface NSManagedObjectParcelKitTests : XCTestCase
@@ -309,6 +311,36 @@
     XCTAssertEqualObjects(@"OneTwoThree", stringValue, @"");
 }
 
+- (void)testSetAttributesWithRecordShouldReassembleChunksInBinaryDataDirectory
+{
+    PKDatastoreMock *datastore = [[PKDatastoreMock alloc] init];
+    PKTableMock *binaryTable = [[PKTableMock alloc] initWithTableID:@"books.bin" datastore:datastore];
+    [binaryTable setRecord:[PKRecordMock record:@"1" withFields:@{@"data": [@"One" dataUsingEncoding:NSUTF8StringEncoding]}]];
+    [binaryTable setRecord:[PKRecordMock record:@"2" withFields:@{@"data": [@"Two" dataUsingEncoding:NSUTF8StringEncoding]}]];
+    
+    PKTableMock *table = [[PKTableMock alloc] initWithTableID:@"books" datastore:datastore];
+    PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"cover": [[PKListMock alloc] initWithValues:@[@"1", @"2"]]}];
+    [record setTable:table];
+    
+    NSURL *directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]] isDirectory:YES];
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[self.book entity] tableID:@"books" syncAttributeName:PKDefaultSyncAttributeName];
+    syncPlan.binaryDataDirectoryURL = directoryURL;
+    
+    [self.book pk_setAttributesWithRecord:record syncPlan:syncPlan];
+    XCTAssertEqualObjects(@"OneTwo", [[NSString alloc] initWithData:[self.book valueForKey:@"cover"] encoding:NSUTF8StringEncoding], @"");
+    
+    // The file is gone once mapped, the data stays readable until it is released
+    NSURL *fileURL = [syncPlan binaryDataFileURLForRecordID:@"1" attributeName:@"cover"];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]], @"");
+    
+    [record setObject:[[PKListMock alloc] initWithValues:@[@"2", @"1"]] forKey:@"cover"];
+    [self.book pk_setAttributesWithRecord:record syncPlan:syncPlan];
+    XCTAssertEqualObjects(@"TwoOne", [[NSString alloc] initWithData:[self.book valueForKey:@"cover"] encoding:NSUTF8StringEncoding], @"");
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]], @"");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
 - (void)testSetPropertiesWithRecordShouldRaiseExceptionIfInvalidBinaryAttributeType
 {
     PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"cover": @"Not binary or list type"}];
@@ -491,6 +523,33 @@
     }];
 }
 
+- (void)testSetRelationshipsWithRecordShouldKeepUnresolvedListedObjectsInOrderedToManyRelationship
+{
+    NSManagedObject *author = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:self.managedObjectContext];
+    
+    NSMutableDictionary *resolvedBooks = [[NSMutableDictionary alloc] init];
+    NSMutableOrderedSet *books = [author mutableOrderedSetValueForKey:@"books"];
+    for (int i = 0; i < 3; i++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        NSString *identifier = [NSString stringWithFormat:@"%i", i + 100];
+        [book setValue:identifier forKey:PKDefaultSyncAttributeName];
+        [books addObject:book];
+        if (i != 1) {
+            [resolvedBooks setObject:book forKey:identifier];
+        }
+    }
+    NSManagedObject *unresolvedBook = [books objectAtIndex:1];
+    
+    PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"books": [[PKListMock alloc] initWithValues:@[@"102", @"101", @"100"]]}];
+    [author pk_setRelationshipsWithRecord:record syncAttributeName:PKDefaultSyncAttributeName relatedObjects:@{@"Book": resolvedBooks}];
+    
+    NSOrderedSet *syncedBooks = [author valueForKey:@"books"];
+    XCTAssertEqual(3, (int)[syncedBooks count], @"");
+    XCTAssertEqualObjects(unresolvedBook, [syncedBooks objectAtIndex:1], @"");
+    XCTAssertEqualObjects(@"102", [[syncedBooks objectAtIndex:0] valueForKey:PKDefaultSyncAttributeName], @"");
+    XCTAssertEqualObjects(@"100", [[syncedBooks objectAtIndex:2] valueForKey:PKDefaultSyncAttributeName], @"");
+}
+
 - (void)testSetPropertiesWithRecordShouldRaiseExceptionIfToManyRelationshipIsNotAList
 {
     PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"authors": @"1,2"}];
@@ -573,4 +632,31 @@
     XCTAssertEqualObjects(royalties, [self.author valueForKey:@"royalties"], @"");
 }
 
+- (void)testSetPropertiesWithRecordShouldNotChangeObjectIfValuesAreEqual
+{
+    PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"pageCount": @(296), @"authors": [[PKListMock alloc] initWithValues:@[@"1"]], @"publisher": @"1"}];
+    [self.book pk_setPropertiesWithRecord:record syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    [self.book pk_setPropertiesWithRecord:record syncAttributeName:PKDefaultSyncAttributeName];
+    XCTAssertFalse([self.book hasChanges], @"");
+    XCTAssertFalse([self.managedObjectContext hasChanges], @"");
+}
+
+- (void)testSetPropertiesWithRecordShouldNotReassembleChunksOfUnchangedBinaryData
+{
+    NSData *cover = [@"OneTwo" dataUsingEncoding:NSUTF8StringEncoding];
+    [self.book setValue:cover forKey:@"cover"];
+    
+    // Reassembling would raise as the binary table holding the chunks doesn't exist
+    PKDatastoreMock *datastore = [[PKDatastoreMock alloc] init];
+    PKTableMock *table = [[PKTableMock alloc] initWithTableID:@"books" datastore:datastore];
+    NSString *digestFieldName = [@"cover" stringByAppendingString:PKBinaryDataDigestFieldSuffix];
+    PKRecordMock *record = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"cover": [[PKListMock alloc] initWithValues:@[@"1", @"2"]], digestFieldName: [PKBinaryChunker digestForData:cover]}];
+    [record setTable:table];
+    
+    XCTAssertNoThrow([self.book pk_setPropertiesWithRecord:record syncAttributeName:PKDefaultSyncAttributeName], @"");
+    XCTAssertEqualObjects(cover, [self.book valueForKey:@"cover"], @"");
+}
+
 @end
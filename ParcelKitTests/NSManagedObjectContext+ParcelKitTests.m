@@ -25,20 +25,16 @@
 
 #import "NSManagedObjectContext+ParcelKitTests.h"
 
-static NSString * const PKBundleName = @"ParcelKitTests";
-
 @implementation NSManagedObjectContext (ParcelKitTests)
 + (NSManagedObjectContext *)pk_managedObjectContextWithModelName:(NSString *)modelName
 {
-    NSBundle *testBundle = nil;
+    // The model is compiled into the test and benchmark bundles alike
+    NSURL *modelURL = nil;
     for (NSBundle *bundle in [NSBundle allBundles]) {
-        if ([[bundle objectForInfoDictionaryKey:@"CFBundleExecutable"] isEqualToString:PKBundleName]) {
-            testBundle = bundle;
-            break;
-        }
+        modelURL = [bundle URLForResource:modelName withExtension:@"momd"];
+        if (modelURL) break;
     }
     
-    NSURL *modelURL = [testBundle URLForResource:modelName withExtension:@"momd"];
     NSManagedObjectModel *managedObjectModel = [[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL];
     
     NSPersistentStoreCoordinator *persistentStoreCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:managedObjectModel];
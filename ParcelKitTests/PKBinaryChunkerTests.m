@@ -0,0 +1,110 @@
+//
+//  PKBinaryChunkerTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <XCTest/XCTest.h>
+#import "PKBinaryChunker.h"
+
+@interface PKBinaryChunkerTests : XCTestCase
+@end
+
+@implementation PKBinaryChunkerTests
+
+- (NSData *)randomDataWithLength:(NSUInteger)length
+{
+    srandom(7);
+    NSMutableData *data = [[NSMutableData alloc] initWithLength:length];
+    uint8_t *bytes = [data mutableBytes];
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)random();
+    }
+    return data;
+}
+
+- (NSSet *)chunksOfData:(NSData *)data ranges:(NSArray *)ranges
+{
+    NSMutableSet *chunks = [[NSMutableSet alloc] init];
+    for (NSValue *range in ranges) {
+        [chunks addObject:[data subdataWithRange:[range rangeValue]]];
+    }
+    return chunks;
+}
+
+- (void)testChunksShouldCoverDataWithinLengthLimits
+{
+    NSData *data = [self randomDataWithLength:200000];
+    NSArray *ranges = [PKBinaryChunker chunkRangesForData:data maximumChunkLength:4096];
+    
+    NSUInteger location = 0;
+    for (NSValue *value in ranges) {
+        NSRange range = [value rangeValue];
+        XCTAssertEqual(location, range.location, @"");
+        XCTAssertTrue(range.length <= 4096, @"");
+        if (NSMaxRange(range) < [data length]) {
+            XCTAssertTrue(range.length >= 1024, @"");
+        }
+        location = NSMaxRange(range);
+    }
+    XCTAssertEqual(location, [data length], @"");
+}
+
+- (void)testChunksShouldBeEmptyForEmptyData
+{
+    XCTAssertEqual([[PKBinaryChunker chunkRangesForData:[NSData data] maximumChunkLength:4096] count], (NSUInteger)0, @"");
+}
+
+- (void)testInsertingBytesShouldOnlyChangeNearbyChunks
+{
+    NSData *data = [self randomDataWithLength:200000];
+    NSSet *chunks = [self chunksOfData:data ranges:[PKBinaryChunker chunkRangesForData:data maximumChunkLength:4096]];
+    
+    NSMutableData *editedData = [data mutableCopy];
+    [editedData replaceBytesInRange:NSMakeRange(100000, 0) withBytes:"edit" length:4];
+    NSSet *editedChunks = [self chunksOfData:editedData ranges:[PKBinaryChunker chunkRangesForData:editedData maximumChunkLength:4096]];
+    
+    NSMutableSet *changedChunks = [editedChunks mutableCopy];
+    [changedChunks minusSet:chunks];
+    XCTAssertTrue([changedChunks count] <= 2, @"");
+}
+
+- (void)testChunkOfDataShouldReferenceBytesOfData
+{
+    NSData *data = [@"OneTwoThree" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *chunk = [PKBinaryChunker chunkOfData:data range:NSMakeRange(3, 3)];
+    XCTAssertEqualObjects([@"Two" dataUsingEncoding:NSUTF8StringEncoding], chunk, @"");
+    XCTAssertTrue([chunk bytes] == (const uint8_t *)[data bytes] + 3, @"");
+}
+
+- (void)testDataShouldMatchItsDigest
+{
+    NSData *data = [@"The quick brown fox jumps over the lazy dog" dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *digest = [PKBinaryChunker digestForData:data];
+    XCTAssertEqualObjects(@"9e107d9d372bb6826bd81d3542a419d6:43", digest, @"");
+    XCTAssertTrue([PKBinaryChunker data:data matchesDigest:digest], @"");
+    XCTAssertFalse([PKBinaryChunker data:[data subdataWithRange:NSMakeRange(0, 42)] matchesDigest:digest], @"");
+    XCTAssertFalse([PKBinaryChunker data:nil matchesDigest:digest], @"");
+}
+
+@end
@@ -0,0 +1,165 @@
+//
+//  PKChangeRecorderTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <XCTest/XCTest.h>
+#import "PKChangeRecorder.h"
+#import "PKRecordMock.h"
+#import "PKListMock.h"
+
+@interface PKChangeRecorderTests : XCTestCase
+@property (strong, nonatomic) NSURL *recordingURL;
+@property (strong, nonatomic) PKChangeRecorder *recorder;
+@end
+
+@implementation PKChangeRecorderTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.recordingURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]]];
+    self.recorder = [[PKChangeRecorder alloc] initWithURL:self.recordingURL tablesByEntityName:@{@"Book": @"books", @"Author": @"authors"} syncAttributeName:@"syncID"];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:self.recordingURL error:nil];
+    [super tearDown];
+}
+
+- (NSArray *)recordedChangeSetsOfRecorder:(PKChangeRecorder *)recorder
+{
+    NSMutableArray *changeSets = [[NSMutableArray alloc] init];
+    NSError *error = nil;
+    XCTAssertTrue([recorder enumerateChangeSetsUsingBlock:^(NSDictionary *changes, NSDate *date, BOOL *stop) {
+        XCTAssertNotNil(date, @"");
+        [changeSets addObject:changes];
+    } error:&error], @"%@", error);
+    return changeSets;
+}
+
+- (void)testRecordedChangesShouldBeReadBackInOrder
+{
+    NSDate *publishedDate = [NSDate dateWithTimeIntervalSince1970:1000000000];
+    NSData *cover = [@"cover" dataUsingEncoding:NSUTF8StringEncoding];
+    NSDictionary *fields = @{@"title": @"To Kill a Mockingbird", @"pageCount": @(281), @"averageRating": @(4.5), @"isFavorite": @YES, @"publishedDate": publishedDate, @"cover": cover, @"authors": [[PKListMock alloc] initWithValues:@[@"1", @"2"]]};
+    
+    NSError *error = nil;
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:fields], [PKRecordMock record:@"2" withFields:nil deleted:YES]]} error:&error], @"%@", error);
+    XCTAssertTrue([self.recorder recordChanges:@{@"authors": [NSSet setWithObject:[PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee"}]]} error:&error], @"%@", error);
+    
+    NSArray *changeSets = [self recordedChangeSetsOfRecorder:self.recorder];
+    XCTAssertEqual((NSUInteger)2, [changeSets count], @"");
+    
+    NSArray *books = [[changeSets objectAtIndex:0] objectForKey:@"books"];
+    XCTAssertEqual((NSUInteger)2, [books count], @"");
+    NSDictionary *book = [books objectAtIndex:0];
+    XCTAssertEqualObjects(@"1", [book objectForKey:PKChangeRecorderRecordIDKey], @"");
+    XCTAssertNil([book objectForKey:PKChangeRecorderDeletedKey], @"");
+    NSDictionary *recordedFields = [book objectForKey:PKChangeRecorderFieldsKey];
+    XCTAssertEqualObjects(@"To Kill a Mockingbird", [recordedFields objectForKey:@"title"], @"");
+    XCTAssertEqualObjects(@(281), [recordedFields objectForKey:@"pageCount"], @"");
+    XCTAssertEqualObjects(@(4.5), [recordedFields objectForKey:@"averageRating"], @"");
+    XCTAssertEqualObjects(@YES, [recordedFields objectForKey:@"isFavorite"], @"");
+    XCTAssertEqualObjects(publishedDate, [recordedFields objectForKey:@"publishedDate"], @"");
+    XCTAssertEqualObjects(cover, [recordedFields objectForKey:@"cover"], @"");
+    XCTAssertEqualObjects((@[@"1", @"2"]), [recordedFields objectForKey:@"authors"], @"");
+    
+    NSDictionary *deletedBook = [books objectAtIndex:1];
+    XCTAssertEqualObjects(@"2", [deletedBook objectForKey:PKChangeRecorderRecordIDKey], @"");
+    XCTAssertEqualObjects(@YES, [deletedBook objectForKey:PKChangeRecorderDeletedKey], @"");
+    XCTAssertNil([deletedBook objectForKey:PKChangeRecorderFieldsKey], @"");
+    
+    NSArray *authors = [[changeSets objectAtIndex:1] objectForKey:@"authors"];
+    XCTAssertEqualObjects(@"Harper Lee", [[[authors lastObject] objectForKey:PKChangeRecorderFieldsKey] objectForKey:@"name"], @"");
+}
+
+- (void)testRecorderWithContentsOfURLShouldReadTablesAndSyncAttributeName
+{
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:@{@"title": @"1984"}]]} error:nil], @"");
+    
+    NSError *error = nil;
+    PKChangeRecorder *recorder = [PKChangeRecorder recorderWithContentsOfURL:self.recordingURL error:&error];
+    XCTAssertNotNil(recorder, @"%@", error);
+    XCTAssertEqualObjects((@{@"Book": @"books", @"Author": @"authors"}), recorder.tablesByEntityName, @"");
+    XCTAssertEqualObjects(@"syncID", recorder.syncAttributeName, @"");
+    
+    // Recording more keeps the existing change sets
+    XCTAssertTrue([recorder recordChanges:@{@"books": @[[PKRecordMock record:@"2" withFields:@{@"title": @"Animal Farm"}]]} error:&error], @"%@", error);
+    XCTAssertEqual((NSUInteger)2, [[self recordedChangeSetsOfRecorder:recorder] count], @"");
+}
+
+- (void)testUnfinishedChangeSetShouldBeIgnored
+{
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:@{@"title": @"1984"}]]} error:nil], @"");
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"2" withFields:@{@"title": @"Animal Farm"}]]} error:nil], @"");
+    
+    NSData *data = [NSData dataWithContentsOfURL:self.recordingURL];
+    [[data subdataWithRange:NSMakeRange(0, [data length] - 1)] writeToURL:self.recordingURL atomically:YES];
+    
+    NSArray *changeSets = [self recordedChangeSetsOfRecorder:self.recorder];
+    XCTAssertEqual((NSUInteger)1, [changeSets count], @"");
+    XCTAssertEqualObjects(@"1", [[[changeSets lastObject] objectForKey:@"books"] valueForKey:PKChangeRecorderRecordIDKey][0], @"");
+}
+
+- (void)testRecordingAfterAnUnfinishedChangeSetShouldDropIt
+{
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:@{@"title": @"1984"}]]} error:nil], @"");
+    XCTAssertTrue([self.recorder recordChanges:@{@"books": @[[PKRecordMock record:@"2" withFields:@{@"title": @"Animal Farm"}]]} error:nil], @"");
+    
+    NSData *data = [NSData dataWithContentsOfURL:self.recordingURL];
+    [[data subdataWithRange:NSMakeRange(0, [data length] - 1)] writeToURL:self.recordingURL atomically:YES];
+    
+    NSError *error = nil;
+    PKChangeRecorder *recorder = [PKChangeRecorder recorderWithContentsOfURL:self.recordingURL error:&error];
+    XCTAssertNotNil(recorder, @"%@", error);
+    XCTAssertTrue([recorder recordChanges:@{@"books": @[[PKRecordMock record:@"3" withFields:@{@"title": @"Brave New World"}]]} error:&error], @"%@", error);
+    
+    NSArray *changeSets = [self recordedChangeSetsOfRecorder:recorder];
+    XCTAssertEqual((NSUInteger)2, [changeSets count], @"");
+    XCTAssertEqualObjects(@"1", [[[changeSets objectAtIndex:0] objectForKey:@"books"] valueForKey:PKChangeRecorderRecordIDKey][0], @"");
+    XCTAssertEqualObjects(@"3", [[[changeSets objectAtIndex:1] objectForKey:@"books"] valueForKey:PKChangeRecorderRecordIDKey][0], @"");
+    
+    // The recorder that wrote the unfinished change set drops it as well
+    data = [NSData dataWithContentsOfURL:self.recordingURL];
+    [[data subdataWithRange:NSMakeRange(0, [data length] - 1)] writeToURL:self.recordingURL atomically:YES];
+    XCTAssertTrue([recorder recordChanges:@{@"books": @[[PKRecordMock record:@"4" withFields:@{@"title": @"We"}]]} error:&error], @"%@", error);
+    
+    changeSets = [self recordedChangeSetsOfRecorder:recorder];
+    XCTAssertEqual((NSUInteger)2, [changeSets count], @"");
+    XCTAssertEqualObjects(@"4", [[[changeSets objectAtIndex:1] objectForKey:@"books"] valueForKey:PKChangeRecorderRecordIDKey][0], @"");
+}
+
+- (void)testReadingAFileThatIsNotARecordingShouldFail
+{
+    [[@"bplist00" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:self.recordingURL atomically:YES];
+    
+    NSError *error = nil;
+    XCTAssertNil([PKChangeRecorder recorderWithContentsOfURL:self.recordingURL error:&error], @"");
+    XCTAssertEqualObjects(NSCocoaErrorDomain, [error domain], @"");
+    XCTAssertEqual((NSInteger)NSFileReadCorruptFileError, [error code], @"");
+}
+
+@end
@@ -0,0 +1,82 @@
+//
+//  PKCompressionTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <XCTest/XCTest.h>
+#import "PKCompression.h"
+
+@interface PKCompressionTests : XCTestCase
+@end
+
+@implementation PKCompressionTests
+
+- (NSData *)compressibleData
+{
+    NSMutableString *string = [[NSMutableString alloc] init];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [string appendFormat:@"{\"title\": \"To Kill a Mockingbird\", \"pageCount\": %lu}", (unsigned long)i];
+    }
+    return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)testEncodedDataShouldRoundTripWithEveryCodec
+{
+    NSData *data = [self compressibleData];
+    for (NSNumber *codec in @[@(PKCompressionCodecFast), @(PKCompressionCodecBest)]) {
+        NSData *encodedData = [PKCompression encodedData:data codec:[codec unsignedCharValue]];
+        XCTAssertTrue([encodedData length] < [data length] / 3, @"");
+        
+        NSUInteger decodedLength = 0;
+        XCTAssertTrue([PKCompression isEncodedData:encodedData decodedLength:&decodedLength], @"");
+        XCTAssertEqual(decodedLength, [data length], @"");
+        XCTAssertEqualObjects([PKCompression decodedData:encodedData], data, @"");
+    }
+}
+
+- (void)testEncodedDataShouldBeLeftAsIsIfNotSmaller
+{
+    NSData *data = [@"One" dataUsingEncoding:NSUTF8StringEncoding];
+    XCTAssertEqual([PKCompression encodedData:data codec:PKCompressionCodecBest], data, @"");
+    XCTAssertEqual([PKCompression decodedData:data], data, @"");
+}
+
+- (void)testDataThatLooksEncodedShouldBeFramed
+{
+    NSMutableData *data = [[NSMutableData alloc] initWithData:[@"PKZ" dataUsingEncoding:NSUTF8StringEncoding]];
+    [data setLength:12];
+    
+    NSData *encodedData = [PKCompression encodedData:data codec:PKCompressionCodecNone];
+    XCTAssertFalse([encodedData isEqualToData:data], @"");
+    XCTAssertEqualObjects([PKCompression decodedData:encodedData], data, @"");
+}
+
+- (void)testDecodedDataShouldBeNilIfCorrupt
+{
+    NSMutableData *encodedData = [[PKCompression encodedData:[self compressibleData] codec:PKCompressionCodecFast] mutableCopy];
+    [encodedData setLength:[encodedData length] / 2];
+    XCTAssertNil([PKCompression decodedData:encodedData], @"");
+}
+
+@end
@@ -31,6 +31,8 @@
 
 @interface PKDatastoreMock : NSObject
 @property (nonatomic, readonly) PKDatastoreStatusMock *status;
+@property (nonatomic) NSUInteger unsyncedChangesSize;
+@property (nonatomic, readonly) NSUInteger syncCount;
 
 // Unit Testing Methods
 - (void)updateStatus:(PKDatastoreStatusMock *)status withChanges:(NSDictionary *)changes;
@@ -35,6 +35,7 @@ static NSString * const PKDatastoreMockObserverBlockKey = @"block";
 @property (nonatomic, readwrite) PKDatastoreStatusMock *status;
 @property (strong, nonatomic) NSDictionary *changes;
 @property (strong, nonatomic) NSMutableDictionary *tables;
+@property (nonatomic, readwrite) NSUInteger syncCount;
 @end
 
 @implementation PKDatastoreMock
@@ -91,6 +92,8 @@ static NSString * const PKDatastoreMockObserverBlockKey = @"block";
 {
     NSDictionary *changes = self.changes;
     self.changes = nil;
+    self.unsyncedChangesSize = 0;
+    self.syncCount++;
     return changes;
 }
 
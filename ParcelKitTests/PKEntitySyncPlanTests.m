@@ -0,0 +1,108 @@
+//
+//  PKEntitySyncPlanTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "NSManagedObjectContext+ParcelKitTests.h"
+#import "PKEntitySyncPlan.h"
+#import "PKSyncManager.h"
+#import "PKDatastoreMock.h"
+#import "PKTableMock.h"
+
+@interface PKEntitySyncPlanTests : XCTestCase
+@property (strong, nonatomic) NSManagedObjectContext *managedObjectContext;
+@end
+
+@implementation PKEntitySyncPlanTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+}
+
+- (PKEntitySyncPlan *)syncPlanForEntityName:(NSString *)entityName
+{
+    NSEntityDescription *entity = [NSEntityDescription entityForName:entityName inManagedObjectContext:self.managedObjectContext];
+    return [[PKEntitySyncPlan alloc] initWithEntity:entity tableID:@"table" syncAttributeName:PKDefaultSyncAttributeName];
+}
+
+- (void)testPlanShouldExcludeSyncAttributeAndTransientProperties
+{
+    PKEntitySyncPlan *syncPlan = [self syncPlanForEntityName:@"Book"];
+    XCTAssertTrue([syncPlan excludesPropertyName:@"syncID"], @"");
+    XCTAssertTrue([syncPlan excludesPropertyName:@"coverPath"], @"");
+    XCTAssertNil([syncPlan propertyForName:@"syncID"], @"");
+    XCTAssertNil([syncPlan propertyForName:@"coverPath"], @"");
+    XCTAssertFalse([syncPlan.propertyNames containsObject:@"coverPath"], @"");
+    XCTAssertTrue([syncPlan.propertyNames containsObject:@"title"], @"");
+}
+
+- (void)testPlanShouldCoerceAttributeValues
+{
+    PKEntitySyncPlan *syncPlan = [self syncPlanForEntityName:@"Book"];
+    
+    PKSyncPlanAttribute *title = [syncPlan propertyForName:@"title"];
+    XCTAssertEqualObjects(@"42", title.coercion(@42), @"");
+    XCTAssertNil(title.coercion([NSDate date]), @"");
+    
+    PKSyncPlanAttribute *pageCount = [syncPlan propertyForName:@"pageCount"];
+    XCTAssertEqualObjects(@42, pageCount.coercion(@"42"), @"");
+    
+    PKSyncPlanAttribute *cover = [syncPlan propertyForName:@"cover"];
+    XCTAssertTrue([cover isBinary], @"");
+    XCTAssertNil(cover.coercion(@"data"), @"");
+}
+
+- (void)testPlanShouldOnlySyncRelationshipsStoredInRecords
+{
+    XCTAssertTrue([[[self syncPlanForEntityName:@"Book"] propertyForName:@"publisher"] isSynced], @"");
+    XCTAssertTrue([[[self syncPlanForEntityName:@"Book"] propertyForName:@"authors"] isSynced], @"");
+    XCTAssertFalse([[[self syncPlanForEntityName:@"Publisher"] propertyForName:@"books"] isSynced], @"");
+}
+
+- (void)testPlanShouldAskObjectsWithSyncedPropertiesDictionary
+{
+    XCTAssertTrue([[self syncPlanForEntityName:@"Author"] usesSyncedPropertiesDictionary], @"");
+    XCTAssertFalse([[self syncPlanForEntityName:@"Book"] usesSyncedPropertiesDictionary], @"");
+    
+    PKEntitySyncPlan *syncPlan = [self syncPlanForEntityName:@"Author"];
+    NSManagedObject *author = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:self.managedObjectContext];
+    NSArray *attributeNames = [[syncPlan attributesForManagedObject:author] valueForKey:@"name"];
+    XCTAssertTrue([attributeNames containsObject:@"favoriteFood"], @"");
+    XCTAssertFalse([attributeNames containsObject:@"royalties"], @"");
+}
+
+- (void)testPlanShouldCacheTableHandles
+{
+    PKDatastoreMock *datastore = [[PKDatastoreMock alloc] init];
+    PKTableMock *tableMock = [[PKTableMock alloc] initWithTableID:@"table" datastore:datastore];
+    PKEntitySyncPlan *syncPlan = [self syncPlanForEntityName:@"Book"];
+    DBTable *table = [syncPlan tableInDatastore:(DBDatastore *)datastore];
+    XCTAssertEqual((DBTable *)tableMock, table, @"");
+    XCTAssertEqual(table, [syncPlan tableInDatastore:(DBDatastore *)datastore], @"");
+    XCTAssertEqualObjects(@"table.bin", [syncPlan binaryTableForTable:table].tableId, @"");
+}
+
+@end
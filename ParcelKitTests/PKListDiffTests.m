@@ -0,0 +1,94 @@
+//
+//  PKListDiffTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+
+#import <XCTest/XCTest.h>
+#import "PKListDiff.h"
+
+@interface PKListDiffTests : XCTestCase
+@end
+
+@implementation PKListDiffTests
+
+- (NSArray *)arrayByApplyingDiffFromArray:(NSArray *)fromArray toArray:(NSArray *)toArray operations:(NSArray **)operations
+{
+    NSArray *diff = [PKListDiff operationsFromArray:fromArray toArray:toArray];
+    if (operations) *operations = diff;
+    NSMutableArray *array = [fromArray mutableCopy];
+    [PKListDiff applyOperations:diff toArray:array];
+    return array;
+}
+
+- (void)testIdenticalArraysShouldProduceNoOperations
+{
+    NSArray *operations = [PKListDiff operationsFromArray:@[@"a", @"b", @"c"] toArray:@[@"a", @"b", @"c"]];
+    XCTAssertEqual([operations count], (NSUInteger)0, @"");
+}
+
+- (void)testRotationShouldProduceASingleMove
+{
+    NSArray *operations = nil;
+    NSArray *result = [self arrayByApplyingDiffFromArray:@[@"a", @"b", @"c", @"d", @"e"] toArray:@[@"e", @"a", @"b", @"c", @"d"] operations:&operations];
+    XCTAssertEqualObjects(result, (@[@"e", @"a", @"b", @"c", @"d"]), @"");
+    XCTAssertEqual([operations count], (NSUInteger)1, @"");
+    PKListDiffOperation *operation = [operations objectAtIndex:0];
+    XCTAssertEqual(operation.type, PKListDiffOperationMove, @"");
+    XCTAssertEqualObjects(operation.object, @"e", @"");
+}
+
+- (void)testInsertAndRemoveShouldNotMoveOtherObjects
+{
+    NSArray *operations = nil;
+    NSArray *result = [self arrayByApplyingDiffFromArray:@[@"a", @"b", @"c"] toArray:@[@"a", @"x", @"c"] operations:&operations];
+    XCTAssertEqualObjects(result, (@[@"a", @"x", @"c"]), @"");
+    XCTAssertEqual([operations count], (NSUInteger)2, @"");
+    for (PKListDiffOperation *operation in operations) {
+        XCTAssertTrue(operation.type != PKListDiffOperationMove, @"");
+    }
+}
+
+- (void)testDuplicatesShouldBeRemoved
+{
+    NSArray *result = [self arrayByApplyingDiffFromArray:@[@"a", @"b", @"a", @"c"] toArray:@[@"c", @"a", @"c", @"b"] operations:nil];
+    XCTAssertEqualObjects(result, (@[@"c", @"a", @"b"]), @"");
+}
+
+- (void)testRandomArraysShouldRoundTrip
+{
+    srandom(42);
+    for (NSUInteger iteration = 0; iteration < 500; iteration++) {
+        NSMutableArray *fromArray = [[NSMutableArray alloc] init];
+        NSMutableArray *toArray = [[NSMutableArray alloc] init];
+        NSUInteger fromCount = random() % 12, toCount = random() % 12;
+        for (NSUInteger i = 0; i < fromCount; i++) [fromArray addObject:@(random() % 10)];
+        for (NSUInteger i = 0; i < toCount; i++) [toArray addObject:@(random() % 10)];
+        
+        NSArray *expected = [[NSOrderedSet orderedSetWithArray:toArray] array];
+        NSArray *result = [self arrayByApplyingDiffFromArray:fromArray toArray:toArray operations:nil];
+        XCTAssertEqualObjects(result, expected, @"%@ -> %@", fromArray, toArray);
+    }
+}
+
+@end
@@ -0,0 +1,142 @@
+//
+//  PKSyncContextPoolTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "NSManagedObjectContext+ParcelKitTests.h"
+#import "PKSyncContextPool.h"
+#import "PKSyncManager.h"
+
+@interface PKSyncContextPoolTests : XCTestCase
+@property (strong, nonatomic) NSManagedObjectContext *managedObjectContext;
+@property (strong, nonatomic) PKSyncContextPool *contextPool;
+@end
+
+@implementation PKSyncContextPoolTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+    self.contextPool = [[PKSyncContextPool alloc] initWithPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator]];
+    
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [book setValue:@"1" forKey:PKDefaultSyncAttributeName];
+    [book setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+}
+
+- (NSManagedObjectID *)bookObjectID
+{
+    NSArray *books = [self.managedObjectContext executeFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Book"] error:nil];
+    return [[books lastObject] objectID];
+}
+
+- (void)testContextShouldBeReused
+{
+    __block NSManagedObjectContext *firstContext = nil;
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        firstContext = managedObjectContext;
+    }];
+    
+    __block NSManagedObjectContext *secondContext = nil;
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        secondContext = managedObjectContext;
+    }];
+    XCTAssertTrue(firstContext == secondContext, @"");
+}
+
+- (void)testObjectsShouldStayRegisteredBetweenUses
+{
+    NSManagedObjectID *objectID = [self bookObjectID];
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        XCTAssertEqualObjects(@"To Kill a Mockingbird", [[managedObjectContext existingObjectWithID:objectID error:nil] valueForKey:@"title"], @"");
+    }];
+    
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        NSManagedObject *book = [managedObjectContext objectRegisteredForID:objectID];
+        XCTAssertNotNil(book, @"");
+        XCTAssertFalse([book isFault], @"");
+    }];
+}
+
+- (void)testObjectsShouldNotBeKeptPastTheHotObjectLimit
+{
+    self.contextPool.hotObjectLimit = 0;
+    NSManagedObjectID *objectID = [self bookObjectID];
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        [managedObjectContext existingObjectWithID:objectID error:nil];
+    }];
+    
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        XCTAssertNil([managedObjectContext objectRegisteredForID:objectID], @"");
+    }];
+}
+
+- (void)testUsedObjectsShouldBeKeptBeforeOtherRegisteredObjects
+{
+    NSManagedObjectID *objectID = [self bookObjectID];
+    NSMutableArray *otherObjects = [[NSMutableArray alloc] init];
+    for (NSUInteger index = 0; index < 20; index++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        [book setValue:[NSString stringWithFormat:@"%lu", (unsigned long)index + 2] forKey:PKDefaultSyncAttributeName];
+        [book setValue:@"Go Set a Watchman" forKey:@"title"];
+        [otherObjects addObject:book];
+    }
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    NSArray *otherObjectIDs = [otherObjects valueForKey:@"objectID"];
+    
+    self.contextPool.hotObjectLimit = 1;
+    for (NSUInteger use = 0; use < 2; use++) {
+        [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+            NSManagedObject *book = [managedObjectContext existingObjectWithID:objectID error:nil];
+            for (NSManagedObjectID *otherObjectID in otherObjectIDs) {
+                [managedObjectContext existingObjectWithID:otherObjectID error:nil];
+            }
+            [self.contextPool addUsedManagedObjects:@[book] inManagedObjectContext:managedObjectContext];
+        }];
+    }
+    
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        XCTAssertNotNil([managedObjectContext objectRegisteredForID:objectID], @"");
+    }];
+}
+
+- (void)testSavesOfOtherContextsShouldRefreshHotObjects
+{
+    NSManagedObjectID *objectID = [self bookObjectID];
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        [managedObjectContext existingObjectWithID:objectID error:nil];
+    }];
+    
+    [[self.managedObjectContext objectWithID:objectID] setValue:@"Go Set a Watchman" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    [self.contextPool performBlockAndWait:^(NSManagedObjectContext *managedObjectContext) {
+        XCTAssertEqualObjects(@"Go Set a Watchman", [[managedObjectContext objectRegisteredForID:objectID] valueForKey:@"title"], @"");
+    }];
+}
+
+@end
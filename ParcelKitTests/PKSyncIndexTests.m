@@ -0,0 +1,215 @@
+//
+//  PKSyncIndexTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "NSManagedObjectContext+ParcelKitTests.h"
+#import "PKSyncIndex.h"
+#import "PKSyncManager.h"
+
+@interface PKSyncIndexTests : XCTestCase
+@property (strong, nonatomic) NSManagedObjectContext *managedObjectContext;
+@property (strong, nonatomic) PKSyncIndex *syncIndex;
+@end
+
+@implementation PKSyncIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+    self.syncIndex = [[PKSyncIndex alloc] initWithPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator] syncAttributeName:PKDefaultSyncAttributeName];
+    [self.syncIndex startObserving];
+}
+
+- (void)tearDown
+{
+    [self.syncIndex stopObserving];
+    [super tearDown];
+}
+
+- (NSManagedObject *)insertBookWithSyncID:(NSString *)syncID
+{
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [book setValue:syncID forKey:PKDefaultSyncAttributeName];
+    [book setValue:@"A Book" forKey:@"title"];
+    return book;
+}
+
+- (NSDictionary *)booksKeyedBySyncID:(NSArray *)syncIDs
+{
+    NSError *error = nil;
+    NSDictionary *books = [self.syncIndex managedObjectsKeyedBySyncID:syncIDs entityName:@"Book" inManagedObjectContext:self.managedObjectContext returnsObjectsAsFaults:NO error:&error];
+    XCTAssertNotNil(books, @"Lookup failed: %@", error);
+    return books;
+}
+
+- (void)testSavedObjectsShouldBeIndexed
+{
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    XCTAssertNil([self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+    
+    [self.managedObjectContext save:NULL];
+    XCTAssertEqualObjects([book objectID], [self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+}
+
+- (void)testDeletedObjectsShouldBeRemovedFromIndex
+{
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    
+    [self.managedObjectContext deleteObject:book];
+    [self.managedObjectContext save:NULL];
+    XCTAssertNil([self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+    XCTAssertEqual(0, (int)[[self booksKeyedBySyncID:@[@"1"]] count], @"");
+}
+
+- (void)testChangedSyncIDShouldReplaceIndexedSyncID
+{
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    
+    [book setValue:@"2" forKey:PKDefaultSyncAttributeName];
+    [self.managedObjectContext save:NULL];
+    XCTAssertNil([self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+    XCTAssertEqualObjects([book objectID], [self.syncIndex managedObjectIDForSyncID:@"2" entityName:@"Book"], @"");
+}
+
+- (void)testLookupShouldFindObjectsSavedBeforeObserving
+{
+    [self.syncIndex stopObserving];
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    [self.syncIndex startObserving];
+    
+    NSDictionary *books = [self booksKeyedBySyncID:@[@"1", @"2"]];
+    XCTAssertEqual(1, (int)[books count], @"");
+    XCTAssertEqualObjects(book, books[@"1"], @"");
+    XCTAssertEqualObjects([book objectID], [self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+}
+
+- (void)testLookupShouldFindUnsavedObjects
+{
+    [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    [self booksKeyedBySyncID:@[@"1"]];
+    
+    NSManagedObject *book = [self insertBookWithSyncID:@"2"];
+    XCTAssertEqualObjects(book, [self booksKeyedBySyncID:@[@"2"]][@"2"], @"");
+}
+
+- (void)testLookupShouldVerifyEvictedObjects
+{
+    self.syncIndex.memoryBudget = 1024;
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    NSMutableArray *syncIDs = [[NSMutableArray alloc] init];
+    for (NSUInteger index = 0; index < 50; index++) {
+        NSString *syncID = [NSString stringWithFormat:@"%lu", (unsigned long)index];
+        [books addObject:[self insertBookWithSyncID:syncID]];
+        [syncIDs addObject:syncID];
+    }
+    [self.managedObjectContext save:NULL];
+    
+    NSDictionary *booksBySyncID = [self booksKeyedBySyncID:syncIDs];
+    XCTAssertEqual(50, (int)[booksBySyncID count], @"");
+    for (NSManagedObject *book in books) {
+        XCTAssertEqualObjects(book, booksBySyncID[[book valueForKey:PKDefaultSyncAttributeName]], @"");
+    }
+}
+
+- (void)testLoadThatDoesNotFitShouldNotEvictEntries
+{
+    [self.syncIndex stopObserving];
+    NSMutableArray *syncIDs = [[NSMutableArray alloc] init];
+    for (NSUInteger index = 0; index < 10; index++) {
+        NSString *syncID = [[NSString stringWithFormat:@"%lu", (unsigned long)index] stringByPaddingToLength:120 withString:@"-" startingAtIndex:0];
+        [self insertBookWithSyncID:syncID];
+        [syncIDs addObject:syncID];
+    }
+    [self.managedObjectContext save:NULL];
+    [self.syncIndex startObserving];
+    
+    // Barely enough for the entries without their identifiers
+    self.syncIndex.memoryBudget = 2 * 10 * 96;
+    XCTAssertEqual(1, (int)[[self booksKeyedBySyncID:@[[syncIDs lastObject]]] count], @"");
+    XCTAssertEqual(10, (int)[[self booksKeyedBySyncID:syncIDs] count], @"");
+}
+
+- (void)testLookupShouldSkipObjectsDeletedOutsideObservedSaves
+{
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    NSManagedObjectID *objectID = [book objectID];
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self.syncIndex];
+    NSManagedObjectContext *otherManagedObjectContext = [[NSManagedObjectContext alloc] init];
+    [otherManagedObjectContext setPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator]];
+    [otherManagedObjectContext deleteObject:[otherManagedObjectContext objectWithID:objectID]];
+    [otherManagedObjectContext save:NULL];
+    [self.managedObjectContext reset];
+    
+    XCTAssertEqualObjects(objectID, [self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+    XCTAssertEqual(0, (int)[[self booksKeyedBySyncID:@[@"1"]] count], @"");
+    XCTAssertNil([self.syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+}
+
+- (void)testLookupShouldFindObjectsSavedOutsideObservedSaves
+{
+    [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    XCTAssertEqual(1, (int)[[self booksKeyedBySyncID:@[@"1"]] count], @"");
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self.syncIndex];
+    NSManagedObjectContext *otherManagedObjectContext = [[NSManagedObjectContext alloc] init];
+    [otherManagedObjectContext setPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator]];
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:otherManagedObjectContext];
+    [book setValue:@"2" forKey:PKDefaultSyncAttributeName];
+    [book setValue:@"A Book" forKey:@"title"];
+    [otherManagedObjectContext save:NULL];
+    
+    NSDictionary *books = [self booksKeyedBySyncID:@[@"2"]];
+    XCTAssertEqual(1, (int)[books count], @"");
+    XCTAssertEqualObjects([book objectID], [books[@"2"] objectID], @"");
+}
+
+- (void)testSnapshotShouldRestoreIndex
+{
+    NSManagedObject *book = [self insertBookWithSyncID:@"1"];
+    [self.managedObjectContext save:NULL];
+    
+    NSURL *snapshotURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"PKSyncIndexTests.plist"]];
+    [[NSFileManager defaultManager] removeItemAtURL:snapshotURL error:NULL];
+    self.syncIndex.snapshotURL = snapshotURL;
+    NSError *error = nil;
+    XCTAssertTrue([self.syncIndex writeSnapshot:&error], @"Writing snapshot failed: %@", error);
+    
+    PKSyncIndex *syncIndex = [[PKSyncIndex alloc] initWithPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator] syncAttributeName:PKDefaultSyncAttributeName];
+    syncIndex.snapshotURL = snapshotURL;
+    XCTAssertEqualObjects([book objectID], [syncIndex managedObjectIDForSyncID:@"1" entityName:@"Book"], @"");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:snapshotURL error:NULL];
+}
+
+@end
@@ -0,0 +1,168 @@
+//
+//  PKSyncManagerPerformanceTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "NSManagedObjectContext+ParcelKitTests.h"
+#import "NSManagedObjectContext+ParcelKit.h"
+#import "PKSyncManager.h"
+#import "PKDatastoreMock.h"
+#import "PKRecordMock.h"
+#import "PKListMock.h"
+
+static const NSUInteger PKPerformanceTestRecordCount = 2000;
+static const NSUInteger PKPerformanceTestBootstrapRecordCount = 10000;
+
+@interface PKSyncManager (ParcelKitPerformanceTests)
+- (BOOL)updateCoreDataWithDatastoreChanges:(NSDictionary *)changes;
+@end
+
+@interface PKSyncManagerPerformanceTests : XCTestCase
+@property (strong, nonatomic) NSManagedObjectContext *managedObjectContext;
+@property (strong, nonatomic) PKSyncManager *syncManager;
+@property (strong, nonatomic) NSArray *records;
+@end
+
+@implementation PKSyncManagerPerformanceTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+    self.syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:self.managedObjectContext datastore:(DBDatastore *)[[PKDatastoreMock alloc] init]];
+    [self.syncManager setTablesForEntityNamesWithDictionary:@{@"Book": @"books", @"Author": @"authors", @"Publisher": @"publishers"}];
+    
+    NSMutableArray *records = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < PKPerformanceTestRecordCount; i++) {
+        NSString *identifier = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        [book setValue:identifier forKey:PKDefaultSyncAttributeName];
+        [book setValue:[NSString stringWithFormat:@"Book %@", identifier] forKey:@"title"];
+        
+        [records addObject:[PKRecordMock record:identifier withFields:@{@"title": [NSString stringWithFormat:@"Book %@ (Revised Edition)", identifier]}]];
+    }
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    self.records = records;
+}
+
+- (void)tearDown
+{
+    // Put teardown code here; it will be run once, after the last test case.
+    [super tearDown];
+}
+
+- (NSManagedObjectContext *)privateManagedObjectContext
+{
+    NSManagedObjectContext *managedObjectContext = [[NSManagedObjectContext alloc] initWithConcurrencyType:NSPrivateQueueConcurrencyType];
+    [managedObjectContext setPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator]];
+    [managedObjectContext setUndoManager:nil];
+    return managedObjectContext;
+}
+
+#pragma mark - Incoming Lookup
+
+- (void)testPerRecordLookupPerformance
+{
+    // Baseline: one fetch request per incoming record
+    NSManagedObjectContext *managedObjectContext = [self privateManagedObjectContext];
+    [self measureBlock:^{
+        [managedObjectContext performBlockAndWait:^{
+            NSUInteger count = 0;
+            NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+            [fetchRequest setFetchLimit:1];
+            for (DBRecord *record in self.records) {
+                [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"%K == %@", PKDefaultSyncAttributeName, record.recordId]];
+                count += [[managedObjectContext executeFetchRequest:fetchRequest error:nil] count];
+            }
+            XCTAssertEqual(PKPerformanceTestRecordCount, count, @"");
+            [managedObjectContext reset];
+        }];
+    }];
+}
+
+- (void)testBatchedLookupPerformance
+{
+    NSManagedObjectContext *managedObjectContext = [self privateManagedObjectContext];
+    NSArray *syncIDs = [self.records valueForKey:@"recordId"];
+    [self measureBlock:^{
+        [managedObjectContext performBlockAndWait:^{
+            NSDictionary *managedObjects = [managedObjectContext pk_managedObjectsKeyedBySyncID:syncIDs entityName:@"Book" syncAttributeName:PKDefaultSyncAttributeName error:nil];
+            XCTAssertEqual(PKPerformanceTestRecordCount, [managedObjects count], @"");
+            [managedObjectContext reset];
+        }];
+    }];
+}
+
+- (void)testIncomingUpdatePerformance
+{
+    [self measureBlock:^{
+        XCTAssertTrue([self.syncManager updateCoreDataWithDatastoreChanges:@{@"books": self.records}], @"");
+    }];
+}
+
+#pragma mark - Bootstrap
+
+// Materializes a datastore of books and their authors in an empty store
+- (void)measureInitialSyncBootstrappingEmptyEntities:(BOOL)bootstrapsEmptyEntities
+{
+    NSMutableArray *authors = [[NSMutableArray alloc] init];
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < PKPerformanceTestBootstrapRecordCount; i++) {
+        NSString *identifier = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        NSString *authorIdentifier = [NSString stringWithFormat:@"%lu", (unsigned long)(i / 10)];
+        if (i % 10 == 0) {
+            [authors addObject:[PKRecordMock record:authorIdentifier withFields:@{@"name": [NSString stringWithFormat:@"Author %@", authorIdentifier]}]];
+        }
+        [books addObject:[PKRecordMock record:identifier withFields:@{@"title": [NSString stringWithFormat:@"Book %@", identifier], @"authors": [[PKListMock alloc] initWithValues:@[authorIdentifier]]}]];
+    }
+    NSDictionary *changes = @{@"books": books, @"authors": authors};
+    
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        NSManagedObjectContext *managedObjectContext = [NSManagedObjectContext pk_managedObjectContextWithModelName:@"Tests"];
+        PKSyncManager *syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:managedObjectContext datastore:(DBDatastore *)[[PKDatastoreMock alloc] init]];
+        [syncManager setTablesForEntityNamesWithDictionary:@{@"Book": @"books", @"Author": @"authors"}];
+        syncManager.bootstrapsEmptyEntities = bootstrapsEmptyEntities;
+        
+        [self startMeasuring];
+        XCTAssertTrue([syncManager updateCoreDataWithDatastoreChanges:changes], @"");
+        [self stopMeasuring];
+        
+        XCTAssertEqual(PKPerformanceTestBootstrapRecordCount, [managedObjectContext countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Book"] error:nil], @"");
+    }];
+}
+
+- (void)testInitialSyncPerformance
+{
+    // Baseline: every incoming record is looked up before it is inserted
+    [self measureInitialSyncBootstrappingEmptyEntities:NO];
+}
+
+- (void)testBootstrapPerformance
+{
+    [self measureInitialSyncBootstrappingEmptyEntities:YES];
+}
+
+@end
@@ -27,14 +27,21 @@
 #import <OCMock/OCMock.h>
 #import "NSManagedObjectContext+ParcelKitTests.h"
 #import "PKSyncManager.h"
+#import "PKConstants.h"
 #import "PKDatastoreMock.h"
 #import "PKDatastoreStatusMock.h"
 #import "PKTableMock.h"
 #import "PKRecordMock.h"
+#import "PKListMock.h"
+#import "PKEntitySyncPlan.h"
+#import "PKSyncMetrics.h"
+#import "PKChangeRecorder.h"
 #import "Author.h"
 
 @interface PKSyncManager (ParcelKitTests)
 - (void)updateCoreDataWithDatastoreChanges:(NSDictionary *)changes;
+- (void)syncManagedObjectContextDidSave:(NSNotification *)notification;
+- (dispatch_queue_t)syncQueue;
 @end
 
 @interface PKSyncManagerTests : XCTestCase
@@ -53,6 +60,11 @@
     self.datastore = [OCMockObject partialMockForObject:[[PKDatastoreMock alloc] init]];
     self.syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:self.managedObjectContext datastore:self.datastore];
     [self.syncManager setTablesForEntityNamesWithDictionary:@{@"Book": @"books", @"Author": @"authors", @"Publisher": @"publishers"}];
+    
+    // Sync right away so incoming changes can be checked as soon as the sync queue is done
+    self.syncManager.minimumSyncLatency = 0;
+    self.syncManager.maximumSyncLatency = 0;
+    self.syncManager.maximumStatusNotificationsPerSecond = 0;
 }
 
 - (void)tearDown
@@ -61,6 +73,34 @@
     [super tearDown];
 }
 
+// Updates the datastore status and waits for the sync it starts and the merges the sync hands to the main queue
+- (void)updateDatastoreStatus:(PKDatastoreStatusMock *)status withChanges:(NSDictionary *)changes
+{
+    [self.datastore updateStatus:status withChanges:changes];
+    dispatch_sync([self.syncManager syncQueue], ^{});
+    
+    __block BOOL done = NO;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        done = YES;
+    });
+    [self runMainRunLoopUntilCondition:^BOOL{ return done; } timeout:2.0];
+}
+
+- (void)runMainRunLoopUntilCondition:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout
+{
+    NSDate *timeoutDate = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (!condition() && [timeoutDate timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+}
+
+// Saves are written to the datastore on the sync queue once they went through
+- (void)saveManagedObjectContextAndWaitForSyncQueue
+{
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    dispatch_sync([self.syncManager syncQueue], ^{});
+}
+
 #pragma mark - Sync Manager Setup
 
 - (void)testSyncIdShouldReturnAString
@@ -241,7 +281,7 @@
     [self.syncManager startObserving];
     
     PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird"}];
-    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
     
     NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
     NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
@@ -258,7 +298,7 @@
     
     PKRecordMock *bookA = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird"}];
     PKRecordMock *bookB = [PKRecordMock record:@"2" withFields:@{@"title": @"The Grapes of Wrath"}];
-    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB]}];
     
     NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
     [fetchRequest setSortDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"syncID" ascending:YES]]];
@@ -284,7 +324,7 @@
     [self.syncManager startObserving];
     
     PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird Part 2: Birdy's Revenge"}];
-    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
     
     NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
     NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
@@ -305,13 +345,213 @@
     [self.syncManager startObserving];
     
     PKRecordMock *book = [PKRecordMock record:@"1" withFields:nil deleted:YES];
-    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
     
     NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
     NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
     XCTAssertEqual(0, (int)[objects count], @"");
 }
 
+- (void)testIncomingDatastoreChangeShouldUpdateCoreDataWithMoreObjectsThanFetchBatchSize
+{
+    NSUInteger count = (PKSyncIDFetchBatchSize * 2) + 1;
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *identifier = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        if (i % 2) {
+            NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+            [object setValue:identifier forKey:self.syncManager.syncAttributeName];
+            [object setValue:@"Untitled" forKey:@"title"];
+        }
+        [books addObject:[PKRecordMock record:identifier withFields:@{@"title": identifier}]];
+    }
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    [self.syncManager startObserving];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": books}];
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(count, [objects count], @"");
+    for (NSManagedObject *object in objects) {
+        XCTAssertEqualObjects([object valueForKey:self.syncManager.syncAttributeName], [object valueForKey:@"title"], @"");
+    }
+}
+
+- (void)testIncomingDatastoreChangeShouldSetRelationshipsBetweenObjectsOfTheSameChangeSet
+{
+    NSManagedObject *publisher = [NSEntityDescription insertNewObjectForEntityForName:@"Publisher" inManagedObjectContext:self.managedObjectContext];
+    [publisher setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [publisher setValue:@"Harper" forKey:@"name"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    [self.syncManager startObserving];
+    
+    PKRecordMock *bookA = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"authors": [[PKListMock alloc] initWithValues:@[@"1"]], @"publisher": @"1"}];
+    PKRecordMock *bookB = [PKRecordMock record:@"2" withFields:@{@"title": @"Go Set a Watchman", @"authors": [[PKListMock alloc] initWithValues:@[@"1", @"2"]], @"publisher": @"1"}];
+    PKRecordMock *authorA = [PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee", @"books": [[PKListMock alloc] initWithValues:@[@"1", @"2"]]}];
+    PKRecordMock *authorB = [PKRecordMock record:@"2" withFields:@{@"name": @"Truman Capote", @"books": [[PKListMock alloc] initWithValues:@[@"2"]]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB], @"authors": @[authorA, authorB]}];
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Author"];
+    [fetchRequest setSortDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"syncID" ascending:YES]]];
+    NSArray *authors = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(2, (int)[authors count], @"");
+    XCTAssertEqualObjects((@[@"1", @"2"]), [[[authors[0] valueForKey:@"books"] array] valueForKey:@"syncID"], @"");
+    XCTAssertEqualObjects((@[@"2"]), [[[authors[1] valueForKey:@"books"] array] valueForKey:@"syncID"], @"");
+    
+    for (NSManagedObject *book in [[authors[0] valueForKey:@"books"] array]) {
+        XCTAssertEqualObjects(publisher, [book valueForKey:@"publisher"], @"");
+    }
+}
+
+- (void)testIncomingDatastoreChangeShouldUpdateCoreDataInWindows
+{
+    self.syncManager.incomingChangesWindowSize = 7;
+    [self.syncManager startObserving];
+
+    NSUInteger count = 50;
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString *identifier = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        [books addObject:[PKRecordMock record:identifier withFields:@{@"title": identifier}]];
+    }
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": books}];
+
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(count, [objects count], @"");
+    for (NSManagedObject *object in objects) {
+        XCTAssertEqualObjects([object valueForKey:self.syncManager.syncAttributeName], [object valueForKey:@"title"], @"");
+    }
+}
+
+- (void)testIncomingDatastoreChangeShouldSetRelationshipsToObjectsOfLaterWindows
+{
+    self.syncManager.incomingChangesWindowSize = 1;
+    [self.syncManager startObserving];
+
+    PKRecordMock *bookA = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"authors": [[PKListMock alloc] initWithValues:@[@"1"]]}];
+    PKRecordMock *bookB = [PKRecordMock record:@"2" withFields:@{@"title": @"Go Set a Watchman", @"authors": [[PKListMock alloc] initWithValues:@[@"1", @"2"]]}];
+    PKRecordMock *authorA = [PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee", @"books": [[PKListMock alloc] initWithValues:@[@"1", @"2"]]}];
+    PKRecordMock *authorB = [PKRecordMock record:@"2" withFields:@{@"name": @"Truman Capote", @"books": [[PKListMock alloc] initWithValues:@[@"2"]]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB], @"authors": @[authorA, authorB]}];
+
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Author"];
+    [fetchRequest setSortDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"syncID" ascending:YES]]];
+    NSArray *authors = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(2, (int)[authors count], @"");
+    XCTAssertEqualObjects((@[@"1", @"2"]), [[[authors[0] valueForKey:@"books"] array] valueForKey:@"syncID"], @"");
+    XCTAssertEqualObjects((@[@"2"]), [[[authors[1] valueForKey:@"books"] array] valueForKey:@"syncID"], @"");
+}
+
+- (void)testIncomingDatastoreChangeShouldBootstrapEmptyEntities
+{
+    self.syncManager.bootstrapsEmptyEntities = YES;
+    NSManagedObject *publisher = [NSEntityDescription insertNewObjectForEntityForName:@"Publisher" inManagedObjectContext:self.managedObjectContext];
+    [publisher setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [publisher setValue:@"Harper" forKey:@"name"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    [self.syncManager startObserving];
+    
+    PKRecordMock *bookA = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"authors": [[PKListMock alloc] initWithValues:@[@"1"]], @"publisher": @"1"}];
+    PKRecordMock *bookB = [PKRecordMock record:@"2" withFields:@{@"title": @"Go Set a Watchman"}];
+    PKRecordMock *author = [PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee", @"books": [[PKListMock alloc] initWithValues:@[@"1"]]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB], @"authors": @[author]}];
+    
+    NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
+    [fetchRequest setSortDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"syncID" ascending:YES]]];
+    NSArray *books = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(2, (int)[books count], @"");
+    XCTAssertEqualObjects(publisher, [books[0] valueForKey:@"publisher"], @"");
+    XCTAssertEqualObjects((@[@"1"]), [[[books[0] valueForKey:@"authors"] allObjects] valueForKey:@"syncID"], @"");
+    XCTAssertEqualObjects(@"Go Set a Watchman", [books[1] valueForKey:@"title"], @"");
+    
+    // Once bootstrapped, incoming records update the objects they were inserted as
+    PKRecordMock *updatedBook = [PKRecordMock record:@"2" withFields:@{@"title": @"Go Set a Watchman (Revised Edition)"}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[updatedBook]}];
+    
+    books = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
+    XCTAssertEqual(2, (int)[books count], @"");
+    XCTAssertEqualObjects(@"Go Set a Watchman (Revised Edition)", [books[1] valueForKey:@"title"], @"");
+}
+
+- (void)testInvalidBootstrappedRecordsShouldCallDelegateMethodOnceRelationshipsAreSet
+{
+    __block NSInteger authorCount = -1;
+    id delegateMock = OCMProtocolMock(@protocol(PKSyncManagerDelegate));
+    OCMStub([delegateMock syncManager:self.syncManager managedObject:[OCMArg any] insertValidationFailed:[OCMArg any] inManagedObjectContext:[OCMArg any]]).andDo(^(NSInvocation *invocation) {
+        __unsafe_unretained NSManagedObject *managedObject = nil;
+        [invocation getArgument:&managedObject atIndex:3];
+        if ([[[managedObject entity] name] isEqualToString:@"Book"]) {
+            authorCount = (NSInteger)[[managedObject valueForKey:@"authors"] count];
+        }
+    });
+    
+    self.syncManager.delegate = delegateMock;
+    self.syncManager.bootstrapsEmptyEntities = YES;
+    [self.syncManager startObserving];
+    
+    PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @"", @"authors": [[PKListMock alloc] initWithValues:@[@"1"]]}];
+    PKRecordMock *author = [PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee"}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book], @"authors": @[author]}];
+    
+    XCTAssertEqual((NSInteger)1, authorCount, @"");
+}
+
+- (void)testIncomingDatastoreChangesOfIndependentTablesShouldBeAppliedInSeparateContexts
+{
+    self.syncManager.appliesIndependentTablesConcurrently = YES;
+    [self.syncManager setTable:@"notes" forEntityName:@"Note"];
+    [self.syncManager startObserving];
+    
+    NSMutableSet *savedContexts = [[NSMutableSet alloc] init];
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:NSManagedObjectContextDidSaveNotification object:nil queue:nil usingBlock:^(NSNotification *notification) {
+        if (notification.object == self.managedObjectContext) return;
+        @synchronized(savedContexts) {
+            [savedContexts addObject:notification.object];
+        }
+    }];
+    
+    PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird", @"authors": [[PKListMock alloc] initWithValues:@[@"1"]]}];
+    PKRecordMock *author = [PKRecordMock record:@"1" withFields:@{@"name": @"Harper Lee"}];
+    PKRecordMock *note = [PKRecordMock record:@"1" withFields:@{@"text": @"Read again"}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book], @"authors": @[author], @"notes": @[note]}];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    
+    XCTAssertEqual((NSUInteger)2, [savedContexts count], @"");
+    
+    NSArray *books = [self.managedObjectContext executeFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Book"] error:nil];
+    XCTAssertEqual(1, (int)[books count], @"");
+    XCTAssertEqualObjects(@"Harper Lee", [[[books[0] valueForKey:@"authors"] anyObject] valueForKey:@"name"], @"");
+    
+    NSArray *notes = [self.managedObjectContext executeFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Note"] error:nil];
+    XCTAssertEqual(1, (int)[notes count], @"");
+    XCTAssertEqualObjects(@"Read again", [notes[0] valueForKey:@"text"], @"");
+}
+
+- (void)testIndependentTablesShouldBeAppliedConcurrentlyByAFreshSyncManager
+{
+    // Neither the context pool nor the sync index exist before the first apply
+    for (NSUInteger i = 0; i < 10; i++) {
+        PKSyncManager *syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:self.managedObjectContext datastore:self.datastore];
+        [syncManager setTablesForEntityNamesWithDictionary:[self.syncManager tablesByEntityName]];
+        [syncManager setTable:@"notes" forEntityName:@"Note"];
+        syncManager.appliesIndependentTablesConcurrently = YES;
+        
+        NSString *syncID = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        PKRecordMock *book = [PKRecordMock record:syncID withFields:@{@"title": @"To Kill a Mockingbird"}];
+        PKRecordMock *note = [PKRecordMock record:syncID withFields:@{@"text": @"Read again"}];
+        dispatch_sync([syncManager syncQueue], ^{
+            [syncManager updateCoreDataWithDatastoreChanges:@{@"books": @[book], @"notes": @[note]}];
+        });
+    }
+    
+    XCTAssertEqual(10, (int)[self.managedObjectContext countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Book"] error:nil], @"");
+    XCTAssertEqual(10, (int)[self.managedObjectContext countForFetchRequest:[NSFetchRequest fetchRequestWithEntityName:@"Note"] error:nil], @"");
+}
+
 - (void)testNonIncomingDatastoreChangesShouldNotUpdateCoreData
 {
     [self.syncManager startObserving];
@@ -323,7 +563,7 @@
     status.downloading = YES;
     status.uploading = YES;
     status.outgoing = YES;
-    [self.datastore updateStatus:status withChanges:@{@"books": @[book]}];
+    [self updateDatastoreStatus:status withChanges:@{@"books": @[book]}];
     
     NSFetchRequest *fetchRequest = [NSFetchRequest fetchRequestWithEntityName:@"Book"];
     NSArray *objects = [self.managedObjectContext executeFetchRequest:fetchRequest error:nil];
@@ -343,7 +583,7 @@
     [object setValue:@"" forKey:@"title"];
     
     PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @""}];
-    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
     
     OCMVerify([delegateMock syncManager:self.syncManager managedObject:[OCMArg any] insertValidationFailed:[OCMArg any] inManagedObjectContext:[OCMArg any]]);
 }
@@ -357,7 +597,7 @@
     NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
     [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
     [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"books"];
     XCTAssertNotNil(table, @"");
@@ -380,7 +620,7 @@
     [objectB setValue:@"2" forKey:self.syncManager.syncAttributeName];
     [objectB setValue:@"The Grapes of Wrath" forKey:@"title"];
     
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"books"];
     XCTAssertNotNil(table, @"");
@@ -409,7 +649,7 @@
     [review setValue:@"Goodreads" forKey:@"reviewer"];
     [review setValue:@(4.23) forKey:@"rating"];
     
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     XCTAssertEqual(1, [[book valueForKey:@"reviews"] count], @"");
     
     DBTable *table = [self.datastore getTable:@"books"];
@@ -428,10 +668,10 @@
     NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
     [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
     [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     [object setValue:@"To Kill a Mockingbird Part 2: Birdy's Revenge" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"books"];
     XCTAssertNotNil(table, @"");
@@ -450,7 +690,7 @@
     [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
     [object setValue:@"Harper Lee" forKey:@"name"];
     object.isRecordSyncable = NO;
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"authors"];
     XCTAssertNotNil(table, @"");
@@ -466,10 +706,10 @@
     NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
     [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
     [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     [self.managedObjectContext deleteObject:object];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"books"];
     XCTAssertNotNil(table, @"");
@@ -485,11 +725,11 @@
     Author *object = [NSEntityDescription insertNewObjectForEntityForName:@"Author" inManagedObjectContext:self.managedObjectContext];
     [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
     [object setValue:@"Harper Lee" forKey:@"name"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     object.isRecordSyncable = NO;
     [self.managedObjectContext deleteObject:object];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     DBTable *table = [self.datastore getTable:@"authors"];
     XCTAssertNotNil(table, @"");
@@ -510,7 +750,7 @@
     [book setValue:@"Treasure Island" forKey:@"title"];
     [book setValue:publisher forKey:@"publisher"];
     
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     
     XCTAssertNotNil([publisher valueForKey:self.syncManager.syncAttributeName], @"");
     DBTable *publishers = [self.datastore getTable:@"publishers"];
@@ -527,16 +767,445 @@
 {
     NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
     [book setValue:@"Treasure Island" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     XCTAssertNil([book valueForKey:self.syncManager.syncAttributeName], @"");
     
     [self.syncManager startObserving];
     
     [book setValue:@"Return to Treasure Island" forKey:@"title"];
-    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
     XCTAssertNotNil([book valueForKey:self.syncManager.syncAttributeName], @"");
     DBTable *books = [self.datastore getTable:@"books"];
     XCTAssertNotNil(books, @"");
     XCTAssertNotNil([books getRecord:[book valueForKey:self.syncManager.syncAttributeName] error:nil], @"");
 }
+
+#pragma mark - Batching
+
+- (void)insertBooksWithCount:(NSUInteger)count
+{
+    for (NSUInteger i = 0; i < count; i++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        [book setValue:[NSString stringWithFormat:@"%lu", (unsigned long)i] forKey:self.syncManager.syncAttributeName];
+        [book setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    }
+}
+
+- (void)testCoreDataSaveShouldSyncSmallRecordsInASingleBatch
+{
+    [self.syncManager startObserving];
+    [self insertBooksWithCount:50];
+    self.syncManager.syncBatchByteLimit = PKSyncBatchByteLimit;
+    
+    XCTAssertEqual((NSUInteger)1, [self.syncManager numberOfSyncBatchesForPendingChanges], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
+    XCTAssertEqual((NSUInteger)1, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testCoreDataSaveShouldSyncBeforeByteLimitIsReached
+{
+    [self.syncManager startObserving];
+    [self insertBooksWithCount:10];
+    
+    NSManagedObject *book = [[self.managedObjectContext insertedObjects] anyObject];
+    PKEntitySyncPlan *syncPlan = [[PKEntitySyncPlan alloc] initWithEntity:[book entity] tableID:@"books" syncAttributeName:PKDefaultSyncAttributeName];
+    NSUInteger recordSize = [syncPlan estimatedChangeSizeOfValues:[syncPlan valuesToWriteForManagedObject:book]];
+    self.syncManager.syncBatchByteLimit = recordSize * 3;
+    
+    NSUInteger numberOfSyncBatches = [self.syncManager numberOfSyncBatchesForPendingChanges];
+    XCTAssertEqual((NSUInteger)4, numberOfSyncBatches, @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
+    XCTAssertEqual(numberOfSyncBatches, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testCoreDataSaveShouldSyncByCountWithoutByteLimit
+{
+    [self.syncManager startObserving];
+    [self insertBooksWithCount:10];
+    XCTAssertEqual((NSUInteger)0, self.syncManager.syncBatchByteLimit, @"");
+    self.syncManager.syncBatchSize = 4;
+    
+    XCTAssertEqual((NSUInteger)3, [self.syncManager numberOfSyncBatchesForPendingChanges], @"");
+    [self saveManagedObjectContextAndWaitForSyncQueue];
+    XCTAssertEqual((NSUInteger)3, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testCoreDataSaveShouldCountUnsyncedChangesTowardsTheFirstBatch
+{
+    [self.syncManager startObserving];
+    [self insertBooksWithCount:1];
+    self.syncManager.syncBatchByteLimit = PKSyncBatchByteLimit;
+    [(PKDatastoreMock *)self.datastore setUnsyncedChangesSize:self.syncManager.syncBatchByteLimit];
+    
+    XCTAssertEqual((NSUInteger)2, [self.syncManager numberOfSyncBatchesForPendingChanges], @"");
+}
+
+#pragma mark - Merging
+
+- (void)testSyncSaveShouldNotRegisterUnregisteredObjectsWhenMerging
+{
+    NSManagedObjectContext *syncContext = [[NSManagedObjectContext alloc] init];
+    [syncContext setPersistentStoreCoordinator:[self.managedObjectContext persistentStoreCoordinator]];
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:syncContext];
+    [book setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [book setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([syncContext save:nil], @"");
+    
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:NSManagedObjectContextDidSaveNotification object:syncContext queue:nil usingBlock:^(NSNotification *notification) {
+        [self.syncManager syncManagedObjectContextDidSave:notification];
+    }];
+    [book setValue:@"Go Set a Watchman" forKey:@"title"];
+    XCTAssertTrue([syncContext save:nil], @"");
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    
+    XCTAssertNil([self.managedObjectContext objectRegisteredForID:[book objectID]], @"");
+}
+
+- (void)testSyncSaveOnAnotherThreadShouldBeMergedAsynchronously
+{
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [book setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [book setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    NSManagedObjectID *objectID = [book objectID];
+    NSPersistentStoreCoordinator *persistentStoreCoordinator = [self.managedObjectContext persistentStoreCoordinator];
+    dispatch_semaphore_t saved = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSManagedObjectContext *syncContext = [[NSManagedObjectContext alloc] init];
+        [syncContext setPersistentStoreCoordinator:persistentStoreCoordinator];
+        id observer = [[NSNotificationCenter defaultCenter] addObserverForName:NSManagedObjectContextDidSaveNotification object:syncContext queue:nil usingBlock:^(NSNotification *notification) {
+            [self.syncManager syncManagedObjectContextDidSave:notification];
+        }];
+        [[syncContext objectWithID:objectID] setValue:@"Go Set a Watchman" forKey:@"title"];
+        [syncContext save:nil];
+        [[NSNotificationCenter defaultCenter] removeObserver:observer];
+        dispatch_semaphore_signal(saved);
+    });
+    dispatch_semaphore_wait(saved, DISPATCH_TIME_FOREVER);
+    
+    // The merge waits for the main thread instead of blocking the saving thread
+    XCTAssertEqualObjects(@"To Kill a Mockingbird", [book valueForKey:@"title"], @"");
+    
+    [self runMainRunLoopUntilCondition:^BOOL{ return [[book valueForKey:@"title"] isEqualToString:@"Go Set a Watchman"]; } timeout:2.0];
+    XCTAssertEqualObjects(@"Go Set a Watchman", [book valueForKey:@"title"], @"");
+}
+
+#pragma mark - Sync Queue
+
+- (void)testStatusBurstShouldBeCollapsedIntoASingleSync
+{
+    self.syncManager.minimumSyncLatency = 0.05;
+    self.syncManager.maximumSyncLatency = 1.0;
+    [self.syncManager startObserving];
+    
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{}];
+    }
+    XCTAssertEqual((NSUInteger)0, [(PKDatastoreMock *)self.datastore syncCount], @"");
+    
+    [self runMainRunLoopUntilCondition:^BOOL{ return [(PKDatastoreMock *)self.datastore syncCount] > 0; } timeout:2.0];
+    [self runMainRunLoopUntilCondition:^BOOL{ return NO; } timeout:0.2];
+    XCTAssertEqual((NSUInteger)1, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testStatusBurstShouldNotPutOffSyncPastMaximumLatency
+{
+    self.syncManager.minimumSyncLatency = 10.0;
+    self.syncManager.maximumSyncLatency = 0.05;
+    [self.syncManager startObserving];
+    
+    [self.datastore updateStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{}];
+    [self runMainRunLoopUntilCondition:^BOOL{ return [(PKDatastoreMock *)self.datastore syncCount] > 0; } timeout:2.0];
+    XCTAssertEqual((NSUInteger)1, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testManualSyncShouldWaitForWorkOnSyncQueue
+{
+    __block BOOL finished = NO;
+    dispatch_async([self.syncManager syncQueue], ^{
+        [NSThread sleepForTimeInterval:0.1];
+        finished = YES;
+    });
+    
+    [self.syncManager syncDatastore];
+    XCTAssertTrue(finished, @"");
+    XCTAssertEqual((NSUInteger)1, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testCoreDataSaveShouldNotWaitForSyncInProgress
+{
+    [self.syncManager startObserving];
+    dispatch_semaphore_t syncing = dispatch_semaphore_create(0);
+    dispatch_async([self.syncManager syncQueue], ^{
+        dispatch_semaphore_wait(syncing, DISPATCH_TIME_FOREVER);
+    });
+    
+    NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    XCTAssertNil([[self.datastore getTable:@"books"] getRecord:@"1" error:nil], @"");
+    
+    // The save is written with the values it had, even when they change before the sync queue gets to it
+    [object setValue:@"Go Set a Watchman" forKey:@"title"];
+    dispatch_semaphore_signal(syncing);
+    dispatch_sync([self.syncManager syncQueue], ^{});
+    XCTAssertEqualObjects(@"To Kill a Mockingbird", [[[self.datastore getTable:@"books"] getRecord:@"1" error:nil] objectForKey:@"title"], @"");
+}
+
+- (void)testStatusNotificationsShouldBeThrottled
+{
+    self.syncManager.maximumStatusNotificationsPerSecond = 4;
+    [self.syncManager startObserving];
+    
+    NSMutableArray *statuses = [[NSMutableArray alloc] init];
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:PKSyncManagerDatastoreStatusDidChangeNotification object:self.syncManager queue:nil usingBlock:^(NSNotification *notification) {
+        [statuses addObject:[[notification userInfo] objectForKey:PKSyncManagerDatastoreStatusKey]];
+    }];
+    
+    PKDatastoreStatusMock *lastStatus = nil;
+    for (NSUInteger i = 0; i < 5; i++) {
+        lastStatus = [PKDatastoreStatusMock datastoreStatusWithIncoming:NO];
+        [self updateDatastoreStatus:lastStatus withChanges:nil];
+    }
+    XCTAssertEqual((NSUInteger)1, [statuses count], @"");
+    
+    [self runMainRunLoopUntilCondition:^BOOL{ return [statuses count] > 1; } timeout:2.0];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    XCTAssertEqual((NSUInteger)2, [statuses count], @"");
+    XCTAssertTrue(lastStatus == [statuses lastObject], @"");
+}
+
+#pragma mark - Metrics
+
+- (void)testIncomingChangesShouldBeCountedInSyncMetrics
+{
+    [self.syncManager startObserving];
+    
+    __block PKSyncMetrics *metrics = nil;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:PKSyncManagerSyncMetricsNotification object:self.syncManager queue:nil usingBlock:^(NSNotification *notification) {
+        metrics = [[notification userInfo] objectForKey:PKSyncManagerSyncMetricsKey];
+    }];
+    
+    PKRecordMock *bookA = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird"}];
+    PKRecordMock *bookB = [PKRecordMock record:@"2" withFields:@{@"title": @"The Grapes of Wrath"}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[bookA, bookB]}];
+    [self runMainRunLoopUntilCondition:^BOOL{ return metrics != nil; } timeout:2.0];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    
+    XCTAssertNotNil(metrics, @"");
+    XCTAssertEqual((NSUInteger)2, metrics.numberOfRecordsIn, @"");
+    XCTAssertEqualObjects(@{@"books": @2}, metrics.numberOfRecordsInByTableID, @"");
+    XCTAssertEqual((NSUInteger)0, metrics.numberOfRecordsOut, @"");
+    XCTAssertTrue(metrics.numberOfFetches > 0, @"");
+    XCTAssertEqualObjects(@1, [[metrics histogramForPhase:PKSyncPhaseDatastoreSync] valueForKeyPath:@"@sum.self"], @"");
+    XCTAssertEqualObjects(@1, [[metrics histogramForPhase:PKSyncPhaseSave] valueForKeyPath:@"@sum.self"], @"");
+    XCTAssertTrue(metrics.duration > 0, @"");
+}
+
+- (void)testSavedChangesShouldBeCountedInSyncMetrics
+{
+    [self.syncManager startObserving];
+    
+    __block PKSyncMetrics *metrics = nil;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:PKSyncManagerSyncMetricsNotification object:self.syncManager queue:nil usingBlock:^(NSNotification *notification) {
+        metrics = [[notification userInfo] objectForKey:PKSyncManagerSyncMetricsKey];
+    }];
+    
+    NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [book setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [book setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self runMainRunLoopUntilCondition:^BOOL{ return metrics != nil; } timeout:2.0];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    
+    XCTAssertNotNil(metrics, @"");
+    XCTAssertEqual((NSUInteger)1, metrics.numberOfRecordsOut, @"");
+    XCTAssertEqualObjects(@{@"books": @1}, metrics.numberOfRecordsOutByTableID, @"");
+    XCTAssertEqualObjects(@1, [[metrics histogramForPhase:PKSyncPhaseMapping] valueForKeyPath:@"@sum.self"], @"");
+}
+
+- (void)testSyncMetricsShouldNotBePostedWhenNotCollected
+{
+    self.syncManager.collectsSyncMetrics = NO;
+    [self.syncManager startObserving];
+    
+    __block BOOL posted = NO;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:PKSyncManagerSyncMetricsNotification object:self.syncManager queue:nil usingBlock:^(NSNotification *notification) {
+        posted = YES;
+    }];
+    
+    PKRecordMock *book = [PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird"}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[book]}];
+    [self runMainRunLoopUntilCondition:^BOOL{ return posted; } timeout:0.2];
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    XCTAssertFalse(posted, @"");
+}
+
+#pragma mark - Outbox
+
+- (void)testWriteBehindSavesShouldBeWrittenWithASingleSync
+{
+    self.syncManager.writeBehindInterval = 10.0;
+    [self.syncManager startObserving];
+    
+    NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [object setValue:[NSString stringWithFormat:@"Draft %lu", (unsigned long)i] forKey:@"title"];
+        XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    }
+    
+    DBTable *table = [self.datastore getTable:@"books"];
+    XCTAssertNil([table getRecord:@"1" error:nil], @"");
+    XCTAssertEqual((NSUInteger)0, [(PKDatastoreMock *)self.datastore syncCount], @"");
+    
+    [self.syncManager flushOutbox];
+    XCTAssertEqualObjects(@"Draft 9", [[table getRecord:@"1" error:nil] objectForKey:@"title"], @"");
+    XCTAssertEqual((NSUInteger)1, [(PKDatastoreMock *)self.datastore syncCount], @"");
+}
+
+- (void)testWriteBehindShouldDeleteRecordsOfDeletedObjects
+{
+    self.syncManager.writeBehindInterval = 10.0;
+    [self.syncManager startObserving];
+    
+    NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self.syncManager flushOutbox];
+    
+    DBTable *table = [self.datastore getTable:@"books"];
+    XCTAssertNotNil([table getRecord:@"1" error:nil], @"");
+    
+    [self.managedObjectContext deleteObject:object];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self.syncManager flushOutbox];
+    XCTAssertNil([table getRecord:@"1" error:nil], @"");
+}
+
+- (void)testOutboxShouldSurviveStoppingObserving
+{
+    NSURL *outboxURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    self.syncManager.writeBehindInterval = 10.0;
+    self.syncManager.outboxURL = outboxURL;
+    [self.syncManager startObserving];
+    
+    NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+    [object setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    [object setValue:@"To Kill a Mockingbird" forKey:@"title"];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    [self.syncManager stopObserving];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[outboxURL path]], @"");
+    
+    PKSyncManager *syncManager = [[PKSyncManager alloc] initWithManagedObjectContext:self.managedObjectContext datastore:self.datastore];
+    [syncManager setTablesForEntityNamesWithDictionary:[self.syncManager tablesByEntityName]];
+    syncManager.outboxURL = outboxURL;
+    [syncManager startObserving];
+    [syncManager flushOutbox];
+    [syncManager stopObserving];
+    
+    XCTAssertEqualObjects(@"To Kill a Mockingbird", [[[self.datastore getTable:@"books"] getRecord:@"1" error:nil] objectForKey:@"title"], @"");
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[outboxURL path]], @"");
+}
+
+#pragma mark - Change Recording
+
+- (void)testIncomingChangesShouldBeRecorded
+{
+    NSURL *recordingURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    self.syncManager.changeRecordingURL = recordingURL;
+    [self.syncManager startObserving];
+    
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:@{@"title": @"To Kill a Mockingbird"}]]}];
+    [self updateDatastoreStatus:[PKDatastoreStatusMock datastoreStatusWithIncoming:YES] withChanges:@{@"books": @[[PKRecordMock record:@"1" withFields:nil deleted:YES]]}];
+    
+    NSError *error = nil;
+    PKChangeRecorder *recorder = [PKChangeRecorder recorderWithContentsOfURL:recordingURL error:&error];
+    XCTAssertNotNil(recorder, @"%@", error);
+    XCTAssertEqualObjects([self.syncManager tablesByEntityName], recorder.tablesByEntityName, @"");
+    XCTAssertEqualObjects(self.syncManager.syncAttributeName, recorder.syncAttributeName, @"");
+    
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    XCTAssertTrue([recorder enumerateChangeSetsUsingBlock:^(NSDictionary *changes, NSDate *date, BOOL *stop) {
+        [books addObjectsFromArray:[changes objectForKey:@"books"]];
+    } error:&error], @"%@", error);
+    XCTAssertEqual((NSUInteger)2, [books count], @"");
+    XCTAssertEqualObjects(@"To Kill a Mockingbird", [[books objectAtIndex:0] valueForKeyPath:@"fields.title"], @"");
+    XCTAssertEqualObjects(@YES, [[books objectAtIndex:1] objectForKey:PKChangeRecorderDeletedKey], @"");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:recordingURL error:nil];
+}
+
+#pragma mark - Exporting
+
+- (BOOL)exportManagedObjectsWithProgressBlock:(void (^)(NSUInteger exportedCount, NSUInteger totalCount))progressBlock
+{
+    __block BOOL done = NO;
+    __block BOOL finished = NO;
+    [self.syncManager exportManagedObjectsWithProgressBlock:progressBlock completionBlock:^(BOOL exportFinished) {
+        finished = exportFinished;
+        done = YES;
+    }];
+    [self runMainRunLoopUntilCondition:^BOOL{ return done; } timeout:2.0];
+    return finished;
+}
+
+- (void)testExportShouldWriteExistingObjectsOfMappedEntities
+{
+    NSMutableArray *books = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < 3; i++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        [book setValue:[NSString stringWithFormat:@"Book %lu", (unsigned long)i] forKey:@"title"];
+        [books addObject:book];
+    }
+    [[books objectAtIndex:0] setValue:@"1" forKey:self.syncManager.syncAttributeName];
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    __block NSUInteger exportedCount = 0;
+    __block NSUInteger totalCount = 0;
+    XCTAssertTrue([self exportManagedObjectsWithProgressBlock:^(NSUInteger exported, NSUInteger total) {
+        exportedCount = exported;
+        totalCount = total;
+    }], @"");
+    XCTAssertEqual((NSUInteger)3, exportedCount, @"");
+    XCTAssertEqual((NSUInteger)3, totalCount, @"");
+    
+    DBTable *table = [self.datastore getTable:@"books"];
+    for (NSManagedObject *book in books) {
+        NSString *syncID = [book valueForKey:self.syncManager.syncAttributeName];
+        XCTAssertNotNil(syncID, @"");
+        XCTAssertEqualObjects([book valueForKey:@"title"], [[table getRecord:syncID error:nil] objectForKey:@"title"], @"");
+    }
+}
+
+- (void)testExportShouldResumeFromCheckpoint
+{
+    for (NSUInteger i = 1; i <= 3; i++) {
+        NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName:@"Book" inManagedObjectContext:self.managedObjectContext];
+        [book setValue:[NSString stringWithFormat:@"%lu", (unsigned long)i] forKey:self.syncManager.syncAttributeName];
+        [book setValue:[NSString stringWithFormat:@"Book %lu", (unsigned long)i] forKey:@"title"];
+    }
+    XCTAssertTrue([self.managedObjectContext save:nil], @"");
+    
+    NSURL *checkpointURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    NSData *checkpoint = [NSPropertyListSerialization dataWithPropertyList:@{@"Book": @"2"} format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+    XCTAssertTrue([checkpoint writeToURL:checkpointURL atomically:YES], @"");
+    self.syncManager.exportCheckpointURL = checkpointURL;
+    
+    __block NSUInteger exportedCount = 0;
+    XCTAssertTrue([self exportManagedObjectsWithProgressBlock:^(NSUInteger exported, NSUInteger total) {
+        exportedCount = exported;
+    }], @"");
+    XCTAssertEqual((NSUInteger)3, exportedCount, @"");
+    
+    DBTable *table = [self.datastore getTable:@"books"];
+    XCTAssertNil([table getRecord:@"1" error:nil], @"");
+    XCTAssertNil([table getRecord:@"2" error:nil], @"");
+    XCTAssertEqualObjects(@"Book 3", [[table getRecord:@"3" error:nil] objectForKey:@"title"], @"");
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[checkpointURL path]], @"");
+}
+
 @end
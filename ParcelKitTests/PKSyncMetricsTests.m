@@ -0,0 +1,85 @@
+//
+//  PKSyncMetricsTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "PKSyncMetrics.h"
+
+@interface PKSyncMetricsTests : XCTestCase
+@property (strong, nonatomic) PKSyncMetrics *metrics;
+@end
+
+@implementation PKSyncMetricsTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.metrics = [[PKSyncMetrics alloc] init];
+}
+
+- (void)testRecordsShouldBeCountedPerTable
+{
+    [self.metrics addRecordsIn:2 tableID:@"books"];
+    [self.metrics addRecordsIn:3 tableID:@"books"];
+    [self.metrics addRecordsIn:1 tableID:@"authors"];
+    [self.metrics addRecordsOut:4 tableID:@"books"];
+    
+    XCTAssertEqual((NSUInteger)6, self.metrics.numberOfRecordsIn, @"");
+    XCTAssertEqualObjects((@{@"books": @5, @"authors": @1}), self.metrics.numberOfRecordsInByTableID, @"");
+    XCTAssertEqual((NSUInteger)4, self.metrics.numberOfRecordsOut, @"");
+    XCTAssertEqualObjects(@{@"books": @4}, self.metrics.numberOfRecordsOutByTableID, @"");
+}
+
+- (void)testTimeShouldBeAddedToPhase
+{
+    [self.metrics addTimeSince:[PKSyncMetrics timestamp] - 0.5 toPhase:PKSyncPhaseSave];
+    [self.metrics addTimeSince:[PKSyncMetrics timestamp] - 0.25 toPhase:PKSyncPhaseSave];
+    
+    XCTAssertEqualWithAccuracy(0.75, [self.metrics timeInPhase:PKSyncPhaseSave], 0.1, @"");
+    XCTAssertEqual(0.0, [self.metrics timeInPhase:PKSyncPhaseLookup], @"");
+}
+
+- (void)testHistogramShouldBucketStepsByPowersOfTwoMicroseconds
+{
+    // 0.25s is 250000µs, between 2^17 and 2^18
+    [self.metrics addTimeSince:[PKSyncMetrics timestamp] - 0.25 toPhase:PKSyncPhaseMerge];
+    [self.metrics addTimeSince:[PKSyncMetrics timestamp] + 1.0 toPhase:PKSyncPhaseMerge];
+    [self.metrics addTimeSince:[PKSyncMetrics timestamp] - 3600.0 toPhase:PKSyncPhaseMerge];
+    
+    NSArray *histogram = [self.metrics histogramForPhase:PKSyncPhaseMerge];
+    XCTAssertEqual((NSUInteger)PKSyncMetricsHistogramBucketCount, [histogram count], @"");
+    XCTAssertEqualObjects(@1, [histogram objectAtIndex:0], @"");
+    XCTAssertEqualObjects(@1, [histogram objectAtIndex:17], @"");
+    XCTAssertEqualObjects(@1, [histogram lastObject], @"");
+    XCTAssertEqualObjects(@3, [histogram valueForKeyPath:@"@sum.self"], @"");
+}
+
+- (void)testFinishShouldSetDuration
+{
+    XCTAssertEqual(0.0, self.metrics.duration, @"");
+    [self.metrics finish];
+    XCTAssertTrue(self.metrics.duration > 0.0, @"");
+}
+
+@end
@@ -0,0 +1,150 @@
+//
+//  PKSyncTracerTests.m
+//  ParcelKit
+//
+//  Copyright (c) 2014 Overcommitted, LLC. All rights reserved.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+#import "PKSyncTracer.h"
+
+@interface PKSyncTracerTests : XCTestCase
+@property (strong, nonatomic) NSURL *traceURL;
+@end
+
+@implementation PKSyncTracerTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.traceURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]]];
+}
+
+- (void)tearDown
+{
+    [PKSyncTracer stopTracing];
+    [[NSFileManager defaultManager] removeItemAtURL:self.traceURL error:nil];
+    [super tearDown];
+}
+
+- (NSArray *)writtenTraceEvents
+{
+    NSError *error = nil;
+    XCTAssertTrue([PKSyncTracer writeTraceToURL:self.traceURL error:&error], @"%@", error);
+    
+    NSData *data = [NSData dataWithContentsOfURL:self.traceURL];
+    NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+    XCTAssertNotNil(trace, @"%@", error);
+    
+    // Only the spans of the tests, sync work left over from other tests may still be traced
+    NSSet *names = [NSSet setWithObjects:@"outer", @"inner", @"main", @"queue", @"ignored", @"earlier", @"later", @"exited", nil];
+    return [[trace objectForKey:@"traceEvents"] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"name IN %@", names]];
+}
+
+- (void)testSpansShouldBeWrittenAsBeginAndEndEvents
+{
+    [PKSyncTracer startTracing];
+    XCTAssertTrue([PKSyncTracer isTracing], @"");
+    {
+        PKTraceScope("outer", @"book \"1\"");
+        PKTraceScope("inner", nil);
+    }
+    [PKSyncTracer stopTracing];
+    
+    NSArray *events = [self writtenTraceEvents];
+    XCTAssertEqualObjects((@[@"outer", @"inner", @"inner", @"outer"]), [events valueForKey:@"name"], @"");
+    XCTAssertEqualObjects((@[@"B", @"B", @"E", @"E"]), [events valueForKey:@"ph"], @"");
+    
+    NSDictionary *outer = [events objectAtIndex:0];
+    XCTAssertEqualObjects(@"book \"1\"", [outer valueForKeyPath:@"args.detail"], @"");
+    XCTAssertEqualObjects(@"com.apple.main-thread", [outer valueForKeyPath:@"args.queue"], @"");
+    XCTAssertTrue([[[events lastObject] objectForKey:@"ts"] doubleValue] >= [[outer objectForKey:@"ts"] doubleValue], @"");
+}
+
+- (void)testSpansShouldBeTaggedWithTheirThreadAndQueue
+{
+    [PKSyncTracer startTracing];
+    {
+        PKTraceScope("main", nil);
+    }
+    dispatch_queue_t queue = dispatch_queue_create("ParcelKitTests.PKSyncTracer", DISPATCH_QUEUE_SERIAL);
+    dispatch_sync(queue, ^{
+        PKTraceScope("queue", nil);
+    });
+    [PKSyncTracer stopTracing];
+    
+    NSArray *events = [self writtenTraceEvents];
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"name == 'queue' AND ph == 'B'"];
+    NSDictionary *queueEvent = [[events filteredArrayUsingPredicate:predicate] lastObject];
+    XCTAssertEqualObjects(@"ParcelKitTests.PKSyncTracer", [queueEvent valueForKeyPath:@"args.queue"], @"");
+    XCTAssertNotNil([queueEvent objectForKey:@"tid"], @"");
+    XCTAssertEqual((NSUInteger)4, [events count], @"");
+}
+
+- (void)testSpansShouldNotBeRecordedWhileNotTracing
+{
+    [PKSyncTracer startTracing];
+    [PKSyncTracer stopTracing];
+    XCTAssertFalse([PKSyncTracer isTracing], @"");
+    {
+        PKTraceScope("ignored", nil);
+    }
+    
+    XCTAssertEqual((NSUInteger)0, [[self writtenTraceEvents] count], @"");
+}
+
+- (void)testStartingShouldDiscardEventsOfEarlierTraces
+{
+    [PKSyncTracer startTracing];
+    {
+        PKTraceScope("earlier", nil);
+    }
+    [PKSyncTracer startTracing];
+    {
+        PKTraceScope("later", nil);
+    }
+    [PKSyncTracer stopTracing];
+    
+    XCTAssertEqualObjects((@[@"later", @"later"]), [[self writtenTraceEvents] valueForKey:@"name"], @"");
+}
+
+- (void)testSpansOfExitedThreadsShouldBeWritten
+{
+    for (NSUInteger trace = 0; trace < 2; trace++) {
+        [PKSyncTracer startTracing];
+        NSThread *thread = [[NSThread alloc] initWithTarget:self selector:@selector(recordSpanOnExitingThread) object:nil];
+        [thread start];
+        while (![thread isFinished]) {
+            [NSThread sleepForTimeInterval:0.01];
+        }
+        [NSThread sleepForTimeInterval:0.05];
+        [PKSyncTracer stopTracing];
+        
+        XCTAssertEqualObjects((@[@"exited", @"exited"]), [[self writtenTraceEvents] valueForKey:@"name"], @"");
+    }
+}
+
+- (void)recordSpanOnExitingThread
+{
+    PKTraceScope("exited", nil);
+}
+
+@end